@@ -16,22 +16,41 @@
  *
  * Contents:
  *
- *   main()         - Send a file to the specified parallel port.
- *   drain_output() - Drain pending print data to the device.
- *   list_devices() - List all parallel devices.
- *   run_loop()     - Read and write print and back-channel data.
- *   side_cb()      - Handle side-channel requests...
+ *   main()             - Send a file to the specified parallel port.
+ *   drain_output()     - Drain pending print data to the device.
+ *   list_devices()     - List all parallel devices.
+ *   read_print_data()  - Read print data into the buffer or splice pipe.
+ *   run_loop()         - Read and write print and back-channel data.
+ *   side_cb()          - Handle side-channel requests...
+ *   write_print_data() - Write print data from the buffer or splice pipe.
  */
 
 /*
  * Include necessary headers.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE			/* splice() */
+#endif
 #include "backend-private.h"
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+
+
+/*
+ * Local globals...
+ */
+
+static int	splice_fds[2] = { -1, -1 },
+					/* Pipe for splice() */
+		drain_fds[2] = { -1, -1 };
+					/* Pipe for splice() in drain_output() */
+#ifdef HAVE_SPLICE
+static int	splice_state = 0;	/* 1 = working, 0 = untried, -1 = off */
+#endif /* HAVE_SPLICE */
 
 
 /*
@@ -40,9 +59,13 @@
 
 static int	drain_output(int print_fd, int device_fd);
 static void	list_devices(void);
+static ssize_t	read_print_data(int print_fd, char *buffer, size_t bufsize,
+		                int *fds, int *spliced);
 static ssize_t	run_loop(int print_fd, int device_fd, int use_bc,
 		         int update_state);
 static int	side_cb(int print_fd, int device_fd, int use_bc);
+static ssize_t	write_print_data(int device_fd, char *buffer, size_t bytes,
+		                 int *fds, int *spliced);
 
 
 /*
@@ -68,6 +91,10 @@ main(int  argc,				/* I - Number of command-line arguments (6 or 7) */
 		use_bc;			/* Read back-channel data? */
   int		copies;			/* Number of copies to print */
   ssize_t	tbytes;			/* Total number of bytes written */
+  double	total_bytes;		/* Bytes written for all copies */
+  struct timeval start,			/* Time the first copy started */
+		end;			/* Time the last copy ended */
+  double	secs;			/* Seconds spent sending */
   struct termios opts;			/* Parallel port options */
 #if defined(HAVE_SIGACTION) && !defined(HAVE_SIGSET)
   struct sigaction action;		/* Actions for POSIX signals */
@@ -246,7 +273,10 @@ main(int  argc,				/* I - Number of command-line arguments (6 or 7) */
   * Finally, send the print file...
   */
 
-  tbytes = 0;
+  tbytes      = 0;
+  total_bytes = 0.0;
+
+  gettimeofday(&start, NULL);
 
   while (copies > 0 && tbytes >= 0)
   {
@@ -260,14 +290,46 @@ main(int  argc,				/* I - Number of command-line arguments (6 or 7) */
 
     tbytes = run_loop(print_fd, device_fd, use_bc, 1);
 
+    if (tbytes > 0)
+      total_bytes += tbytes;
+
     if (print_fd != 0 && tbytes >= 0)
       fputs("INFO: Print file sent.\n", stderr);
   }
 
+ /*
+  * Report the throughput...
+  */
+
+  gettimeofday(&end, NULL);
+
+  secs = (end.tv_sec - start.tv_sec) +
+         0.000001 * (end.tv_usec - start.tv_usec);
+
+  fprintf(stderr,
+          "DEBUG: Sent %.0f bytes in %.3f seconds (%.0f bytes/sec%s).\n",
+          total_bytes, secs, secs > 0.0 ? total_bytes / secs : 0.0,
+#ifdef HAVE_SPLICE
+          splice_state > 0 ? ", using splice()" :
+#endif /* HAVE_SPLICE */
+          "");
+
  /*
   * Close the socket connection and input file and return...
   */
 
+  if (splice_fds[0] >= 0)
+  {
+    close(splice_fds[0]);
+    close(splice_fds[1]);
+  }
+
+  if (drain_fds[0] >= 0)
+  {
+    close(drain_fds[0]);
+    close(drain_fds[1]);
+  }
+
   close(device_fd);
 
   if (print_fd != 0)
@@ -279,6 +341,9 @@ main(int  argc,				/* I - Number of command-line arguments (6 or 7) */
 
 /*
  * 'drain_output()' - Drain pending print data to the device.
+ *
+ * The data is spliced through a pipe of its own, so a drain request never
+ * blocks on or picks up data the copy loop has left in its pipe.
  */
 
 static int				/* O - 0 on success, -1 on error */
@@ -291,6 +356,7 @@ drain_output(int print_fd,		/* I - Print file descriptor */
 		bytes;			/* Bytes written */
   char		print_buffer[8192],	/* Print data buffer */
 		*print_ptr;		/* Pointer into print data buffer */
+  int		spliced;		/* Is the data in the splice pipe? */
   struct timeval timeout;		/* Timeout for read... */
 
 
@@ -304,7 +370,7 @@ drain_output(int print_fd,		/* I - Print file descriptor */
   * Now loop until we are out of data from print_fd...
   */
 
-  for (;;)
+  for (spliced = 0;;)
   {
    /*
     * Use select() to determine whether we have data to copy around...
@@ -322,8 +388,9 @@ drain_output(int print_fd,		/* I - Print file descriptor */
     if (!FD_ISSET(print_fd, &input))
       return (0);
 
-    if ((print_bytes = read(print_fd, print_buffer,
-			    sizeof(print_buffer))) < 0)
+    if ((print_bytes = read_print_data(print_fd, print_buffer,
+				       sizeof(print_buffer), drain_fds,
+				       &spliced)) < 0)
     {
      /*
       * Read error - bail if we don't see EAGAIN or EINTR...
@@ -351,7 +418,8 @@ drain_output(int print_fd,		/* I - Print file descriptor */
 
     for (print_ptr = print_buffer; print_bytes > 0;)
     {
-      if ((bytes = write(device_fd, print_ptr, print_bytes)) < 0)
+      if ((bytes = write_print_data(device_fd, print_ptr, print_bytes,
+                                    drain_fds, &spliced)) < 0)
       {
        /*
         * Write error - bail if we don't see an error we can retry...
@@ -369,7 +437,8 @@ drain_output(int print_fd,		/* I - Print file descriptor */
         fprintf(stderr, "DEBUG: Wrote %d bytes of print data.\n", (int)bytes);
 
         print_bytes -= bytes;
-	print_ptr   += bytes;
+	if (!spliced)
+	  print_ptr += bytes;
       }
     }
   }
@@ -536,6 +605,53 @@ list_devices(void)
 }
 
 
+/*
+ * 'read_print_data()' - Read print data into the buffer or splice pipe.
+ *
+ * When splice() is available the data is moved from print_fd into a pipe
+ * without copying it through the buffer, and "spliced" is set.  Until the
+ * device has accepted spliced data no more than "bufsize" bytes are moved,
+ * so write_print_data() can still fall back to the buffer.
+ */
+
+static ssize_t				/* O - Bytes read, 0 on EOF, -1 on error */
+read_print_data(int    print_fd,	/* I - Print file descriptor */
+                char   *buffer,		/* I - Print data buffer */
+                size_t bufsize,		/* I - Size of buffer */
+		int    *fds,		/* I - Splice pipe */
+		int    *spliced)	/* O - 1 if the data is in the pipe */
+{
+#ifdef HAVE_SPLICE
+  ssize_t	bytes;			/* Bytes moved */
+
+
+  if (splice_state >= 0 && (fds[0] >= 0 || !pipe(fds)))
+  {
+    if ((bytes = splice(print_fd, NULL, fds[1], NULL,
+                        splice_state ? 65536 : bufsize, SPLICE_F_MOVE)) >= 0)
+    {
+      *spliced = 1;
+      return (bytes);
+    }
+    else if (errno != EINVAL && errno != ENOSYS)
+      return (-1);
+
+   /*
+    * print_fd cannot be spliced, so copy from now on...
+    */
+
+    fputs("DEBUG: Unable to splice print data, copying it instead.\n",
+          stderr);
+    splice_state = -1;
+  }
+#endif /* HAVE_SPLICE */
+
+  *spliced = 0;
+
+  return (read(print_fd, buffer, bufsize));
+}
+
+
 /*
  * 'run_loop()' - Read and write print and back-channel data.
  */
@@ -558,6 +674,7 @@ run_loop(int print_fd,			/* I - Print file descriptor */
   char		print_buffer[8192],	/* Print data buffer */
 		*print_ptr,		/* Pointer into print data buffer */
 		bc_buffer[1024];	/* Back-channel data buffer */
+  int		spliced;		/* Is the data in the splice pipe? */
   struct timeval timeout;		/* Timeout for select() */
   int           sc_ok;                  /* Flag a side channel error and
 					   stop using the side channel
@@ -615,7 +732,7 @@ run_loop(int print_fd,			/* I - Print file descriptor */
   */
 
   for (print_bytes = 0, print_ptr = print_buffer, offline = -1,
-           paperout = -1, total_bytes = 0;;)
+           paperout = -1, total_bytes = 0, spliced = 0;;)
   {
    /*
     * Use select() to determine whether we have data to copy around...
@@ -705,8 +822,9 @@ run_loop(int print_fd,			/* I - Print file descriptor */
 
     if (FD_ISSET(print_fd, &input))
     {
-      if ((print_bytes = read(print_fd, print_buffer,
-                              sizeof(print_buffer))) < 0)
+      if ((print_bytes = read_print_data(print_fd, print_buffer,
+                                         sizeof(print_buffer), splice_fds,
+					 &spliced)) < 0)
       {
        /*
         * Read error - bail if we don't see EAGAIN or EINTR...
@@ -742,7 +860,8 @@ run_loop(int print_fd,			/* I - Print file descriptor */
 
     if (print_bytes && FD_ISSET(device_fd, &output))
     {
-      if ((bytes = write(device_fd, print_ptr, print_bytes)) < 0)
+      if ((bytes = write_print_data(device_fd, print_ptr, print_bytes,
+                                    splice_fds, &spliced)) < 0)
       {
        /*
         * Write error - bail if we don't see an error we can retry...
@@ -787,8 +906,9 @@ run_loop(int print_fd,			/* I - Print file descriptor */
         fprintf(stderr, "DEBUG: Wrote %d bytes of print data...\n", (int)bytes);
 
         print_bytes -= bytes;
-	print_ptr   += bytes;
 	total_bytes += bytes;
+	if (!spliced)
+	  print_ptr += bytes;
       }
     }
   }
@@ -866,6 +986,54 @@ side_cb(int         print_fd,		/* I - Print file */
 }
 
 
+
+/*
+ * 'write_print_data()' - Write print data from the buffer or splice pipe.
+ */
+
+static ssize_t				/* O - Bytes written or -1 on error */
+write_print_data(int    device_fd,	/* I - Device file descriptor */
+                 char   *buffer,	/* I - Print data */
+                 size_t bytes,		/* I - Bytes to write */
+		 int    *fds,		/* I - Splice pipe */
+		 int    *spliced)	/* IO - 1 if the data is in the pipe */
+{
+#ifdef HAVE_SPLICE
+  ssize_t	written;		/* Bytes written */
+
+
+  if (*spliced)
+  {
+    if ((written = splice(fds[0], NULL, device_fd, NULL, bytes,
+                          SPLICE_F_MOVE)) >= 0)
+    {
+      splice_state = 1;
+      return (written);
+    }
+    else if (splice_state > 0 || errno != EINVAL)
+      return (-1);
+
+   /*
+    * The device driver does not accept spliced data; the pipe holds no more
+    * than a buffer full, so move it back into the buffer and copy from now
+    * on...
+    */
+
+    fputs("DEBUG: Device does not support splice(), copying print data "
+          "instead.\n", stderr);
+
+    splice_state = -1;
+    *spliced     = 0;
+
+    if (read(fds[0], buffer, bytes) != (ssize_t)bytes)
+      return (-1);
+  }
+#endif /* HAVE_SPLICE */
+
+  return (write(device_fd, buffer, bytes));
+}
+
+
 /*
  * End of "$Id$".
  */
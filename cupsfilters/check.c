@@ -15,6 +15,8 @@
  * Contents:
  *
  *   cupsCheckBytes() - Check to see if all bytes are zero.
+ *   cupsCheckFirst() - Find the first byte that does not match a value.
+ *   cupsCheckLast()  - Find the last byte that does not match a value.
  *   cupsCheckValue() - Check to see if all bytes match the given value.
  */
 
@@ -23,6 +25,10 @@
  */
 
 #include "driver.h"
+#include <string.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
 
 
 /*
@@ -33,35 +39,151 @@ int						/* O - 1 if they match */
 cupsCheckBytes(const unsigned char *bytes,	/* I - Bytes to check */
                int                 length)	/* I - Number of bytes to check */
 {
-  while (length > 7)
+  return (cupsCheckFirst(bytes, length, 0) < 0);
+}
+
+
+/*
+ * 'cupsCheckFirst()' - Find the first byte that does not match a value.
+ *
+ * Blocks of 64 and 16 bytes are compared with SSE2 where available, or one
+ * machine word at a time otherwise, before the remaining bytes are checked.
+ */
+
+int						/* O - Offset of first other byte or -1 */
+cupsCheckFirst(const unsigned char *bytes,	/* I - Bytes to check */
+               int                 length,	/* I - Number of bytes to check */
+	       const unsigned char value)	/* I - Value to check */
+{
+  int		offset = 0;			/* Current offset */
+#ifdef __SSE2__
+  __m128i	pattern = _mm_set1_epi8((char)value);
+						/* Value in every byte */
+  __m128i	eq;				/* Comparison result */
+  unsigned	mask;				/* Mask of matching bytes */
+
+
+  while (length - offset >= 64)
+  {
+    eq = _mm_and_si128(
+	     _mm_and_si128(
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + offset)),
+				pattern),
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + offset + 16)),
+				pattern)),
+	     _mm_and_si128(
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + offset + 32)),
+				pattern),
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + offset + 48)),
+				pattern)));
+
+    if (_mm_movemask_epi8(eq) != 0xffff)
+      break;
+
+    offset += 64;
+  }
+
+  while (length - offset >= 16)
+  {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			         _mm_loadu_si128((const __m128i *)(bytes + offset)),
+				 pattern));
+
+    if (mask != 0xffff)
+      return (offset + __builtin_ctz(~mask & 0xffff));
+
+    offset += 16;
+  }
+#else
+  unsigned long	pattern = value * (~0UL / 255),	/* Value in every byte */
+		word;				/* Current word */
+
+
+  while (length - offset >= (int)sizeof(word))
+  {
+    memcpy(&word, bytes + offset, sizeof(word));
+    if (word != pattern)
+      break;
+
+    offset += sizeof(word);
+  }
+#endif /* __SSE2__ */
+
+  for (; offset < length; offset ++)
+    if (bytes[offset] != value)
+      return (offset);
+
+  return (-1);
+}
+
+
+/*
+ * 'cupsCheckLast()' - Find the last byte that does not match a value.
+ */
+
+int						/* O - Offset of last other byte or -1 */
+cupsCheckLast(const unsigned char *bytes,	/* I - Bytes to check */
+              int                 length,	/* I - Number of bytes to check */
+	      const unsigned char value)	/* I - Value to check */
+{
+#ifdef __SSE2__
+  __m128i	pattern = _mm_set1_epi8((char)value);
+						/* Value in every byte */
+  __m128i	eq;				/* Comparison result */
+  unsigned	mask;				/* Mask of matching bytes */
+
+
+  while (length >= 64)
   {
-    if (*bytes++)
-      return (0);
-    if (*bytes++)
-      return (0);
-    if (*bytes++)
-      return (0);
-    if (*bytes++)
-      return (0);
-    if (*bytes++)
-      return (0);
-    if (*bytes++)
-      return (0);
-    if (*bytes++)
-      return (0);
-    if (*bytes++)
-      return (0);
-
-    length -= 8;
+    eq = _mm_and_si128(
+	     _mm_and_si128(
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + length - 64)),
+				pattern),
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + length - 48)),
+				pattern)),
+	     _mm_and_si128(
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + length - 32)),
+				pattern),
+		 _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + length - 16)),
+				pattern)));
+
+    if (_mm_movemask_epi8(eq) != 0xffff)
+      break;
+
+    length -= 64;
   }
 
+  while (length >= 16)
+  {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			         _mm_loadu_si128((const __m128i *)(bytes + length - 16)),
+				 pattern));
+
+    if (mask != 0xffff)
+      return (length - 16 + 31 - __builtin_clz(~mask & 0xffff));
+
+    length -= 16;
+  }
+#else
+  unsigned long	pattern = value * (~0UL / 255),	/* Value in every byte */
+		word;				/* Current word */
+
+
+  while (length >= (int)sizeof(word))
+  {
+    memcpy(&word, bytes + length - sizeof(word), sizeof(word));
+    if (word != pattern)
+      break;
+
+    length -= sizeof(word);
+  }
+#endif /* __SSE2__ */
+
   while (length > 0)
-    if (*bytes++)
-      return (0);
-    else
-      length --;
+    if (bytes[--length] != value)
+      return (length);
 
-  return (1);
+  return (-1);
 }
 
 
@@ -74,35 +196,7 @@ cupsCheckValue(const unsigned char *bytes,	/* I - Bytes to check */
                int                 length,	/* I - Number of bytes to check */
 	       const unsigned char value)	/* I - Value to check */
 {
-  while (length > 7)
-  {
-    if (*bytes++ != value)
-      return (0);
-    if (*bytes++ != value)
-      return (0);
-    if (*bytes++ != value)
-      return (0);
-    if (*bytes++ != value)
-      return (0);
-    if (*bytes++ != value)
-      return (0);
-    if (*bytes++ != value)
-      return (0);
-    if (*bytes++ != value)
-      return (0);
-    if (*bytes++ != value)
-      return (0);
-
-    length -= 8;
-  }
-
-  while (length > 0)
-    if (*bytes++ != value)
-      return (0);
-    else
-      length --;
-
-  return (1);
+  return (cupsCheckFirst(bytes, length, value) < 0);
 }
 
 
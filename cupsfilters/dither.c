@@ -14,9 +14,17 @@
  *
  * Contents:
  *
- *   cupsDitherDelete() - Free a dithering buffer.
- *   cupsDitherLine()   - Dither a line of pixels...
- *   cupsDitherNew()    - Create a dithering buffer.
+ *   cupsDitherDelete()     - Free a dithering buffer.
+ *   cupsDitherLine()       - Dither a line of pixels...
+ *   cupsDitherLines()      - Dither all color channels of a line.
+ *   cupsDitherNew()        - Create a dithering buffer.
+ *   cupsDitherPoolDelete() - Stop and free dithering threads.
+ *   cupsDitherPoolNew()    - Start threads for dithering color channels.
+ *   dither_init()          - Initialize the randomness table.
+ *   dither_line()          - Dither a line of pixels with a random source.
+ *   dither_rand()          - Return the next random number for a buffer.
+ *   dither_run()           - Dither channels until none are left.
+ *   dither_worker()        - Dithering thread.
  */
 
 /*
@@ -25,6 +33,101 @@
 
 #include "driver.h"
 #include <config.h>
+#include <stddef.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Types...
+ */
+
+typedef struct cups_dither_priv_s	/**** Dithering buffer and private data ****/
+{
+  unsigned		seed;		/* Random number state for
+					   cupsDitherLines() */
+  cups_dither_t		dither;		/* Public dithering buffer (last) */
+} cups_dither_priv_t;
+
+struct cups_dither_pool_s		/**** Dithering threads ****/
+{
+  int			num_threads;	/* Number of threads incl. caller */
+#ifdef HAVE_PTHREAD_H
+  pthread_t		threads[CUPS_MAX_CHAN];
+					/* Worker threads */
+  pthread_mutex_t	mutex;		/* Lock for the fields below */
+  pthread_cond_t	work_cond,	/* Signaled when a line is queued */
+			done_cond;	/* Signaled when a line is done */
+  int			shutdown,	/* Non-zero to stop the workers */
+			next_channel,	/* Next channel to dither */
+			num_channels,	/* Number of channels in line */
+			pending;	/* Channels not dithered yet */
+  cups_dither_t		**d;		/* Dither states */
+  cups_lut_t		**luts;		/* Lookup tables */
+  const short		*data;		/* Separation data */
+  unsigned char		**p;		/* Output pixels */
+#endif /* HAVE_PTHREAD_H */
+};
+
+
+/*
+ * Macros...
+ */
+
+#define DITHER_PRIV(d)	((cups_dither_priv_t *)((char *)(d) - \
+			 offsetof(cups_dither_priv_t, dither)))
+
+
+/*
+ * Local globals...
+ */
+
+static char	logtable[16384];	/* Error magnitude for randomness */
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t logonce = PTHREAD_ONCE_INIT;
+					/* Initialize the table once */
+#else
+static char	loginit = 0;		/* Has the table been initialized? */
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Local functions...
+ */
+
+static void	dither_init(void);
+static void	dither_line(cups_dither_t *d, const cups_lut_t *lut,
+		            const short *data, int num_channels,
+			    unsigned char *p, unsigned *seed);
+#ifdef HAVE_PTHREAD_H
+static void	dither_run(cups_dither_pool_t *pool);
+static void	*dither_worker(void *data);
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * 'dither_rand()' - Return the next random number for a buffer.
+ *
+ * cupsDitherLines() gives each buffer its own xorshift generator so that
+ * the output of a channel doesn't depend on which thread dithers it or in
+ * what order.
+ */
+
+static inline int			/* O  - Random number from 0 to 2^31-1 */
+dither_rand(unsigned *seed)		/* IO - Generator state */
+{
+  unsigned	s = *seed;		/* New state */
+
+
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+
+  *seed = s;
+
+  return ((int)(s >> 1));
+}
 
 
 /*
@@ -37,12 +140,15 @@ void
 cupsDitherDelete(cups_dither_t *d)	/* I - Dithering buffer */
 {
   if (d != NULL)
-    free(d);
+    free(DITHER_PRIV(d));
 }
 
 
 /*
  * 'cupsDitherLine()' - Dither a line of pixels...
+ *
+ * The random noise comes from CUPS_RAND(), so the channels must be
+ * dithered in the same order to get the same output.
  */
 
 void
@@ -52,6 +158,235 @@ cupsDitherLine(cups_dither_t    *d,	/* I - Dither data */
 	       int              num_channels,
 					/* I - Number of components */
 	       unsigned char    *p)	/* O - Pixels */
+{
+  dither_line(d, lut, data, num_channels, p, NULL);
+}
+
+
+/*
+ * 'cupsDitherLines()' - Dither all color channels of a line.
+ *
+ * Channel "i" of the interleaved separation data is dithered with d[i] and
+ * luts[i] into p[i].  The channels are shared between the pool's threads.
+ * "pool" may be NULL to dither in the calling thread.
+ *
+ * Without a pool, or with a pool of one thread, this is the same as calling
+ * cupsDitherLine() for each channel in turn.  With more threads each buffer
+ * draws its noise from its own generator instead of the process-wide
+ * CUPS_RAND() stream, so the output is the same for any number of threads
+ * but not the same as without them.  The buffers must come from
+ * cupsDitherNew().
+ */
+
+void
+cupsDitherLines(cups_dither_pool_t *pool,
+					/* I - Dithering threads or NULL */
+                cups_dither_t      **d,	/* I - Dither data */
+		cups_lut_t         **luts,
+					/* I - Lookup tables */
+		const short        *data,
+					/* I - Separation data */
+		int                num_channels,
+					/* I - Number of components */
+		unsigned char      **p)	/* O - Pixels */
+{
+  int	i;				/* Looping var */
+
+
+#ifdef HAVE_PTHREAD_H
+  if (pool && pool->num_threads > 1)
+  {
+   /*
+    * Seed new buffers from their channel number so that every run gives the
+    * same output...
+    */
+
+    for (i = 0; i < num_channels; i ++)
+      if (!DITHER_PRIV(d[i])->seed)
+	DITHER_PRIV(d[i])->seed = 0x9e3779b9U * (unsigned)(i + 1);
+
+    if (num_channels == 1)
+    {
+      dither_line(d[0], luts[0], data, 1, p[0], &(DITHER_PRIV(d[0])->seed));
+      return;
+    }
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    pool->d            = d;
+    pool->luts         = luts;
+    pool->data         = data;
+    pool->p            = p;
+    pool->next_channel = 0;
+    pool->num_channels = num_channels;
+    pool->pending      = num_channels;
+
+    pthread_cond_broadcast(&(pool->work_cond));
+
+   /*
+    * Take a share of the channels ourselves and wait for the rest...
+    */
+
+    dither_run(pool);
+
+    while (pool->pending > 0)
+      pthread_cond_wait(&(pool->done_cond), &(pool->mutex));
+
+    pthread_mutex_unlock(&(pool->mutex));
+    return;
+  }
+#else
+  (void)pool;
+#endif /* HAVE_PTHREAD_H */
+
+  for (i = 0; i < num_channels; i ++)
+    dither_line(d[i], luts[i], data + i, num_channels, p[i], NULL);
+}
+
+
+/*
+ * 'cupsDitherNew()' - Create an error-diffusion dithering buffer.
+ */
+
+cups_dither_t *			/* O - New state array */
+cupsDitherNew(int width)	/* I - Width of output in pixels */
+{
+  cups_dither_priv_t	*dp;	/* New dithering buffer */
+
+
+  if ((dp = (cups_dither_priv_t *)calloc(1, sizeof(cups_dither_priv_t) +
+                                         2 * (width + 4) *
+				             sizeof(int))) == NULL)
+    return (NULL);
+
+  dp->dither.width = width;
+
+  return (&(dp->dither));
+}
+
+
+/*
+ * 'cupsDitherPoolDelete()' - Stop and free dithering threads.
+ */
+
+void
+cupsDitherPoolDelete(
+    cups_dither_pool_t *pool)		/* I - Dithering threads */
+{
+#ifdef HAVE_PTHREAD_H
+  int	i;				/* Looping var */
+#endif /* HAVE_PTHREAD_H */
+
+
+  if (!pool)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(pool->mutex));
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&(pool->work_cond));
+  pthread_mutex_unlock(&(pool->mutex));
+
+  for (i = 0; i < pool->num_threads - 1; i ++)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&(pool->work_cond));
+  pthread_cond_destroy(&(pool->done_cond));
+  pthread_mutex_destroy(&(pool->mutex));
+#endif /* HAVE_PTHREAD_H */
+
+  free(pool);
+}
+
+
+/*
+ * 'cupsDitherPoolNew()' - Start threads for dithering color channels.
+ *
+ * "num_threads" includes the thread calling cupsDitherLines(); 0 uses one
+ * thread per online CPU.  Error diffusion carries the error from pixel to
+ * pixel and the serpentine rows reverse direction, so the color channels
+ * are what is dithered in parallel.
+ */
+
+cups_dither_pool_t *			/* O - Dithering threads or NULL */
+cupsDitherPoolNew(int num_threads)	/* I - Number of threads */
+{
+  cups_dither_pool_t	*pool;		/* Dithering threads */
+
+
+  if (num_threads <= 0)
+  {
+#ifdef _SC_NPROCESSORS_ONLN
+    num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* _SC_NPROCESSORS_ONLN */
+
+    if (num_threads <= 0)
+      num_threads = 1;
+  }
+
+  if (num_threads > CUPS_MAX_CHAN)
+    num_threads = CUPS_MAX_CHAN;
+
+  if ((pool = (cups_dither_pool_t *)calloc(1, sizeof(cups_dither_pool_t))) ==
+          NULL)
+    return (NULL);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&(pool->mutex), NULL);
+  pthread_cond_init(&(pool->work_cond), NULL);
+  pthread_cond_init(&(pool->done_cond), NULL);
+
+  for (pool->num_threads = 1; pool->num_threads < num_threads;
+       pool->num_threads ++)
+    if (pthread_create(pool->threads + pool->num_threads - 1, NULL,
+                       dither_worker, pool))
+      break;
+#else
+  pool->num_threads = 1;
+#endif /* HAVE_PTHREAD_H */
+
+  return (pool);
+}
+
+
+/*
+ * 'dither_init()' - Initialize the randomness table.
+ */
+
+static void
+dither_init(void)
+{
+  int	x;				/* Looping var */
+
+
+ /*
+  * Initialize a logarithmic table for the magnitude of randomness
+  * that is introduced.
+  */
+
+  logtable[0] = 0;
+  for (x = 1; x < 2049; x ++)
+    logtable[x] = (int)(log(x / 16.0) / log(2.0) + 1.0);
+  for (; x < 16384; x ++)
+    logtable[x] = logtable[2049];
+}
+
+
+/*
+ * 'dither_line()' - Dither a line of pixels with a random source.
+ *
+ * "seed" is the buffer's own generator, or NULL to use CUPS_RAND() like
+ * cupsDitherLine() always has.
+ */
+
+static void
+dither_line(cups_dither_t    *d,	/* I  - Dither data */
+            const cups_lut_t *lut,	/* I  - Lookup table */
+	    const short      *data,	/* I  - Separation data */
+	    int              num_channels,
+					/* I  - Number of components */
+	    unsigned char    *p,	/* O  - Pixels */
+	    unsigned         *seed)	/* IO - Generator state or NULL */
 {
   register int	x,			/* Horizontal position in line... */
 		pixel,			/* Current adjusted pixel... */
@@ -65,25 +400,17 @@ cupsDitherLine(cups_dither_t    *d,	/* I - Dither data */
 		errrange;		/* Range of random multiplier */
   register int	*p0,			/* Error buffer pointers... */
 		*p1;
-  static char	logtable[16384];	/* Error magnitude for randomness */
-  static char	loginit = 0;		/* Has the table been initialized? */
 
 
+#ifdef HAVE_PTHREAD_H
+  pthread_once(&logonce, dither_init);
+#else
   if (!loginit)
   {
-   /*
-    * Initialize a logarithmic table for the magnitude of randomness
-    * that is introduced.
-    */
-
     loginit = 1;
-
-    logtable[0] = 0;
-    for (x = 1; x < 2049; x ++)
-      logtable[x] = (int)(log(x / 16.0) / log(2.0) + 1.0);
-    for (; x < 16384; x ++)
-      logtable[x] = logtable[2049];
+    dither_init();
   }
+#endif /* HAVE_PTHREAD_H */
 
   if (d->row == 0)
   {
@@ -153,7 +480,12 @@ cupsDitherLine(cups_dither_t    *d,	/* I - Dither data */
       * Randomize the error value.
       */
 
-      if (errrange > 1)
+      if (errrange > 1 && seed)
+      {
+        errbase0 = errbase + (dither_rand(seed) % errrange);
+        errbase1 = errbase + (dither_rand(seed) % errrange);
+      }
+      else if (errrange > 1)
       {
         errbase0 = errbase + (CUPS_RAND() % errrange);
         errbase1 = errbase + (CUPS_RAND() % errrange);
@@ -247,7 +579,12 @@ cupsDitherLine(cups_dither_t    *d,	/* I - Dither data */
       * Randomize the error value.
       */
 
-      if (errrange > 1)
+      if (errrange > 1 && seed)
+      {
+        errbase0 = errbase + (dither_rand(seed) % errrange);
+        errbase1 = errbase + (dither_rand(seed) % errrange);
+      }
+      else if (errrange > 1)
       {
         errbase0 = errbase + (CUPS_RAND() % errrange);
         errbase1 = errbase + (CUPS_RAND() % errrange);
@@ -280,25 +617,63 @@ cupsDitherLine(cups_dither_t    *d,	/* I - Dither data */
 }
 
 
+#ifdef HAVE_PTHREAD_H
 /*
- * 'cupsDitherNew()' - Create an error-diffusion dithering buffer.
+ * 'dither_run()' - Dither channels until none are left.
+ *
+ * Called and returns with the pool locked.
  */
 
-cups_dither_t *			/* O - New state array */
-cupsDitherNew(int width)	/* I - Width of output in pixels */
+static void
+dither_run(cups_dither_pool_t *pool)	/* I - Dithering threads */
 {
-  cups_dither_t	*d;		/* New dithering buffer */
+  int	c;				/* Channel to dither */
 
 
-  if ((d = (cups_dither_t *)calloc(1, sizeof(cups_dither_t) +
-                                   2 * (width + 4) *
-				       sizeof(int))) == NULL)
-    return (NULL);
+  while (pool->next_channel < pool->num_channels)
+  {
+    c = pool->next_channel ++;
+
+    pthread_mutex_unlock(&(pool->mutex));
+
+    dither_line(pool->d[c], pool->luts[c], pool->data + c,
+                pool->num_channels, pool->p[c],
+		&(DITHER_PRIV(pool->d[c])->seed));
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    if (-- pool->pending == 0)
+      pthread_cond_signal(&(pool->done_cond));
+  }
+}
+
+
+/*
+ * 'dither_worker()' - Dithering thread.
+ */
+
+static void *				/* O - Thread exit value */
+dither_worker(void *data)		/* I - Dithering threads */
+{
+  cups_dither_pool_t	*pool = (cups_dither_pool_t *)data;
+					/* Dithering threads */
+
+
+  pthread_mutex_lock(&(pool->mutex));
+
+  while (!pool->shutdown)
+  {
+    if (pool->next_channel < pool->num_channels)
+      dither_run(pool);
+    else
+      pthread_cond_wait(&(pool->work_cond), &(pool->mutex));
+  }
 
-  d->width = width;
+  pthread_mutex_unlock(&(pool->mutex));
 
-  return (d);
+  return (NULL);
 }
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
@@ -77,6 +77,9 @@ typedef struct cups_dither_s		/**** Dithering State ****/
   int		errors[96];		/* Error values */
 } cups_dither_t;
 
+typedef struct cups_dither_pool_s cups_dither_pool_t;
+					/**** Dithering threads ****/
+
 typedef struct cups_sample_s		/**** Color sample point ****/
 {
   unsigned char	rgb[3];			/* sRGB values */
@@ -139,6 +142,10 @@ extern ppd_attr_t	*cupsFindAttr(ppd_file_t *ppd, const char *name,
 extern int		cupsCheckBytes(const unsigned char *, int);
 extern int		cupsCheckValue(const unsigned char *, int,
 			               const unsigned char);
+extern int		cupsCheckFirst(const unsigned char *, int,
+			               const unsigned char);
+extern int		cupsCheckLast(const unsigned char *, int,
+			               const unsigned char);
 
 /*
  * Dithering functions...
@@ -149,6 +156,12 @@ extern void		cupsDitherLine(cups_dither_t *d, const cups_lut_t *lut,
 				       unsigned char *p);
 extern cups_dither_t	*cupsDitherNew(int width);
 extern void		cupsDitherDelete(cups_dither_t *);
+extern void		cupsDitherLines(cups_dither_pool_t *pool,
+			                cups_dither_t **d, cups_lut_t **luts,
+					const short *data, int num_channels,
+					unsigned char **p);
+extern cups_dither_pool_t *cupsDitherPoolNew(int num_threads);
+extern void		cupsDitherPoolDelete(cups_dither_pool_t *pool);
 
 /*
  * Lookup table functions for dithering...
@@ -17,6 +17,9 @@
  * Contents:
  *
  *   _cupsImageReadBMP() - Read a BMP image file.
+ *   bmp_decode()        - Decode rows of an uncompressed BMP image on demand.
+ *   bmp_done()          - Close a BMP image file and free its buffers.
+ *   bmp_put_row()       - Convert and store a row of a BMP image.
  *   read_word()         - Read a 16-bit unsigned integer.
  *   read_dword()        - Read a 32-bit unsigned integer.
  *   read_long()         - Read a 32-bit signed integer.
@@ -39,10 +42,34 @@
 #  define BI_BITFIELDS	3		/* RGB bitmap with RGB masks */
 
 
+/*
+ * Local types...
+ */
+
+typedef struct cups_bmp_s		/**** BMP decoder state ****/
+{
+  FILE		*fp;			/* Image file */
+  long		offset;			/* Offset of bottom row in file */
+  int		depth,			/* Depth of image (bits) */
+		rowbytes,		/* Bytes per row in file */
+		saturation,		/* Color saturation (%) */
+		hue;			/* Color hue (degrees) */
+  const cups_ib_t *lut;			/* Lookup table or NULL */
+  cups_ib_t	lutdata[256],		/* Copy of lookup table */
+		colormap[256][4],	/* Colormap */
+		*row,			/* Row from file */
+		*in,			/* Input pixels */
+		*out;			/* Output pixels */
+} cups_bmp_t;
+
+
 /*
  * Local functions...
  */
 
+static int		bmp_decode(cups_image_t *img, int y, int height);
+static void		bmp_done(cups_image_t *img);
+static void		bmp_put_row(cups_image_t *img, cups_bmp_t *bmp, int y);
 static unsigned short	read_word(FILE *fp);
 static unsigned int	read_dword(FILE *fp);
 static int		read_long(FILE *fp);
@@ -70,18 +97,14 @@ _cupsImageReadBMP(
 		image_size,		/* Size of image in bytes */
 		colors_used,		/* Number of colors used */
 		colors_important,	/* Number of important colors */
-		bpp,			/* Bytes per pixel */
 		x, y,			/* Looping vars */
 		color,			/* Color of RLE pixel */
 		count,			/* Number of times to repeat */
 		temp,			/* Temporary color */
 		align;			/* Alignment bytes */
-  cups_ib_t	bit,			/* Bit in image */
-		byte;			/* Byte in image */
-  cups_ib_t	*in,			/* Input pixels */
-		*out,			/* Output pixels */
-		*ptr;			/* Pointer into pixels */
-  cups_ib_t	colormap[256][4];	/* Colormap */
+  cups_ib_t	bit;			/* Bit in image */
+  cups_ib_t	*ptr;			/* Pointer into pixels */
+  cups_bmp_t	*bmp;			/* Decoder state */
 
 
   (void)secondary;
@@ -168,10 +191,29 @@ _cupsImageReadBMP(
   if (colors_used == 0 && depth <= 8)
     colors_used = 1 << depth;
 
+  if ((bmp = calloc(1, sizeof(cups_bmp_t))) == NULL)
+  {
+    fputs("DEBUG: Unable to allocate memory!\n", stderr);
+    fclose(fp);
+    return (1);
+  }
+
+  bmp->fp         = fp;
+  bmp->depth      = depth;
+  bmp->saturation = saturation;
+  bmp->hue        = hue;
+
+  if (lut)
+  {
+    memcpy(bmp->lutdata, lut, sizeof(bmp->lutdata));
+    bmp->lut = bmp->lutdata;
+  }
+
+  img->decode_data = bmp;
+  img->decode_done = bmp_done;
+
   if (colors_used > 0)
-    fread(colormap, colors_used, 4, fp);
-  else
-    memset(colormap, 0, sizeof(colormap));
+    fread(bmp->colormap, colors_used, 4, fp);
 
  /*
   * Setup image and buffers...
@@ -181,25 +223,32 @@ _cupsImageReadBMP(
 
   cupsImageSetMaxTiles(img, 0);
 
-  bpp = cupsImageGetDepth(img);
+  bmp->rowbytes = (img->xsize * depth + 31) / 32 * 4;
 
-  if ((in = malloc(img->xsize * 3)) == NULL)
+  if ((bmp->in = malloc(img->xsize * 3)) == NULL ||
+      (bmp->out = malloc(img->xsize * cupsImageGetDepth(img))) == NULL ||
+      (bmp->row = malloc(bmp->rowbytes)) == NULL)
   {
     fputs("DEBUG: Unable to allocate memory!\n", stderr);
-    fclose(fp);
     return (1);
   }
 
-  if ((out = malloc(img->xsize * bpp)) == NULL)
+  if ((depth != 4 || compression != BI_RLE4) &&
+      (depth != 8 || compression != BI_RLE8))
   {
-    fputs("DEBUG: Unable to allocate memory!\n", stderr);
-    free(in);
-    fclose(fp);
-    return (1);
+   /*
+    * Uncompressed rows have a fixed size, so only decode them when they are
+    * needed...
+    */
+
+    bmp->offset = ftell(fp);
+    img->decode = bmp_decode;
+
+    return (0);
   }
 
  /*
-  * Read the image data...
+  * Read the run-length encoded image data...
   */
 
   color = 0;
@@ -208,43 +257,10 @@ _cupsImageReadBMP(
 
   for (y = img->ysize - 1; y >= 0; y --)
   {
-    ptr = in;
+    ptr = bmp->in;
 
     switch (depth)
     {
-      case 1 : /* Bitmap */
-          for (x = img->xsize, bit = 128, byte = 0; x > 0; x --)
-	  {
-	    if (bit == 128)
-	      byte = getc(fp);
-
-	    if (byte & bit)
-	    {
-	      *ptr++ = colormap[1][2];
-	      *ptr++ = colormap[1][1];
-	      *ptr++ = colormap[1][0];
-	    }
-	    else
-	    {
-	      *ptr++ = colormap[0][2];
-	      *ptr++ = colormap[0][1];
-	      *ptr++ = colormap[0][0];
-	    }
-
-	    if (bit > 1)
-	      bit >>= 1;
-	    else
-	      bit = 128;
-	  }
-
-         /*
-	  * Read remaining bytes to align to 32 bits...
-	  */
-
-	  for (temp = (img->xsize + 7) / 8; temp & 3; temp ++)
-	    getc(fp);
-          break;
-
       case 4 : /* 16-color */
           for (x = img->xsize, bit = 0xf0, temp = 0; x > 0; x --)
 	  {
@@ -325,9 +341,9 @@ _cupsImageReadBMP(
 	      * Copy the color value...
 	      */
 
-	      *ptr++ = colormap[temp >> 4][2];
-	      *ptr++ = colormap[temp >> 4][1];
-	      *ptr++ = colormap[temp >> 4][0];
+	      *ptr++ = bmp->colormap[temp >> 4][2];
+	      *ptr++ = bmp->colormap[temp >> 4][1];
+	      *ptr++ = bmp->colormap[temp >> 4][0];
 	      bit    = 0x0f;
             }
 	    else
@@ -336,9 +352,9 @@ _cupsImageReadBMP(
 	      * Copy the color value...
 	      */
 
-	      *ptr++ = colormap[temp & 15][2];
-	      *ptr++ = colormap[temp & 15][1];
-	      *ptr++ = colormap[temp & 15][0];
+	      *ptr++ = bmp->colormap[temp & 15][2];
+	      *ptr++ = bmp->colormap[temp & 15][1];
+	      *ptr++ = bmp->colormap[temp & 15][0];
 	      bit    = 0xf0;
 	    }
 	  }
@@ -422,72 +438,165 @@ _cupsImageReadBMP(
 	    * Copy the color value...
 	    */
 
-	    *ptr++ = colormap[temp][2];
-	    *ptr++ = colormap[temp][1];
-	    *ptr++ = colormap[temp][0];
+	    *ptr++ = bmp->colormap[temp][2];
+	    *ptr++ = bmp->colormap[temp][1];
+	    *ptr++ = bmp->colormap[temp][0];
 	  }
           break;
 
-      case 24 : /* 24-bit RGB */
-          for (x = img->xsize; x > 0; x --, ptr += 3)
-	  {
-	    ptr[2] = getc(fp);
-	    ptr[1] = getc(fp);
-	    ptr[0] = getc(fp);
-	  }
+    }
 
-         /*
-	  * Read remaining bytes to align to 32 bits...
-	  */
+    bmp_put_row(img, bmp, y);
+  }
 
-	  for (temp = img->xsize * 3; temp & 3; temp ++)
-	    getc(fp);
-          break;
-    }
+  bmp_done(img);
 
-    if (saturation != 100 || hue != 0)
-      cupsImageRGBAdjust(in, img->xsize, saturation, hue);
+  return (0);
+}
 
-    switch (img->colorspace)
-    {
-      default :
-	  break;
 
-      case CUPS_IMAGE_WHITE :
-	  cupsImageRGBToWhite(in, out, img->xsize);
-	  break;
+/*
+ * 'bmp_decode()' - Decode rows of an uncompressed BMP image on demand.
+ */
 
-      case CUPS_IMAGE_RGB :
-	  cupsImageRGBToRGB(in, out, img->xsize);
-	  break;
+static int				/* O - 0 on success, -1 on error */
+bmp_decode(cups_image_t *img,		/* I - Image */
+           int          y,		/* I - First row */
+	   int          height)		/* I - Number of rows */
+{
+  cups_bmp_t	*bmp = (cups_bmp_t *)img->decode_data;
+					/* Decoder state */
+  int		x;			/* Looping var */
+  size_t	bytes;			/* Bytes read */
+  cups_ib_t	*inptr,			/* Pointer into row */
+		*ptr,			/* Pointer into pixels */
+		*color;			/* Colormap entry */
 
-      case CUPS_IMAGE_BLACK :
-	  cupsImageRGBToBlack(in, out, img->xsize);
-	  break;
 
-      case CUPS_IMAGE_CMY :
-	  cupsImageRGBToCMY(in, out, img->xsize);
-	  break;
+ /*
+  * Rows are stored bottom-up, so read the band from its last row; a short
+  * file keeps the rows that could be read and zeroes the rest of a partial
+  * row...
+  */
+
+  if (fseek(bmp->fp, bmp->offset + (long)(img->ysize - y - height) *
+                                    bmp->rowbytes, SEEK_SET))
+    return (-1);
+
+  for (y += height - 1; height > 0; height --, y --)
+  {
+    if ((bytes = fread(bmp->row, 1, bmp->rowbytes, bmp->fp)) == 0)
+      return (-1);
+    else if (bytes < (size_t)bmp->rowbytes)
+      memset(bmp->row + bytes, 0, bmp->rowbytes - bytes);
 
-      case CUPS_IMAGE_CMYK :
-	  cupsImageRGBToCMYK(in, out, img->xsize);
-	  break;
+    for (x = 0, inptr = bmp->row, ptr = bmp->in; x < img->xsize; x ++)
+    {
+      switch (bmp->depth)
+      {
+        case 1 : /* Bitmap */
+	    color = bmp->colormap[(inptr[x >> 3] >> (7 - (x & 7))) & 1];
+	    break;
+
+        case 4 : /* 16-color */
+	    color = bmp->colormap[(inptr[x >> 1] >> ((x & 1) ? 0 : 4)) & 15];
+	    break;
+
+        case 8 : /* 256-color */
+	    color = bmp->colormap[inptr[x]];
+	    break;
+
+	default : /* 24-bit RGB */
+	    color = inptr + 3 * x;
+	    break;
+      }
+
+      *ptr++ = color[2];
+      *ptr++ = color[1];
+      *ptr++ = color[0];
     }
 
-    if (lut)
-      cupsImageLut(out, img->xsize * bpp, lut);
+    bmp_put_row(img, bmp, y);
 
-    _cupsImagePutRow(img, 0, y, img->xsize, out);
+    if (bytes < (size_t)bmp->rowbytes)
+      return (-1);
   }
 
-  fclose(fp);
-  free(in);
-  free(out);
-
   return (0);
 }
 
 
+/*
+ * 'bmp_done()' - Close a BMP image file and free its buffers.
+ */
+
+static void
+bmp_done(cups_image_t *img)		/* I - Image */
+{
+  cups_bmp_t	*bmp = (cups_bmp_t *)img->decode_data;
+					/* Decoder state */
+
+
+  fclose(bmp->fp);
+  free(bmp->row);
+  free(bmp->in);
+  free(bmp->out);
+  free(bmp);
+
+  img->decode_data = NULL;
+  img->decode_done = NULL;
+}
+
+
+/*
+ * 'bmp_put_row()' - Convert and store a row of a BMP image.
+ */
+
+static void
+bmp_put_row(cups_image_t *img,		/* I - Image */
+            cups_bmp_t   *bmp,		/* I - Decoder state */
+	    int          y)		/* I - Row */
+{
+  cups_ib_t	*in = bmp->in,		/* Input pixels */
+		*out = bmp->out;	/* Output pixels */
+
+
+  if (bmp->saturation != 100 || bmp->hue != 0)
+    cupsImageRGBAdjust(in, img->xsize, bmp->saturation, bmp->hue);
+
+  switch (img->colorspace)
+  {
+    default :
+	break;
+
+    case CUPS_IMAGE_WHITE :
+	cupsImageRGBToWhite(in, out, img->xsize);
+	break;
+
+    case CUPS_IMAGE_RGB :
+	cupsImageRGBToRGB(in, out, img->xsize);
+	break;
+
+    case CUPS_IMAGE_BLACK :
+	cupsImageRGBToBlack(in, out, img->xsize);
+	break;
+
+    case CUPS_IMAGE_CMY :
+	cupsImageRGBToCMY(in, out, img->xsize);
+	break;
+
+    case CUPS_IMAGE_CMYK :
+	cupsImageRGBToCMYK(in, out, img->xsize);
+	break;
+  }
+
+  if (bmp->lut)
+    cupsImageLut(out, img->xsize * cupsImageGetDepth(img), bmp->lut);
+
+  _cupsImagePutRow(img, 0, y, img->xsize, out);
+}
+
+
 /*
  * 'read_word()' - Read a 16-bit unsigned integer.
  */
@@ -341,6 +341,7 @@ cupsImageCMYKToRGB(
 {
   int	c, m, y, k;			/* CMYK values */
   int	cr, cg, cb;			/* Calibrated RGB values */
+  int	simd;				/* Pixels converted by SIMD code */
 
 
   if (cupsImageHaveProfile)
@@ -388,6 +389,16 @@ cupsImageCMYKToRGB(
   }
   else
   {
+    if (cupsImageColorSpace != CUPS_CSPACE_CIELab &&
+        cupsImageColorSpace != CUPS_CSPACE_CIEXYZ &&
+        cupsImageColorSpace < CUPS_CSPACE_ICC1)
+    {
+      simd  = _cupsImageSIMDCMYKToRGB(in, out, count);
+      in    += 4 * simd;
+      out   += 3 * simd;
+      count -= simd;
+    }
+
     while (count > 0)
     {
       c = 255 - *in++;
@@ -437,7 +448,18 @@ cupsImageCMYKToWhite(
     int             count)		/* I - Number of pixels */
 {
   int	w;				/* White value */
+  int	simd;				/* Pixels converted by SIMD code */
+
 
+  simd  = _cupsImageSIMDCMYKToWhite(in, out, count);
+  in    += 4 * simd;
+  count -= simd;
+
+  if (cupsImageHaveProfile)
+    for (; simd > 0; simd --, out ++)
+      *out = cupsImageDensity[*out];
+  else
+    out += simd;
 
   if (cupsImageHaveProfile)
   {
@@ -596,6 +618,20 @@ cupsImageRGBToBlack(
     cups_ib_t       *out,		/* I - Output pixels */
     int             count)		/* I - Number of pixels */
 {
+  int	simd;				/* Pixels converted by SIMD code */
+
+
+  simd  = _cupsImageSIMDRGBToWhite(in, out, count);
+  in    += 3 * simd;
+  count -= simd;
+
+  if (cupsImageHaveProfile)
+    for (; simd > 0; simd --, out ++)
+      *out = cupsImageDensity[255 - *out];
+  else
+    for (; simd > 0; simd --, out ++)
+      *out = 255 - *out;
+
   if (cupsImageHaveProfile)
     while (count > 0)
     {
@@ -625,6 +661,7 @@ cupsImageRGBToCMY(
 {
   int	c, m, y, k;			/* CMYK values */
   int	cc, cm, cy;			/* Calibrated CMY values */
+  int	simd;				/* Pixels converted by SIMD code */
 
 
   if (cupsImageHaveProfile)
@@ -672,6 +709,12 @@ cupsImageRGBToCMY(
       count --;
     }
   else
+  {
+    simd  = _cupsImageSIMDRGBToCMY(in, out, count);
+    in    += 3 * simd;
+    out   += 3 * simd;
+    count -= simd;
+
     while (count > 0)
     {
       c    = 255 - in[0];
@@ -685,6 +728,7 @@ cupsImageRGBToCMY(
       in += 3;
       count --;
     }
+  }
 }
 
 
@@ -701,7 +745,62 @@ cupsImageRGBToCMYK(
   int	c, m, y, k,			/* CMYK values */
 	km;				/* Maximum K value */
   int	cc, cm, cy;			/* Calibrated CMY values */
+  int	simd;				/* Pixels converted by SIMD code */
+
+
+  simd  = _cupsImageSIMDRGBToCMYK(in, out, count);
+  in    += 3 * simd;
+  count -= simd;
+
+  if (cupsImageHaveProfile)
+  {
+   /*
+    * Calibrate the separated colors in place...
+    */
+
+    for (; simd > 0; simd --, out += 4)
+    {
+      c = out[0];
+      m = out[1];
+      y = out[2];
+      k = out[3];
+
+      cc = (cupsImageMatrix[0][0][c] +
+            cupsImageMatrix[0][1][m] +
+	    cupsImageMatrix[0][2][y]);
+      cm = (cupsImageMatrix[1][0][c] +
+            cupsImageMatrix[1][1][m] +
+	    cupsImageMatrix[1][2][y]);
+      cy = (cupsImageMatrix[2][0][c] +
+            cupsImageMatrix[2][1][m] +
+	    cupsImageMatrix[2][2][y]);
+
+      if (cc < 0)
+        out[0] = 0;
+      else if (cc > 255)
+        out[0] = cupsImageDensity[255];
+      else
+        out[0] = cupsImageDensity[cc];
+
+      if (cm < 0)
+        out[1] = 0;
+      else if (cm > 255)
+        out[1] = cupsImageDensity[255];
+      else
+        out[1] = cupsImageDensity[cm];
 
+      if (cy < 0)
+        out[2] = 0;
+      else if (cy > 255)
+        out[2] = cupsImageDensity[255];
+      else
+        out[2] = cupsImageDensity[cy];
+
+      out[3] = cupsImageDensity[k];
+    }
+  }
+  else
+    out += 4 * simd;
 
   if (cupsImageHaveProfile)
     while (count > 0)
@@ -878,6 +977,19 @@ cupsImageRGBToWhite(
     cups_ib_t       *out,		/* I - Output pixels */
     int             count)		/* I - Number of pixels */
 {
+  int	simd;				/* Pixels converted by SIMD code */
+
+
+  simd  = _cupsImageSIMDRGBToWhite(in, out, count);
+  in    += 3 * simd;
+  count -= simd;
+
+  if (cupsImageHaveProfile)
+    for (; simd > 0; simd --, out ++)
+      *out = 255 - cupsImageDensity[255 - *out];
+  else
+    out += simd;
+
   if (cupsImageHaveProfile)
   {
     while (count > 0)
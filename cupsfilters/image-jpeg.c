@@ -29,6 +29,13 @@
 #  include <jpeglib.h>	/* JPEG/JFIF image definitions */
 
 
+/*
+ * Constants...
+ */
+
+#  define CUPS_JPEG_ROWS	16	/* Scanlines decoded per call */
+
+
 /*
  * '_cupsImageReadJPEG()' - Read a JPEG image file.
  */
@@ -46,7 +53,15 @@ _cupsImageReadJPEG(
   struct jpeg_decompress_struct	cinfo;	/* Decompressor info */
   struct jpeg_error_mgr	jerr;		/* Error handler info */
   cups_ib_t		*in,		/* Input pixels */
-			*out;		/* Output pixels */
+			*out,		/* Output pixels */
+			*buffer;	/* Decoded scanlines */
+  JSAMPROW		rows[CUPS_JPEG_ROWS];
+					/* Pointers into decoded scanlines */
+  int			y,		/* Current row */
+			rowbytes,	/* Bytes per decoded scanline */
+			denom;		/* DCT scaling denominator */
+  unsigned		width,		/* Scaled width */
+			height;		/* Scaled height */
   jpeg_saved_marker_ptr	marker;		/* Pointer to marker data */
   int			psjpeg = 0;	/* Non-zero if Photoshop CMYK JPEG */
   static const char	*cspaces[] =
@@ -122,6 +137,27 @@ _cupsImageReadJPEG(
     img->colorspace = (primary == CUPS_IMAGE_RGB_CMYK) ? CUPS_IMAGE_RGB : primary;
   }
 
+  if (img->xhint > 0 && img->yhint > 0)
+  {
+   /*
+    * Let the IDCT scale the image down by 2, 4, or 8 as long as the result
+    * still covers the printed size in either orientation...
+    */
+
+    for (denom = 8; denom > 1; denom /= 2)
+    {
+      width  = (cinfo.image_width + denom - 1) / denom;
+      height = (cinfo.image_height + denom - 1) / denom;
+
+      if ((width >= img->xhint || height >= img->yhint) &&
+          (width >= img->yhint || height >= img->xhint))
+        break;
+    }
+
+    cinfo.scale_num   = 1;
+    cinfo.scale_denom = denom;
+  }
+
   jpeg_calc_output_dimensions(&cinfo);
 
   if (cinfo.output_width <= 0 || cinfo.output_width > CUPS_IMAGE_MAX_WIDTH ||
@@ -160,20 +196,49 @@ _cupsImageReadJPEG(
     }
   }
 
+  if (cinfo.output_width != cinfo.image_width ||
+      cinfo.output_height != cinfo.image_height)
+  {
+   /*
+    * Scale the resolution with the image so the printed size stays the
+    * same...
+    */
+
+    fprintf(stderr, "DEBUG: Decoding %dx%d JPEG image at 1/%d size\n",
+            cinfo.image_width, cinfo.image_height, cinfo.scale_denom);
+
+    img->xppi = max(img->xppi * cinfo.output_width / cinfo.image_width, 1);
+    img->yppi = max(img->yppi * cinfo.output_height / cinfo.image_height, 1);
+  }
+
   fprintf(stderr, "DEBUG: JPEG image %dx%dx%d, %dx%d PPI\n",
           img->xsize, img->ysize, cinfo.output_components,
 	  img->xppi, img->yppi);
 
   cupsImageSetMaxTiles(img, 0);
 
-  in  = malloc(img->xsize * cinfo.output_components);
-  out = malloc(img->xsize * cupsImageGetDepth(img));
+  rowbytes = img->xsize * cinfo.output_components;
+  buffer   = malloc(rowbytes * CUPS_JPEG_ROWS);
+  out      = malloc(img->xsize * cupsImageGetDepth(img));
+
+  for (y = 0; y < CUPS_JPEG_ROWS; y ++)
+    rows[y] = buffer + y * rowbytes;
 
   jpeg_start_decompress(&cinfo);
 
-  while (cinfo.output_scanline < cinfo.output_height)
+  for (y = 0, in = buffer; y < img->ysize; y ++, in += rowbytes)
   {
-    jpeg_read_scanlines(&cinfo, (JSAMPROW *)&in, (JDIMENSION)1);
+    if (y == cinfo.output_scanline)
+    {
+     /*
+      * Decode as many scanlines as the library will give us at once...
+      */
+
+      if (jpeg_read_scanlines(&cinfo, rows, CUPS_JPEG_ROWS) == 0)
+        break;
+
+      in = buffer;
+    }
 
     if (psjpeg && cinfo.output_components == 4)
     {
@@ -217,7 +282,7 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(in, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, in);
+      _cupsImagePutRow(img, 0, y, img->xsize, in);
     }
     else if (cinfo.out_color_space == JCS_GRAYSCALE)
     {
@@ -243,7 +308,7 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      _cupsImagePutRow(img, 0, y, img->xsize, out);
     }
     else if (cinfo.out_color_space == JCS_RGB)
     {
@@ -272,7 +337,7 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      _cupsImagePutRow(img, 0, y, img->xsize, out);
     }
     else /* JCS_CMYK */
     {
@@ -300,11 +365,11 @@ _cupsImageReadJPEG(
       if (lut)
         cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      _cupsImagePutRow(img, 0, y, img->xsize, out);
     }
   }
 
-  free(in);
+  free(buffer);
   free(out);
 
   jpeg_finish_decompress(&cinfo);
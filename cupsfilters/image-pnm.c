@@ -17,6 +17,9 @@
  * Contents:
  *
  *   _cupsImageReadPNM() - Read a PNM image file.
+ *   pnm_decode()        - Decode rows of a binary PNM image on demand.
+ *   pnm_done()          - Close a PNM image file and free its buffers.
+ *   pnm_read_rows()     - Read rows of a PNM image file.
  */
 
 /*
@@ -26,6 +29,36 @@
 #include "image-private.h"
 
 
+/*
+ * Local types...
+ */
+
+typedef struct cups_pnm_s		/**** PNM decoder state ****/
+{
+  FILE		*fp;			/* Image file */
+  long		offset;			/* Offset of first row in file */
+  int		format,			/* Format of PNM file */
+		maxval,			/* Maximum pixel value */
+		rowbytes,		/* Bytes per row in file */
+		saturation,		/* Color saturation (%) */
+		hue;			/* Color hue (degrees) */
+  const cups_ib_t *lut;			/* Lookup table or NULL */
+  cups_ib_t	lutdata[256],		/* Copy of lookup table */
+		*in,			/* Input pixels */
+		*out;			/* Output pixels */
+} cups_pnm_t;
+
+
+/*
+ * Local functions...
+ */
+
+static int	pnm_decode(cups_image_t *img, int y, int height);
+static void	pnm_done(cups_image_t *img);
+static int	pnm_read_rows(cups_image_t *img, cups_pnm_t *pnm, int y,
+		              int height);
+
+
 /*
  * '_cupsImageReadPNM()' - Read a PNM image file.
  */
@@ -40,17 +73,10 @@ _cupsImageReadPNM(
     int             hue,		/* I - Color hue (degrees) */
     const cups_ib_t *lut)		/* I - Lookup table for gamma/brightness */
 {
-  int		x, y;			/* Looping vars */
-  int		bpp;			/* Bytes per pixel */
-  cups_ib_t	*in,			/* Input pixels */
-		*inptr,			/* Current input pixel */
-		*out,			/* Output pixels */
-		*outptr,		/* Current output pixel */
-		bit;			/* Bit in input line */
+  cups_pnm_t	*pnm;			/* Decoder state */
   char		line[255],		/* Input line */
 		*lineptr;		/* Pointer in line */
   int		format,			/* Format of PNM file */
-		val,			/* Pixel value */
 		maxval;			/* Maximum pixel value */
 
 
@@ -152,30 +178,142 @@ _cupsImageReadPNM(
 
   cupsImageSetMaxTiles(img, 0);
 
-  bpp = cupsImageGetDepth(img);
-
-  if ((in = malloc(img->xsize * 3)) == NULL)
+  if ((pnm = calloc(1, sizeof(cups_pnm_t))) == NULL)
   {
     fputs("DEBUG: Unable to allocate memory!\n", stderr);
     fclose(fp);
     return (1);
   }
 
-  if ((out = malloc(img->xsize * bpp)) == NULL)
+  pnm->fp         = fp;
+  pnm->format     = format;
+  pnm->maxval     = maxval;
+  pnm->saturation = saturation;
+  pnm->hue        = hue;
+
+  if (lut)
+  {
+    memcpy(pnm->lutdata, lut, sizeof(pnm->lutdata));
+    pnm->lut = pnm->lutdata;
+  }
+
+  img->decode_data = pnm;
+  img->decode_done = pnm_done;
+
+  if ((pnm->in = malloc(img->xsize * 3)) == NULL ||
+      (pnm->out = malloc(img->xsize * cupsImageGetDepth(img))) == NULL)
   {
     fputs("DEBUG: Unable to allocate memory!\n", stderr);
-    fclose(fp);
-    free(in);
     return (1);
   }
 
+  if (format >= 4 && maxval < 256)
+  {
+   /*
+    * Binary rows have a fixed size, so only decode them when they are
+    * needed...
+    */
+
+    if (format == 4)
+      pnm->rowbytes = (img->xsize + 7) / 8;
+    else if (format == 5)
+      pnm->rowbytes = img->xsize;
+    else
+      pnm->rowbytes = img->xsize * 3;
+
+    pnm->offset = ftell(fp);
+    img->decode = pnm_decode;
+
+    return (0);
+  }
+
  /*
   * Read the image file...
   */
 
-  for (y = 0; y < img->ysize; y ++)
+  pnm_read_rows(img, pnm, 0, img->ysize);
+  pnm_done(img);
+
+  return (0);
+}
+
+
+/*
+ * 'pnm_decode()' - Decode rows of a binary PNM image on demand.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+pnm_decode(cups_image_t *img,		/* I - Image */
+           int          y,		/* I - First row */
+	   int          height)		/* I - Number of rows */
+{
+  cups_pnm_t	*pnm = (cups_pnm_t *)img->decode_data;
+					/* Decoder state */
+
+
+  if (fseek(pnm->fp, pnm->offset + (long)y * pnm->rowbytes, SEEK_SET))
+    return (-1);
+
+  return (pnm_read_rows(img, pnm, y, height));
+}
+
+
+/*
+ * 'pnm_done()' - Close a PNM image file and free its buffers.
+ */
+
+static void
+pnm_done(cups_image_t *img)		/* I - Image */
+{
+  cups_pnm_t	*pnm = (cups_pnm_t *)img->decode_data;
+					/* Decoder state */
+
+
+  fclose(pnm->fp);
+  free(pnm->in);
+  free(pnm->out);
+  free(pnm);
+
+  img->decode_data = NULL;
+  img->decode_done = NULL;
+}
+
+
+/*
+ * 'pnm_read_rows()' - Read rows of a PNM image file.
+ *
+ * Every row is stored even when the file is short, so the rows that could
+ * be read are kept.
+ */
+
+static int				/* O - 0 on success, -1 if file is short */
+pnm_read_rows(cups_image_t *img,	/* I - Image */
+              cups_pnm_t   *pnm,	/* I - Decoder state */
+	      int          y,		/* I - First row */
+	      int          height)	/* I - Number of rows */
+{
+  FILE		*fp = pnm->fp;		/* Image file */
+  int		x;			/* Looping var */
+  int		bpp;			/* Bytes per pixel */
+  cups_ib_t	*in = pnm->in,		/* Input pixels */
+		*inptr,			/* Current input pixel */
+		*out = pnm->out,	/* Output pixels */
+		*outptr,		/* Current output pixel */
+		bit;			/* Bit in input line */
+  int		val,			/* Pixel value */
+		maxval = pnm->maxval;	/* Maximum pixel value */
+  int		saturation = pnm->saturation,
+					/* Color saturation (%) */
+		hue = pnm->hue;		/* Color hue (degrees) */
+  const cups_ib_t *lut = pnm->lut;	/* Lookup table for gamma/brightness */
+  int		status = 0;		/* Read status */
+
+
+  bpp = cupsImageGetDepth(img);
+
+  for (; height > 0; height --, y ++)
   {
-    switch (format)
+    switch (pnm->format)
     {
       case 1 :
           for (x = img->xsize, inptr = in; x > 0; x --, inptr ++)
@@ -202,7 +340,9 @@ _cupsImageReadPNM(
           break;
 
       case 4 :
-          fread(out, (img->xsize + 7) / 8, 1, fp);
+          if (fread(out, (img->xsize + 7) / 8, 1, fp) != 1)
+	    status = -1;
+
           for (x = img->xsize, inptr = in, outptr = out, bit = 128;
                x > 0;
                x --, inptr ++)
@@ -223,15 +363,17 @@ _cupsImageReadPNM(
           break;
 
       case 5 :
-          fread(in, img->xsize, 1, fp);
+          if (fread(in, img->xsize, 1, fp) != 1)
+	    status = -1;
           break;
 
       case 6 :
-          fread(in, img->xsize, 3, fp);
+          if (fread(in, img->xsize, 3, fp) != 3)
+	    status = -1;
           break;
     }
 
-    switch (format)
+    switch (pnm->format)
     {
       case 1 :
       case 2 :
@@ -306,12 +448,7 @@ _cupsImageReadPNM(
     }
   }
 
-  free(in);
-  free(out);
-
-  fclose(fp);
-
-  return (0);
+  return (status);
 }
 
 
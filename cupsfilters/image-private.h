@@ -37,6 +37,12 @@
 #  endif /* WIN32 */
 #  include <errno.h>
 #  include <math.h>
+#  ifdef HAVE_PTHREAD_H
+#    include <pthread.h>
+#  endif /* HAVE_PTHREAD_H */
+#  ifdef HAVE_SYS_MMAN_H
+#    include <sys/mman.h>
+#  endif /* HAVE_SYS_MMAN_H */
 
 
 /*
@@ -50,6 +56,20 @@
 
 #  define CUPS_TILE_SIZE	256	/* 256x256 pixel tiles */
 #  define CUPS_TILE_MINIMUM	10	/* Minimum number of tiles */
+#  define CUPS_TILE_MAXPIXELS	16777216/* Maximum pixels in a tile */
+#  define CUPS_TILE_SHARDS	8	/* Number of tile cache shards */
+
+#  define CUPS_IMAGE_SIMD_NONE	0	/* Scalar colorspace conversions */
+#  define CUPS_IMAGE_SIMD_SSSE3	1	/* SSSE3 colorspace conversions */
+#  define CUPS_IMAGE_SIMD_AVX2	2	/* AVX2 colorspace conversions */
+
+#  define CUPS_IZOOM_BATCH	32	/* Output rows filtered at a time */
+#  define CUPS_IZOOM_PREC	14	/* Fraction bits of filter weights */
+#  define CUPS_IZOOM_STRIP	32	/* Image columns rotated at a time */
+#  define CUPS_IZOOM_THREADS	8	/* Maximum number of zoom threads */
+
+#  define CUPS_TIFF_BAND	4194304	/* Bytes of TIFF strips decoded at a time */
+#  define CUPS_TIFF_THREADS	8	/* Maximum number of TIFF decoding threads */
 
 
 /*
@@ -75,15 +95,27 @@ typedef enum cups_iztype_e		/**** Image zoom type ****/
 {
   CUPS_IZOOM_FAST,			/* Use nearest-neighbor sampling */
   CUPS_IZOOM_NORMAL,			/* Use bilinear interpolation */
-  CUPS_IZOOM_BEST			/* Use bicubic interpolation */
+  CUPS_IZOOM_BEST,			/* Use bicubic interpolation */
+  CUPS_IZOOM_LANCZOS			/* Use Lanczos-3 interpolation */
 } cups_iztype_t;
 
+typedef struct cups_ifilter_s		/**** Resampling filter ****/
+{
+  int			taps;		/* Weights per output pixel, padded */
+  int			*start,		/* First input pixel for each output */
+			*num;		/* Number of weights for each output */
+  short			*weights;	/* Fixed-point weights */
+} cups_ifilter_t;
+
+struct cups_izpool_s;
+
 struct cups_ic_s;
 
 typedef struct cups_itile_s		/**** Image tile ****/
 {
   int			dirty;		/* True if tile is dirty */
   off_t			pos;		/* Position of tile on disk (-1 if not written) */
+  int			mapped;		/* True if used in place in the swap file */
   struct cups_ic_s	*ic;		/* Pixel data */
 } cups_itile_t;
 
@@ -95,6 +127,25 @@ typedef struct cups_ic_s		/**** Image tile cache ****/
   cups_ib_t		*pixels;	/* Pixel data */
 } cups_ic_t;
 
+typedef struct cups_ishard_s		/**** Image tile cache shard ****/
+{
+#  ifdef HAVE_PTHREAD_H
+  pthread_mutex_t	mutex;		/* Lock for the tiles of this shard */
+#  endif /* HAVE_PTHREAD_H */
+  unsigned		num_ics;	/* Number of cached tiles */
+  int			mapped;		/* True once the swap file is mapped */
+  cups_ic_t		*first,		/* First cached tile in shard */
+			*last;		/* Last cached tile in shard */
+  unsigned long		hits,		/* Tile lookups served from memory */
+			misses,		/* Tile lookups that were not */
+			evictions;	/* Tiles written to the swap file */
+} cups_ishard_t;
+
+typedef int (*cups_idecode_cb_t)(cups_image_t *img, int y, int height);
+					/**** Decode rows of an image ****/
+typedef void (*cups_idone_cb_t)(cups_image_t *img);
+					/**** Free the decoder of an image ****/
+
 struct cups_image_s			/**** Image file data ****/
 {
   cups_icspace_t	colorspace;	/* Colorspace of image */
@@ -102,13 +153,29 @@ struct cups_image_s			/**** Image file data ****/
 			ysize,		/* Height of image in pixels */
 			xppi,		/* X resolution in pixels-per-inch */
 			yppi,		/* Y resolution in pixels-per-inch */
-			num_ics,	/* Number of cached tiles */
-			max_ics;	/* Maximum number of cached tiles */
+			max_ics,	/* Maximum number of cached tiles */
+			xhint,		/* Smallest useful width, 0 = full */
+			yhint;		/* Smallest useful height, 0 = full */
+  int			tilew,		/* Width of tiles in pixels */
+			tileh,		/* Height of tiles in pixels */
+			xtiles,		/* Number of tiles horizontally */
+			ytiles,		/* Number of tiles vertically */
+			readrow;	/* Furthest tile row read by GetRow */
   cups_itile_t		**tiles;	/* Tiles in image */
-  cups_ic_t		*first,		/* First cached tile in image */
-			*last;		/* Last cached tile in image */
+  cups_ishard_t		shards[CUPS_TILE_SHARDS];
+					/* Tile cache, sharded by tile */
   int			cachefile;	/* Tile cache file */
   char			cachename[256];	/* Tile cache filename */
+  cups_ib_t		*cachemap;	/* Mapping of tile cache file */
+  size_t		cachesize;	/* Size of tile cache file */
+  cups_idecode_cb_t	decode;		/* Decode rows on demand, or NULL */
+  cups_idone_cb_t	decode_done;	/* Free the decoder state */
+  void			*decode_data;	/* Decoder state */
+  unsigned char		*decoded;	/* Tile rows decoded so far */
+#  ifdef HAVE_PTHREAD_H
+  pthread_mutex_t	mutex,		/* Lock for tile array and cache file */
+			decode_mutex;	/* Lock for the decoder */
+#  endif /* HAVE_PTHREAD_H */
 };
 
 struct cups_izoom_s			/**** Image zoom data ****/
@@ -136,6 +203,21 @@ struct cups_izoom_s			/**** Image zoom data ****/
 			row;		/* Current row */
   cups_ib_t		*rows[2],	/* Horizontally scaled pixel data */
 			*in;		/* Unscaled input pixel data */
+  cups_ifilter_t	xfilter,	/* Horizontal filter for BEST/LANCZOS */
+			yfilter;	/* Vertical filter for BEST/LANCZOS */
+  int			simd,		/* Use SIMD filter kernels? */
+			num_threads,	/* Number of threads, before first fill */
+			hfirst,		/* First input row in hrows */
+			hcount,		/* Number of input rows in hrows */
+			hmax,		/* Capacity of hrows */
+			ofirst,		/* First output row in out */
+			ocount,		/* Number of output rows in out */
+			colx,		/* First image column in cols */
+			colcount;	/* Number of image columns in cols */
+  cups_ib_t		*hrows,		/* Horizontally filtered input rows */
+			*out,		/* Filtered output rows */
+			*cols;		/* Image columns for rotated input */
+  struct cups_izpool_s	*pool;		/* Filtering threads */
 };
 
 
@@ -143,6 +225,15 @@ struct cups_izoom_s			/**** Image zoom data ****/
  * Prototypes...
  */
 
+extern int		_cupsImageGetCols(cups_image_t *img, int x, int y,
+			                  int width, int height,
+					  cups_ib_t *pixels);
+extern cups_image_t	*_cupsImageOpenScaled(const char *filename,
+			                      cups_icspace_t primary,
+				              cups_icspace_t secondary,
+			                      int saturation, int hue,
+				              const cups_ib_t *lut,
+					      int xhint, int yhint);
 extern int		_cupsImagePutCol(cups_image_t *img, int x, int y,
 			                 int height, const cups_ib_t *pixels);
 extern int		_cupsImagePutRow(cups_image_t *img, int x, int y,
@@ -202,6 +293,18 @@ extern int		_cupsImageReadTIFF(cups_image_t *img, FILE *fp,
 					   cups_icspace_t secondary,
 			                   int saturation, int hue,
 					   const cups_ib_t *lut);
+extern int		_cupsImageGetSIMD(void);
+extern int		_cupsImageSetSIMD(int level);
+extern int		_cupsImageSIMDCMYKToRGB(const cups_ib_t *in,
+			                        cups_ib_t *out, int count);
+extern int		_cupsImageSIMDCMYKToWhite(const cups_ib_t *in,
+			                          cups_ib_t *out, int count);
+extern int		_cupsImageSIMDRGBToCMY(const cups_ib_t *in,
+			                       cups_ib_t *out, int count);
+extern int		_cupsImageSIMDRGBToCMYK(const cups_ib_t *in,
+			                        cups_ib_t *out, int count);
+extern int		_cupsImageSIMDRGBToWhite(const cups_ib_t *in,
+			                         cups_ib_t *out, int count);
 extern void		_cupsImageZoomDelete(cups_izoom_t *z);
 extern void		_cupsImageZoomFill(cups_izoom_t *z, int iy);
 extern cups_izoom_t	*_cupsImageZoomNew(cups_image_t *img, int xc0, int yc0,
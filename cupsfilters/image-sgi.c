@@ -17,6 +17,8 @@
  * Contents:
  *
  *   _cupsImageReadSGI() - Read a SGI image file.
+ *   sgi_decode()        - Decode rows of a SGI image on demand.
+ *   sgi_done()          - Close a SGI image file and free its buffers.
  */
 
 /*
@@ -27,6 +29,31 @@
 #include "image-sgi.h"
 
 
+/*
+ * Local types...
+ */
+
+typedef struct cups_sgi_s		/**** SGI decoder state ****/
+{
+  sgi_t		*sgip;			/* SGI image file */
+  int		saturation,		/* Color saturation (%) */
+		hue;			/* Color hue (degrees) */
+  const cups_ib_t *lut;			/* Lookup table or NULL */
+  cups_ib_t	lutdata[256],		/* Copy of lookup table */
+		*in,			/* Input pixels */
+		*out;			/* Output pixels */
+  unsigned short *rows[4];		/* Row pointers for image data */
+} cups_sgi_t;
+
+
+/*
+ * Local functions...
+ */
+
+static int	sgi_decode(cups_image_t *img, int y, int height);
+static void	sgi_done(cups_image_t *img);
+
+
 /*
  * '_cupsImageReadSGI()' - Read a SGI image file.
  */
@@ -41,18 +68,9 @@ _cupsImageReadSGI(
     int             hue,		/* I - Color hue (degrees) */
     const cups_ib_t *lut)		/* I - Lookup table for gamma/brightness */
 {
-  int		i, y;			/* Looping vars */
-  int		bpp;			/* Bytes per pixel */
+  cups_sgi_t	*sgi;			/* Decoder state */
   sgi_t		*sgip;			/* SGI image file */
-  cups_ib_t	*in,			/* Input pixels */
-		*inptr,			/* Current input pixel */
-		*out;			/* Output pixels */
-  unsigned short *rows[4],		/* Row pointers for image data */
-		*red,
-		*green,
-		*blue,
-		*gray,
-		*alpha;
+  int		i;			/* Looping var */
 
 
  /*
@@ -90,41 +108,81 @@ _cupsImageReadSGI(
 
   cupsImageSetMaxTiles(img, 0);
 
-  bpp = cupsImageGetDepth(img);
-
-  if ((in = malloc(img->xsize * sgip->zsize)) == NULL)
+  if ((sgi = calloc(1, sizeof(cups_sgi_t))) == NULL)
   {
     fputs("DEBUG: Unable to allocate memory!\n", stderr);
     sgiClose(sgip);
     return (1);
   }
 
-  if ((out = malloc(img->xsize * bpp)) == NULL)
+  sgi->sgip       = sgip;
+  sgi->saturation = saturation;
+  sgi->hue        = hue;
+
+  if (lut)
   {
-    fputs("DEBUG: Unable to allocate memory!\n", stderr);
-    sgiClose(sgip);
-    free(in);
-    return (1);
+    memcpy(sgi->lutdata, lut, sizeof(sgi->lutdata));
+    sgi->lut = sgi->lutdata;
   }
 
-  if ((rows[0] = calloc(img->xsize * sgip->zsize,
-                        sizeof(unsigned short))) == NULL)
+  img->decode_data = sgi;
+  img->decode_done = sgi_done;
+
+  if ((sgi->in = malloc(img->xsize * sgip->zsize)) == NULL ||
+      (sgi->out = malloc(img->xsize * cupsImageGetDepth(img))) == NULL ||
+      (sgi->rows[0] = calloc(img->xsize * sgip->zsize,
+                             sizeof(unsigned short))) == NULL)
   {
     fputs("DEBUG: Unable to allocate memory!\n", stderr);
-    sgiClose(sgip);
-    free(in);
-    free(out);
     return (1);
   }
 
   for (i = 1; i < sgip->zsize; i ++)
-    rows[i] = rows[0] + i * img->xsize;
+    sgi->rows[i] = sgi->rows[0] + i * img->xsize;
 
  /*
-  * Read the SGI image file...
+  * SGI files can be read in any order, so only decode the rows that are
+  * needed...
   */
 
-  for (y = 0; y < img->ysize; y ++)
+  img->decode = sgi_decode;
+
+  return (0);
+}
+
+
+/*
+ * 'sgi_decode()' - Decode rows of a SGI image on demand.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+sgi_decode(cups_image_t *img,		/* I - Image */
+           int          y,		/* I - First row */
+	   int          height)		/* I - Number of rows */
+{
+  cups_sgi_t	*sgi = (cups_sgi_t *)img->decode_data;
+					/* Decoder state */
+  sgi_t		*sgip = sgi->sgip;	/* SGI image file */
+  int		i;			/* Looping var */
+  int		bpp;			/* Bytes per pixel */
+  cups_ib_t	*in = sgi->in,		/* Input pixels */
+		*inptr,			/* Current input pixel */
+		*out = sgi->out;	/* Output pixels */
+  unsigned short **rows = sgi->rows,	/* Row pointers for image data */
+		*red,
+		*green,
+		*blue,
+		*gray,
+		*alpha;
+  int		saturation = sgi->saturation,
+					/* Color saturation (%) */
+		hue = sgi->hue;		/* Color hue (degrees) */
+  const cups_ib_t *lut = sgi->lut;	/* Lookup table for gamma/brightness */
+
+
+  bpp = cupsImageGetDepth(img);
+
+  for (; height > 0; height --, y ++)
   {
     for (i = 0; i < sgip->zsize; i ++)
       sgiGetRow(sgip, rows[i], img->ysize - 1 - y, i);
@@ -280,13 +338,29 @@ _cupsImageReadSGI(
     }
   }
 
-  free(in);
-  free(out);
-  free(rows[0]);
+  return (0);
+}
 
-  sgiClose(sgip);
 
-  return (0);
+/*
+ * 'sgi_done()' - Close a SGI image file and free its buffers.
+ */
+
+static void
+sgi_done(cups_image_t *img)		/* I - Image */
+{
+  cups_sgi_t	*sgi = (cups_sgi_t *)img->decode_data;
+					/* Decoder state */
+
+
+  sgiClose(sgi->sgip);
+  free(sgi->in);
+  free(sgi->out);
+  free(sgi->rows[0]);
+  free(sgi);
+
+  img->decode_data = NULL;
+  img->decode_done = NULL;
 }
 
 
@@ -0,0 +1,815 @@
+/*
+ * "$Id$"
+ *
+ *   SIMD colorspace conversion kernels for CUPS.
+ *
+ *   Copyright 2026 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   _cupsImageGetSIMD()           - Get the selected SIMD level.
+ *   _cupsImageSetSIMD()           - Select the SIMD kernels to use.
+ *   _cupsImageSIMDCMYKToRGB()     - Convert CMYK colors to RGB.
+ *   _cupsImageSIMDCMYKToWhite()   - Convert CMYK colors to luminance.
+ *   _cupsImageSIMDRGBToCMY()      - Convert RGB colors to CMY.
+ *   _cupsImageSIMDRGBToCMYK()     - Convert RGB colors to CMYK.
+ *   _cupsImageSIMDRGBToWhite()    - Convert RGB colors to luminance.
+ *   get_level()                   - Get the selected SIMD level.
+ *   avx2_*(), ssse3_*()           - Kernels for 16 pixels at a time.
+ *
+ * The kernels convert whole blocks of 16 pixels and return the number of
+ * pixels they converted; the callers in image-colorspace.c finish the rest
+ * (and apply any color profile) with their scalar loops.  Every kernel uses
+ * exact integer arithmetic, so the results are identical to the scalar
+ * code:
+ *
+ *   x / 100 == (x * 5243) >> 19	for 0 <= x <= 25500
+ *   x / 255 == (x * 32897) >> 23	for 0 <= x <= 65535
+ *
+ * and k * k * k / (km * km) is computed with single precision floats, which
+ * hold every operand exactly; the correctly rounded quotient truncates to
+ * the integer quotient for all 0 <= k <= km <= 255.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  define HAVE_X86_SIMD 1
+#  include <immintrin.h>
+#endif /* __GNUC__ && x86 */
+
+
+/*
+ * Local globals...
+ */
+
+static int	simd_level = -1;	/* Selected SIMD level */
+
+
+/*
+ * Local functions...
+ */
+
+static int	get_level(void);
+
+#ifdef HAVE_X86_SIMD
+/*
+ * Shuffle masks; "Z" clears a byte...
+ */
+
+#  define Z	-128
+
+#  define RGB_TO_RGB0	0, 1, 2, Z, 3, 4, 5, Z, 6, 7, 8, Z, 9, 10, 11, Z
+#  define RGB0_TO_RGB	0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, Z, Z, Z, Z
+#  define KKK0		3, 3, 3, Z, 7, 7, 7, Z, 11, 11, 11, Z, 15, 15, 15, Z
+#  define K16		3, Z, 7, Z, 11, Z, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z
+#  define LUMA		31, 61, 8, 0, 31, 61, 8, 0, 31, 61, 8, 0, 31, 61, 8, 0
+
+
+/*
+ * 'ssse3_load_rgb()' - Load 16 RGB pixels as four registers of RGB0 pixels.
+ */
+
+__attribute__((target("ssse3")))
+static inline void
+ssse3_load_rgb(const cups_ib_t *in,	/* I - 48 bytes of RGB pixels */
+               __m128i         g[4])	/* O - RGB0 pixels */
+{
+  __m128i	a, b, c,		/* Input bytes */
+		e;			/* RGB to RGB0 mask */
+
+
+  a = _mm_loadu_si128((const __m128i *)in);
+  b = _mm_loadu_si128((const __m128i *)(in + 16));
+  c = _mm_loadu_si128((const __m128i *)(in + 32));
+  e = _mm_setr_epi8(RGB_TO_RGB0);
+
+  g[0] = _mm_shuffle_epi8(a, e);
+  g[1] = _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), e);
+  g[2] = _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), e);
+  g[3] = _mm_shuffle_epi8(_mm_srli_si128(c, 4), e);
+}
+
+
+/*
+ * 'ssse3_store_rgb()' - Store four registers of RGB0 pixels as 48 bytes.
+ */
+
+__attribute__((target("ssse3")))
+static inline void
+ssse3_store_rgb(cups_ib_t *out,		/* O - 48 bytes of RGB pixels */
+                __m128i   g[4])		/* I - RGB0 pixels */
+{
+  __m128i	p0, p1, p2, p3,		/* Packed pixels */
+		e;			/* RGB0 to RGB mask */
+
+
+  e  = _mm_setr_epi8(RGB0_TO_RGB);
+  p0 = _mm_shuffle_epi8(g[0], e);
+  p1 = _mm_shuffle_epi8(g[1], e);
+  p2 = _mm_shuffle_epi8(g[2], e);
+  p3 = _mm_shuffle_epi8(g[3], e);
+
+  _mm_storeu_si128((__m128i *)out,
+                   _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+  _mm_storeu_si128((__m128i *)(out + 16),
+                   _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+  _mm_storeu_si128((__m128i *)(out + 32),
+                   _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+
+/*
+ * 'ssse3_cmyk_to_rgb()' - Convert 16 CMYK pixels to RGB.
+ */
+
+__attribute__((target("ssse3")))
+static void
+ssse3_cmyk_to_rgb(const cups_ib_t *in,	/* I - Input pixels */
+                  cups_ib_t       *out)	/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m128i	v, g[4],		/* Pixels */
+		ones,			/* All bits set */
+		kkk;			/* K to CMY mask */
+
+
+  ones = _mm_set1_epi8(-1);
+  kkk  = _mm_setr_epi8(KKK0);
+
+  for (i = 0; i < 4; i ++)
+  {
+    v    = _mm_loadu_si128((const __m128i *)(in + 16 * i));
+    g[i] = _mm_subs_epu8(_mm_xor_si128(v, ones), _mm_shuffle_epi8(v, kkk));
+  }
+
+  ssse3_store_rgb(out, g);
+}
+
+
+/*
+ * 'ssse3_cmyk_to_white()' - Convert 16 CMYK pixels to luminance.
+ */
+
+__attribute__((target("ssse3")))
+static void
+ssse3_cmyk_to_white(const cups_ib_t *in,/* I - Input pixels */
+                    cups_ib_t       *out)
+					/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m128i	v[4],			/* Pixels */
+		w[2],			/* White values */
+		luma,			/* Luminance weights */
+		k16;			/* K mask */
+
+
+  luma = _mm_setr_epi8(LUMA);
+  k16  = _mm_setr_epi8(K16);
+
+  for (i = 0; i < 4; i ++)
+    v[i] = _mm_loadu_si128((const __m128i *)(in + 16 * i));
+
+  for (i = 0; i < 2; i ++)
+  {
+    w[i] = _mm_hadd_epi16(_mm_maddubs_epi16(v[2 * i], luma),
+                          _mm_maddubs_epi16(v[2 * i + 1], luma));
+    w[i] = _mm_srli_epi16(_mm_mulhi_epu16(w[i], _mm_set1_epi16(5243)), 3);
+    w[i] = _mm_sub_epi16(_mm_sub_epi16(_mm_set1_epi16(255), w[i]),
+                         _mm_unpacklo_epi64(_mm_shuffle_epi8(v[2 * i], k16),
+					    _mm_shuffle_epi8(v[2 * i + 1],
+					                     k16)));
+  }
+
+  _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(w[0], w[1]));
+}
+
+
+/*
+ * 'ssse3_rgb_to_cmy()' - Convert 16 RGB pixels to CMY.
+ */
+
+__attribute__((target("ssse3")))
+static void
+ssse3_rgb_to_cmy(const cups_ib_t *in,	/* I - Input pixels */
+                 cups_ib_t       *out)	/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m128i	g[4],			/* Pixels */
+		r, gr, b,		/* RGB values */
+		c, m, y, k,		/* CMYK values */
+		mask,			/* Low byte mask */
+		full,			/* 255 */
+		div255;			/* Reciprocal of 255 */
+
+
+  mask   = _mm_set1_epi32(255);
+  full   = _mm_set1_epi32(255);
+  div255 = _mm_set1_epi16((short)32897);
+
+  ssse3_load_rgb(in, g);
+
+  for (i = 0; i < 4; i ++)
+  {
+    r  = _mm_and_si128(g[i], mask);
+    gr = _mm_and_si128(_mm_srli_epi32(g[i], 8), mask);
+    b  = _mm_srli_epi32(g[i], 16);
+    c  = _mm_sub_epi32(full, r);
+    m  = _mm_sub_epi32(full, gr);
+    y  = _mm_sub_epi32(full, b);
+    k  = _mm_min_epi16(c, _mm_min_epi16(m, y));
+
+    c = _mm_mullo_epi16(_mm_sub_epi32(full, _mm_srli_epi32(gr, 2)),
+                        _mm_sub_epi32(c, k));
+    m = _mm_mullo_epi16(_mm_sub_epi32(full, _mm_srli_epi32(b, 2)),
+                        _mm_sub_epi32(m, k));
+    y = _mm_mullo_epi16(_mm_sub_epi32(full, _mm_srli_epi32(r, 2)),
+                        _mm_sub_epi32(y, k));
+
+    c = _mm_add_epi32(_mm_srli_epi16(_mm_mulhi_epu16(c, div255), 7), k);
+    m = _mm_add_epi32(_mm_srli_epi16(_mm_mulhi_epu16(m, div255), 7), k);
+    y = _mm_add_epi32(_mm_srli_epi16(_mm_mulhi_epu16(y, div255), 7), k);
+
+    g[i] = _mm_or_si128(c, _mm_or_si128(_mm_slli_epi32(m, 8),
+                                        _mm_slli_epi32(y, 16)));
+  }
+
+  ssse3_store_rgb(out, g);
+}
+
+
+/*
+ * 'ssse3_rgb_to_cmyk()' - Convert 16 RGB pixels to CMYK.
+ */
+
+__attribute__((target("ssse3")))
+static void
+ssse3_rgb_to_cmyk(const cups_ib_t *in,	/* I - Input pixels */
+                  cups_ib_t       *out)	/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m128i	g[4],			/* Pixels */
+		c, m, y, k, km,		/* CMYK values */
+		mask;			/* Low byte mask */
+  __m128	kf, kmf;		/* K and maximum K */
+
+
+  mask = _mm_set1_epi32(255);
+
+  ssse3_load_rgb(in, g);
+
+  for (i = 0; i < 4; i ++)
+  {
+    g[i] = _mm_xor_si128(g[i], _mm_set1_epi32(0xffffff));
+    c    = _mm_and_si128(g[i], mask);
+    m    = _mm_and_si128(_mm_srli_epi32(g[i], 8), mask);
+    y    = _mm_srli_epi32(g[i], 16);
+    k    = _mm_min_epi16(c, _mm_min_epi16(m, y));
+    km   = _mm_max_epi16(c, _mm_max_epi16(m, y));
+
+    kf  = _mm_cvtepi32_ps(k);
+    kmf = _mm_cvtepi32_ps(km);
+    k   = _mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(_mm_mul_ps(kf, kf), kf),
+                                      _mm_max_ps(_mm_mul_ps(kmf, kmf),
+				                 _mm_set1_ps(1.0f))));
+
+    c = _mm_sub_epi32(c, k);
+    m = _mm_sub_epi32(m, k);
+    y = _mm_sub_epi32(y, k);
+
+    _mm_storeu_si128((__m128i *)(out + 16 * i),
+                     _mm_or_si128(_mm_or_si128(c, _mm_slli_epi32(m, 8)),
+		                  _mm_or_si128(_mm_slli_epi32(y, 16),
+				               _mm_slli_epi32(k, 24))));
+  }
+}
+
+
+/*
+ * 'ssse3_rgb_to_white()' - Convert 16 RGB pixels to luminance.
+ */
+
+__attribute__((target("ssse3")))
+static void
+ssse3_rgb_to_white(const cups_ib_t *in,	/* I - Input pixels */
+                   cups_ib_t       *out)/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m128i	g[4],			/* Pixels */
+		w[2],			/* White values */
+		luma;			/* Luminance weights */
+
+
+  luma = _mm_setr_epi8(LUMA);
+
+  ssse3_load_rgb(in, g);
+
+  for (i = 0; i < 2; i ++)
+  {
+    w[i] = _mm_hadd_epi16(_mm_maddubs_epi16(g[2 * i], luma),
+                          _mm_maddubs_epi16(g[2 * i + 1], luma));
+    w[i] = _mm_srli_epi16(_mm_mulhi_epu16(w[i], _mm_set1_epi16(5243)), 3);
+  }
+
+  _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(w[0], w[1]));
+}
+
+
+/*
+ * 'avx2_load_rgb()' - Load 16 RGB pixels as two registers of RGB0 pixels.
+ */
+
+__attribute__((target("avx2")))
+static inline void
+avx2_load_rgb(const cups_ib_t *in,	/* I - 48 bytes of RGB pixels */
+              __m256i         g[2])	/* O - RGB0 pixels */
+{
+  __m128i	a, b, c;		/* Input bytes */
+  __m256i	e;			/* RGB to RGB0 mask */
+
+
+  a = _mm_loadu_si128((const __m128i *)in);
+  b = _mm_loadu_si128((const __m128i *)(in + 16));
+  c = _mm_loadu_si128((const __m128i *)(in + 32));
+  e = _mm256_setr_epi8(RGB_TO_RGB0, RGB_TO_RGB0);
+
+  g[0] = _mm256_shuffle_epi8(
+             _mm256_inserti128_si256(_mm256_castsi128_si256(a),
+	                             _mm_alignr_epi8(b, a, 12), 1), e);
+  g[1] = _mm256_shuffle_epi8(
+             _mm256_inserti128_si256(
+	         _mm256_castsi128_si256(_mm_alignr_epi8(c, b, 8)),
+		 _mm_srli_si128(c, 4), 1), e);
+}
+
+
+/*
+ * 'avx2_store_rgb()' - Store two registers of RGB0 pixels as 48 bytes.
+ */
+
+__attribute__((target("avx2")))
+static inline void
+avx2_store_rgb(cups_ib_t *out,		/* O - 48 bytes of RGB pixels */
+               __m256i   g[2])		/* I - RGB0 pixels */
+{
+  __m128i	p[4];			/* Pixels */
+
+
+  p[0] = _mm256_castsi256_si128(g[0]);
+  p[1] = _mm256_extracti128_si256(g[0], 1);
+  p[2] = _mm256_castsi256_si128(g[1]);
+  p[3] = _mm256_extracti128_si256(g[1], 1);
+
+  ssse3_store_rgb(out, p);
+}
+
+
+/*
+ * 'avx2_cmyk_to_rgb()' - Convert 16 CMYK pixels to RGB.
+ */
+
+__attribute__((target("avx2")))
+static void
+avx2_cmyk_to_rgb(const cups_ib_t *in,	/* I - Input pixels */
+                 cups_ib_t       *out)	/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m256i	v, g[2],		/* Pixels */
+		ones,			/* All bits set */
+		kkk;			/* K to CMY mask */
+
+
+  ones = _mm256_set1_epi8(-1);
+  kkk  = _mm256_setr_epi8(KKK0, KKK0);
+
+  for (i = 0; i < 2; i ++)
+  {
+    v    = _mm256_loadu_si256((const __m256i *)(in + 32 * i));
+    g[i] = _mm256_subs_epu8(_mm256_xor_si256(v, ones),
+                            _mm256_shuffle_epi8(v, kkk));
+  }
+
+  avx2_store_rgb(out, g);
+}
+
+
+/*
+ * 'avx2_cmyk_to_white()' - Convert 16 CMYK pixels to luminance.
+ */
+
+__attribute__((target("avx2")))
+static void
+avx2_cmyk_to_white(const cups_ib_t *in,	/* I - Input pixels */
+                   cups_ib_t       *out)/* O - Output pixels */
+{
+  __m256i	a, b,			/* Pixels */
+		w,			/* White values */
+		luma,			/* Luminance weights */
+		k16;			/* K mask */
+
+
+  luma = _mm256_setr_epi8(LUMA, LUMA);
+  k16  = _mm256_setr_epi8(K16, K16);
+  a    = _mm256_loadu_si256((const __m256i *)in);
+  b    = _mm256_loadu_si256((const __m256i *)(in + 32));
+
+ /*
+  * The 16-bit results are in the order 0-3, 8-11, 4-7, 12-15...
+  */
+
+  w = _mm256_hadd_epi16(_mm256_maddubs_epi16(a, luma),
+                        _mm256_maddubs_epi16(b, luma));
+  w = _mm256_srli_epi16(_mm256_mulhi_epu16(w, _mm256_set1_epi16(5243)), 3);
+  w = _mm256_sub_epi16(_mm256_sub_epi16(_mm256_set1_epi16(255), w),
+                       _mm256_unpacklo_epi64(_mm256_shuffle_epi8(a, k16),
+		                             _mm256_shuffle_epi8(b, k16)));
+  w = _mm256_permute4x64_epi64(w, _MM_SHUFFLE(3, 1, 2, 0));
+
+  _mm_storeu_si128((__m128i *)out,
+                   _mm_packus_epi16(_mm256_castsi256_si128(w),
+                                    _mm256_extracti128_si256(w, 1)));
+}
+
+
+/*
+ * 'avx2_rgb_to_cmy()' - Convert 16 RGB pixels to CMY.
+ */
+
+__attribute__((target("avx2")))
+static void
+avx2_rgb_to_cmy(const cups_ib_t *in,	/* I - Input pixels */
+                cups_ib_t       *out)	/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m256i	g[2],			/* Pixels */
+		r, gr, b,		/* RGB values */
+		c, m, y, k,		/* CMYK values */
+		mask,			/* Low byte mask */
+		full,			/* 255 */
+		div255;			/* Reciprocal of 255 */
+
+
+  mask   = _mm256_set1_epi32(255);
+  full   = _mm256_set1_epi32(255);
+  div255 = _mm256_set1_epi16((short)32897);
+
+  avx2_load_rgb(in, g);
+
+  for (i = 0; i < 2; i ++)
+  {
+    r  = _mm256_and_si256(g[i], mask);
+    gr = _mm256_and_si256(_mm256_srli_epi32(g[i], 8), mask);
+    b  = _mm256_srli_epi32(g[i], 16);
+    c  = _mm256_sub_epi32(full, r);
+    m  = _mm256_sub_epi32(full, gr);
+    y  = _mm256_sub_epi32(full, b);
+    k  = _mm256_min_epi32(c, _mm256_min_epi32(m, y));
+
+    c = _mm256_mullo_epi16(_mm256_sub_epi32(full, _mm256_srli_epi32(gr, 2)),
+                           _mm256_sub_epi32(c, k));
+    m = _mm256_mullo_epi16(_mm256_sub_epi32(full, _mm256_srli_epi32(b, 2)),
+                           _mm256_sub_epi32(m, k));
+    y = _mm256_mullo_epi16(_mm256_sub_epi32(full, _mm256_srli_epi32(r, 2)),
+                           _mm256_sub_epi32(y, k));
+
+    c = _mm256_add_epi32(_mm256_srli_epi16(_mm256_mulhi_epu16(c, div255), 7),
+                         k);
+    m = _mm256_add_epi32(_mm256_srli_epi16(_mm256_mulhi_epu16(m, div255), 7),
+                         k);
+    y = _mm256_add_epi32(_mm256_srli_epi16(_mm256_mulhi_epu16(y, div255), 7),
+                         k);
+
+    g[i] = _mm256_or_si256(c, _mm256_or_si256(_mm256_slli_epi32(m, 8),
+                                              _mm256_slli_epi32(y, 16)));
+  }
+
+  avx2_store_rgb(out, g);
+}
+
+
+/*
+ * 'avx2_rgb_to_cmyk()' - Convert 16 RGB pixels to CMYK.
+ */
+
+__attribute__((target("avx2")))
+static void
+avx2_rgb_to_cmyk(const cups_ib_t *in,	/* I - Input pixels */
+                 cups_ib_t       *out)	/* O - Output pixels */
+{
+  int		i;			/* Looping var */
+  __m256i	g[2],			/* Pixels */
+		c, m, y, k, km,		/* CMYK values */
+		mask;			/* Low byte mask */
+  __m256	kf, kmf;		/* K and maximum K */
+
+
+  mask = _mm256_set1_epi32(255);
+
+  avx2_load_rgb(in, g);
+
+  for (i = 0; i < 2; i ++)
+  {
+    g[i] = _mm256_xor_si256(g[i], _mm256_set1_epi32(0xffffff));
+    c    = _mm256_and_si256(g[i], mask);
+    m    = _mm256_and_si256(_mm256_srli_epi32(g[i], 8), mask);
+    y    = _mm256_srli_epi32(g[i], 16);
+    k    = _mm256_min_epi32(c, _mm256_min_epi32(m, y));
+    km   = _mm256_max_epi32(c, _mm256_max_epi32(m, y));
+
+    kf  = _mm256_cvtepi32_ps(k);
+    kmf = _mm256_cvtepi32_ps(km);
+    k   = _mm256_cvttps_epi32(
+              _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(kf, kf), kf),
+                            _mm256_max_ps(_mm256_mul_ps(kmf, kmf),
+			                  _mm256_set1_ps(1.0f))));
+
+    c = _mm256_sub_epi32(c, k);
+    m = _mm256_sub_epi32(m, k);
+    y = _mm256_sub_epi32(y, k);
+
+    _mm256_storeu_si256((__m256i *)(out + 32 * i),
+                        _mm256_or_si256(
+			    _mm256_or_si256(c, _mm256_slli_epi32(m, 8)),
+		            _mm256_or_si256(_mm256_slli_epi32(y, 16),
+				            _mm256_slli_epi32(k, 24))));
+  }
+}
+
+
+/*
+ * 'avx2_rgb_to_white()' - Convert 16 RGB pixels to luminance.
+ */
+
+__attribute__((target("avx2")))
+static void
+avx2_rgb_to_white(const cups_ib_t *in,	/* I - Input pixels */
+                  cups_ib_t       *out)	/* O - Output pixels */
+{
+  __m256i	g[2],			/* Pixels */
+		w,			/* White values */
+		luma;			/* Luminance weights */
+
+
+  luma = _mm256_setr_epi8(LUMA, LUMA);
+
+  avx2_load_rgb(in, g);
+
+ /*
+  * The 16-bit results are in the order 0-3, 8-11, 4-7, 12-15...
+  */
+
+  w = _mm256_hadd_epi16(_mm256_maddubs_epi16(g[0], luma),
+                        _mm256_maddubs_epi16(g[1], luma));
+  w = _mm256_srli_epi16(_mm256_mulhi_epu16(w, _mm256_set1_epi16(5243)), 3);
+  w = _mm256_permute4x64_epi64(w, _MM_SHUFFLE(3, 1, 2, 0));
+
+  _mm_storeu_si128((__m128i *)out,
+                   _mm_packus_epi16(_mm256_castsi256_si128(w),
+                                    _mm256_extracti128_si256(w, 1)));
+}
+#endif /* HAVE_X86_SIMD */
+
+
+/*
+ * '_cupsImageGetSIMD()' - Get the selected SIMD level.
+ */
+
+int					/* O - CUPS_IMAGE_SIMD_xxx */
+_cupsImageGetSIMD(void)
+{
+  return (get_level());
+}
+
+
+/*
+ * '_cupsImageSetSIMD()' - Select the SIMD kernels to use.
+ *
+ * A negative level selects the best kernels the CPU supports; other levels
+ * are limited to what the CPU supports.  The selected level is returned.
+ */
+
+int					/* O - Selected level */
+_cupsImageSetSIMD(int level)		/* I - CUPS_IMAGE_SIMD_xxx or -1 */
+{
+  int	best = CUPS_IMAGE_SIMD_NONE;	/* Best supported level */
+
+
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    best = CUPS_IMAGE_SIMD_AVX2;
+  else if (__builtin_cpu_supports("ssse3"))
+    best = CUPS_IMAGE_SIMD_SSSE3;
+#endif /* HAVE_X86_SIMD */
+
+  if (level < 0 || level > best)
+    level = best;
+
+  simd_level = level;
+
+  return (level);
+}
+
+
+/*
+ * '_cupsImageSIMDCMYKToRGB()' - Convert CMYK colors to RGB.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDCMYKToRGB(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count)		/* I - Number of pixels */
+{
+  int	i = 0;				/* Pixels converted */
+
+
+#ifdef HAVE_X86_SIMD
+  switch (get_level())
+  {
+    case CUPS_IMAGE_SIMD_AVX2 :
+        for (; i + 16 <= count; i += 16)
+	  avx2_cmyk_to_rgb(in + 4 * i, out + 3 * i);
+        break;
+    case CUPS_IMAGE_SIMD_SSSE3 :
+        for (; i + 16 <= count; i += 16)
+	  ssse3_cmyk_to_rgb(in + 4 * i, out + 3 * i);
+        break;
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)count;
+#endif /* HAVE_X86_SIMD */
+
+  return (i);
+}
+
+
+/*
+ * '_cupsImageSIMDCMYKToWhite()' - Convert CMYK colors to luminance.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDCMYKToWhite(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count)		/* I - Number of pixels */
+{
+  int	i = 0;				/* Pixels converted */
+
+
+#ifdef HAVE_X86_SIMD
+  switch (get_level())
+  {
+    case CUPS_IMAGE_SIMD_AVX2 :
+        for (; i + 16 <= count; i += 16)
+	  avx2_cmyk_to_white(in + 4 * i, out + i);
+        break;
+    case CUPS_IMAGE_SIMD_SSSE3 :
+        for (; i + 16 <= count; i += 16)
+	  ssse3_cmyk_to_white(in + 4 * i, out + i);
+        break;
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)count;
+#endif /* HAVE_X86_SIMD */
+
+  return (i);
+}
+
+
+/*
+ * '_cupsImageSIMDRGBToCMY()' - Convert RGB colors to CMY.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDRGBToCMY(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count)		/* I - Number of pixels */
+{
+  int	i = 0;				/* Pixels converted */
+
+
+#ifdef HAVE_X86_SIMD
+  switch (get_level())
+  {
+    case CUPS_IMAGE_SIMD_AVX2 :
+        for (; i + 16 <= count; i += 16)
+	  avx2_rgb_to_cmy(in + 3 * i, out + 3 * i);
+        break;
+    case CUPS_IMAGE_SIMD_SSSE3 :
+        for (; i + 16 <= count; i += 16)
+	  ssse3_rgb_to_cmy(in + 3 * i, out + 3 * i);
+        break;
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)count;
+#endif /* HAVE_X86_SIMD */
+
+  return (i);
+}
+
+
+/*
+ * '_cupsImageSIMDRGBToCMYK()' - Convert RGB colors to CMYK.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDRGBToCMYK(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count)		/* I - Number of pixels */
+{
+  int	i = 0;				/* Pixels converted */
+
+
+#ifdef HAVE_X86_SIMD
+  switch (get_level())
+  {
+    case CUPS_IMAGE_SIMD_AVX2 :
+        for (; i + 16 <= count; i += 16)
+	  avx2_rgb_to_cmyk(in + 3 * i, out + 4 * i);
+        break;
+    case CUPS_IMAGE_SIMD_SSSE3 :
+        for (; i + 16 <= count; i += 16)
+	  ssse3_rgb_to_cmyk(in + 3 * i, out + 4 * i);
+        break;
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)count;
+#endif /* HAVE_X86_SIMD */
+
+  return (i);
+}
+
+
+/*
+ * '_cupsImageSIMDRGBToWhite()' - Convert RGB colors to luminance.
+ */
+
+int					/* O - Number of pixels converted */
+_cupsImageSIMDRGBToWhite(
+    const cups_ib_t *in,		/* I - Input pixels */
+    cups_ib_t       *out,		/* I - Output pixels */
+    int             count)		/* I - Number of pixels */
+{
+  int	i = 0;				/* Pixels converted */
+
+
+#ifdef HAVE_X86_SIMD
+  switch (get_level())
+  {
+    case CUPS_IMAGE_SIMD_AVX2 :
+        for (; i + 16 <= count; i += 16)
+	  avx2_rgb_to_white(in + 3 * i, out + i);
+        break;
+    case CUPS_IMAGE_SIMD_SSSE3 :
+        for (; i + 16 <= count; i += 16)
+	  ssse3_rgb_to_white(in + 3 * i, out + i);
+        break;
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)count;
+#endif /* HAVE_X86_SIMD */
+
+  return (i);
+}
+
+
+/*
+ * 'get_level()' - Get the selected SIMD level.
+ */
+
+static int				/* O - CUPS_IMAGE_SIMD_xxx */
+get_level(void)
+{
+  if (simd_level < 0)
+    return (_cupsImageSetSIMD(-1));
+
+  return (simd_level);
+}
+
+
+/*
+ * End of "$Id$".
+ */
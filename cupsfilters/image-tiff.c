@@ -17,6 +17,18 @@
  * Contents:
  *
  *   _cupsImageReadTIFF() - Read a TIFF image file.
+ *   tiff_close_rows()    - Free a strip/tile reader.
+ *   tiff_decode()        - Decode strips or tiles of the current band.
+ *   tiff_fill()          - Decode the band of rows holding a row.
+ *   tiff_io_close()      - Close a per-thread TIFF handle.
+ *   tiff_io_map()        - Refuse to map a per-thread TIFF handle.
+ *   tiff_io_read()       - Read from a per-thread TIFF handle.
+ *   tiff_io_seek()       - Seek a per-thread TIFF handle.
+ *   tiff_io_size()       - Return the size of the TIFF file.
+ *   tiff_io_unmap()      - Unmap a per-thread TIFF handle.
+ *   tiff_io_write()      - Refuse to write to a per-thread TIFF handle.
+ *   tiff_open_rows()     - Create a strip/tile reader for a TIFF file.
+ *   tiff_read_row()      - Copy a row from the decoded band.
  */
 
 /*
@@ -29,6 +41,75 @@
 #  include <tiff.h>	/* TIFF image definitions */
 #  include <tiffio.h>
 #  include <unistd.h>
+#  include <sys/stat.h>
+
+
+/*
+ * Types...
+ */
+
+typedef struct cups_tiffio_s		/**** Per-thread TIFF file access ****/
+{
+  int			fd;		/* File descriptor */
+  toff_t		pos;		/* Current file position */
+} cups_tiffio_t;
+
+typedef struct cups_tiffwork_s		/**** TIFF decoding thread ****/
+{
+  struct cups_tiffrd_s	*rd;		/* Strip/tile reader */
+  int			index;		/* Index of this thread */
+  TIFF			*tif;		/* TIFF handle used by this thread */
+  cups_ib_t		*tile;		/* Tile buffer */
+  cups_tiffio_t		io;		/* File access for this thread */
+#ifdef HAVE_PTHREAD_H
+  pthread_t		thread;		/* Thread */
+  int			started;	/* Was the thread started? */
+#endif /* HAVE_PTHREAD_H */
+} cups_tiffwork_t;
+
+typedef struct cups_tiffrd_s		/**** TIFF strip/tile reader ****/
+{
+  TIFF			*tif;		/* TIFF file */
+  int			byrow,		/* Read rows with TIFFReadScanline()? */
+			tiled;		/* Is the image tiled? */
+  uint32		width, height,	/* Size of image */
+			tilew,		/* Width of tiles */
+			rows,		/* Rows per strip or tile */
+			batch,		/* Strips decoded at a time */
+			first,		/* First row in band */
+			count,		/* Number of rows in band */
+			item0,		/* First strip in band */
+			nitems;		/* Number of strips/tiles in band */
+  tsize_t		scanwidth,	/* Bytes per row */
+			tilerow;	/* Bytes per tile row */
+  cups_ib_t		*band;		/* Decoded rows */
+  char			*bad,		/* Strips/tiles that failed to decode */
+			badtiles;	/* Did a tile of the band fail? */
+  int			num_work,	/* Number of decoding threads */
+			num_active;	/* Threads decoding the current band */
+  cups_tiffwork_t	work[CUPS_TIFF_THREADS];
+					/* Decoding threads */
+} cups_tiffrd_t;
+
+
+/*
+ * Local functions...
+ */
+
+static void		tiff_close_rows(cups_tiffrd_t *rd);
+static void		*tiff_decode(void *data);
+static int		tiff_fill(cups_tiffrd_t *rd, uint32 row);
+static int		tiff_io_close(thandle_t fd);
+static int		tiff_io_map(thandle_t fd, tdata_t *base, toff_t *size);
+static tsize_t		tiff_io_read(thandle_t fd, tdata_t buf, tsize_t size);
+static toff_t		tiff_io_seek(thandle_t fd, toff_t off, int whence);
+static toff_t		tiff_io_size(thandle_t fd);
+static void		tiff_io_unmap(thandle_t fd, tdata_t base, toff_t size);
+static tsize_t		tiff_io_write(thandle_t fd, tdata_t buf, tsize_t size);
+static cups_tiffrd_t	*tiff_open_rows(TIFF *tif, int fd,
+			                uint16 compression);
+static int		tiff_read_row(cups_tiffrd_t *rd, cups_ib_t *buf,
+			              uint32 row);
 
 
 /*
@@ -46,6 +127,7 @@ _cupsImageReadTIFF(
     const cups_ib_t *lut)		/* I - Lookup table for gamma/brightness */
 {
   TIFF		*tif;			/* TIFF file */
+  cups_tiffrd_t	*rd;			/* Strip/tile reader */
   uint32	width, height;		/* Size of image */
   uint16	photometric,		/* Colorspace */
 		compression,		/* Type of compression */
@@ -71,7 +153,8 @@ _cupsImageReadTIFF(
 		pstep,			/* Pixel step (= bpp or -2 * bpp) */
 		scanwidth,		/* Width of scanline */
 		r, g, b, k,		/* Red, green, blue, and black values */
-		alpha;			/* cupsImage includes alpha? */
+		alpha,			/* cupsImage includes alpha? */
+		badrows;		/* Rows that could not be read */
   cups_ib_t		*in,			/* Input buffer */
 		*out,			/* Output buffer */
 		*p,			/* Pointer into buffer */
@@ -298,6 +381,17 @@ _cupsImageReadTIFF(
   scanwidth = TIFFScanlineSize(tif);
   scanline  = _TIFFmalloc(scanwidth);
 
+  badrows = 0;
+
+  if ((rd = tiff_open_rows(tif, fileno(fp), compression)) == NULL)
+  {
+    fputs("DEBUG: Unable to read TIFF strips or tiles!\n", stderr);
+    _TIFFfree(scanline);
+    TIFFClose(tif);
+    fclose(fp);
+    return (-1);
+  }
+
  /*
   * Allocate input and output buffers...
   */
@@ -359,7 +453,9 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart, bit = 128;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -380,7 +476,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart, bit = 0xc0;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -401,7 +499,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart, bit = 0xf0;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -421,7 +521,8 @@ _cupsImageReadTIFF(
             }
             else if (xdir < 0 || zero || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
 
               if (alpha)
 	      {
@@ -460,8 +561,8 @@ _cupsImageReadTIFF(
         	}
               }
             }
-            else
-              TIFFReadScanline(tif, in, row, 0);
+            else if (tiff_read_row(rd, in, row) < 0)
+              badrows ++;
 
             if (img->colorspace == CUPS_IMAGE_WHITE)
 	    {
@@ -510,7 +611,9 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart, bit = 128;
                    ycount > 0;
                    ycount --, p += ydir)
@@ -531,7 +634,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart, bit = 0xc0;
                    ycount > 0;
                    ycount --, p += ydir)
@@ -553,7 +658,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart, bit = 0xf0;
                    ycount > 0;
                    ycount --, p += ydir)
@@ -573,7 +680,8 @@ _cupsImageReadTIFF(
             }
             else if (ydir < 0 || zero || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
 
               if (alpha)
 	      {
@@ -612,8 +720,8 @@ _cupsImageReadTIFF(
         	}
 	      }
             }
-            else
-              TIFFReadScanline(tif, in, row, 0);
+            else if (tiff_read_row(rd, in, row) < 0)
+              badrows ++;
 
             if (img->colorspace == CUPS_IMAGE_WHITE)
 	    {
@@ -655,6 +763,7 @@ _cupsImageReadTIFF(
     case PHOTOMETRIC_PALETTE :
 	if (!TIFFGetField(tif, TIFFTAG_COLORMAP, &redcmap, &greencmap, &bluecmap))
 	{
+	  tiff_close_rows(rd);
 	  _TIFFfree(scanline);
 	  free(in);
 	  free(out);
@@ -686,7 +795,9 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline,
 	               p = in + xstart * 3, bit = 128;
                    xcount > 0;
@@ -716,7 +827,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline,
 	               p = in + xstart * 3, bit = 0xc0;
                    xcount > 0;
@@ -741,7 +854,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline,
 	               p = in + 3 * xstart, bit = 0xf0;
                    xcount > 0;
@@ -767,7 +882,8 @@ _cupsImageReadTIFF(
             }
             else
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
 
               for (xcount = img->xsize, p = in + 3 * xstart, scanptr = scanline;
                    xcount > 0;
@@ -819,7 +935,9 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline,
 	               p = in + 3 * ystart, bit = 128;
                    ycount > 0;
@@ -849,7 +967,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline,
 	               p = in + 3 * ystart, bit = 0xc0;
                    ycount > 0;
@@ -874,7 +994,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline,
 	               p = in + 3 * ystart, bit = 0xf0;
                    ycount > 0;
@@ -900,7 +1022,8 @@ _cupsImageReadTIFF(
             }
             else
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
 
               for (ycount = img->ysize, p = in + 3 * ystart, scanptr = scanline;
                    ycount > 0;
@@ -955,7 +1078,9 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3, bit = 0xf0;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -986,7 +1111,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                    xcount > 0;
                    xcount --, p += pstep, scanptr ++)
@@ -1001,7 +1128,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                    xcount > 0;
                    xcount -= 2, p += 2 * pstep, scanptr += 3)
@@ -1025,7 +1154,8 @@ _cupsImageReadTIFF(
             }
             else if (xdir < 0 || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
 
               if (alpha)
 	      {
@@ -1050,8 +1180,8 @@ _cupsImageReadTIFF(
         	}
 	      }
             }
-            else
-              TIFFReadScanline(tif, in, row, 0);
+            else if (tiff_read_row(rd, in, row) < 0)
+              badrows ++;
 
             if ((saturation != 100 || hue != 0) && bpp > 1)
               cupsImageRGBAdjust(in, img->xsize, saturation, hue);
@@ -1096,7 +1226,9 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart * 3, bit = 0xf0;
                    ycount > 0;
                    ycount --, p += pstep)
@@ -1127,7 +1259,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart * 3;
                    ycount > 0;
                    ycount --, p += pstep, scanptr ++)
@@ -1142,7 +1276,9 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
+
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart * 3;
                    ycount > 0;
                    ycount -= 2, p += 2 * pstep, scanptr += 3)
@@ -1166,7 +1302,8 @@ _cupsImageReadTIFF(
             }
             else if (ydir < 0 || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              if (tiff_read_row(rd, scanline, row) < 0)
+                badrows ++;
 
               if (alpha)
 	      {
@@ -1191,8 +1328,8 @@ _cupsImageReadTIFF(
         	}
 	      }
             }
-            else
-              TIFFReadScanline(tif, in, row, 0);
+            else if (tiff_read_row(rd, in, row) < 0)
+              badrows ++;
 
             if ((saturation != 100 || hue != 0) && bpp > 1)
               cupsImageRGBAdjust(in, img->ysize, saturation, hue);
@@ -1255,7 +1392,9 @@ _cupsImageReadTIFF(
             {
               if (bits == 1)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
+
         	for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3, bit = 0xf0;
                      xcount > 0;
                      xcount --, p += pstep)
@@ -1295,7 +1434,9 @@ _cupsImageReadTIFF(
               }
               else if (bits == 2)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
+
         	for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                      xcount > 0;
                      xcount --, p += pstep, scanptr ++)
@@ -1341,7 +1482,9 @@ _cupsImageReadTIFF(
               }
               else if (bits == 4)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
+
         	for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                      xcount > 0;
                      xcount --, p += pstep, scanptr += 2)
@@ -1387,12 +1530,15 @@ _cupsImageReadTIFF(
               }
               else if (img->colorspace == CUPS_IMAGE_CMYK)
 	      {
-	        TIFFReadScanline(tif, scanline, row, 0);
+	        if (tiff_read_row(rd, scanline, row) < 0)
+	          badrows ++;
+
 		_cupsImagePutRow(img, 0, y, img->xsize, scanline);
 	      }
 	      else
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
 
         	for (xcount = img->xsize, p = in + xstart * 3, scanptr = scanline;
                      xcount > 0;
@@ -1477,7 +1623,9 @@ _cupsImageReadTIFF(
             {
               if (bits == 1)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
+
         	for (ycount = img->ysize, scanptr = scanline, p = in + xstart * 3, bit = 0xf0;
                      ycount > 0;
                      ycount --, p += pstep)
@@ -1517,7 +1665,9 @@ _cupsImageReadTIFF(
               }
               else if (bits == 2)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
+
         	for (ycount = img->ysize, scanptr = scanline, p = in + xstart * 3;
                      ycount > 0;
                      ycount --, p += pstep, scanptr ++)
@@ -1563,7 +1713,9 @@ _cupsImageReadTIFF(
               }
               else if (bits == 4)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
+
         	for (ycount = img->ysize, scanptr = scanline, p = in + xstart * 3;
                      ycount > 0;
                      ycount --, p += pstep, scanptr += 2)
@@ -1609,12 +1761,15 @@ _cupsImageReadTIFF(
               }
               else if (img->colorspace == CUPS_IMAGE_CMYK)
 	      {
-	        TIFFReadScanline(tif, scanline, row, 0);
+	        if (tiff_read_row(rd, scanline, row) < 0)
+	          badrows ++;
+
 		_cupsImagePutCol(img, x, 0, img->ysize, scanline);
 	      }
               else
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	if (tiff_read_row(rd, scanline, row) < 0)
+        	  badrows ++;
 
         	for (ycount = img->ysize, p = in + xstart * 3, scanptr = scanline;
                      ycount > 0;
@@ -1692,6 +1847,7 @@ _cupsImageReadTIFF(
 	}
 
     default :
+	tiff_close_rows(rd);
 	_TIFFfree(scanline);
 	free(in);
 	free(out);
@@ -1705,6 +1861,11 @@ _cupsImageReadTIFF(
   * Free temporary buffers, close the TIFF file, and return.
   */
 
+  if (badrows)
+    fprintf(stderr, "DEBUG: %d rows of the TIFF image could not be read!\n",
+            badrows);
+
+  tiff_close_rows(rd);
   _TIFFfree(scanline);
   free(in);
   free(out);
@@ -1712,6 +1873,524 @@ _cupsImageReadTIFF(
   TIFFClose(tif);
   return (0);
 }
+
+
+/*
+ * 'tiff_close_rows()' - Free a strip/tile reader.
+ *
+ * The TIFF file of the reader is closed by the caller.
+ */
+
+static void
+tiff_close_rows(cups_tiffrd_t *rd)	/* I - Strip/tile reader */
+{
+  int	t;				/* Looping var */
+
+
+  for (t = 0; t < rd->num_work; t ++)
+  {
+    if (rd->work[t].tile)
+      _TIFFfree(rd->work[t].tile);
+
+    if (t > 0 && rd->work[t].tif)
+      TIFFClose(rd->work[t].tif);
+  }
+
+  free(rd->band);
+  free(rd->bad);
+  free(rd);
+}
+
+
+/*
+ * 'tiff_decode()' - Decode strips or tiles of the current band.
+ *
+ * Each thread decodes every "num_active"-th strip or tile, starting with
+ * its own index, using its own TIFF handle.  Strips and tiles that cannot
+ * be decoded are flagged in "bad" so that tiff_read_row() reports their
+ * rows as unreadable and leaves the caller's buffer alone, as
+ * TIFFReadScanline() does.
+ */
+
+static void *				/* O - Thread exit status */
+tiff_decode(void *data)			/* I - Decoding thread */
+{
+  cups_tiffwork_t	*w = (cups_tiffwork_t *)data;
+					/* Decoding thread */
+  cups_tiffrd_t		*rd = w->rd;	/* Strip/tile reader */
+  uint32		i,		/* Current strip or tile */
+			y;		/* Current row in tile */
+  cups_ib_t		*bandptr;	/* Pointer into band */
+  tsize_t		offset,		/* Offset of tile in row */
+			bytes;		/* Bytes of tile in row */
+
+
+  for (i = (uint32)w->index; i < rd->nitems; i += (uint32)rd->num_active)
+  {
+    if (!rd->tiled)
+    {
+     /*
+      * Strips are decoded straight into the band...
+      */
+
+      bandptr = rd->band + (size_t)i * rd->rows * rd->scanwidth;
+
+      if ((rd->bad[i] = TIFFReadEncodedStrip(w->tif, rd->item0 + i, bandptr,
+                                             (tsize_t)-1) < 0) != 0)
+        fprintf(stderr, "DEBUG: Unable to decode TIFF strip %u!\n",
+	        (unsigned)(rd->item0 + i));
+    }
+    else
+    {
+     /*
+      * Tiles are decoded into the tile buffer and copied into the band,
+      * clipping the tiles on the right edge of the image...
+      */
+
+      if ((rd->bad[i] = TIFFReadEncodedTile(w->tif,
+                                            TIFFComputeTile(w->tif,
+					                    i * rd->tilew,
+			                                    rd->first, 0, 0),
+                                            w->tile, (tsize_t)-1) < 0) != 0)
+      {
+        fprintf(stderr, "DEBUG: Unable to decode TIFF tile %u,%u!\n",
+	        (unsigned)(i * rd->tilew), (unsigned)rd->first);
+	continue;
+      }
+
+      offset = (tsize_t)i * rd->tilerow;
+      bytes  = rd->scanwidth - offset;
+
+      if (bytes > rd->tilerow)
+        bytes = rd->tilerow;
+
+      for (y = 0, bandptr = rd->band + offset; y < rd->count;
+           y ++, bandptr += rd->scanwidth)
+        memcpy(bandptr, w->tile + (size_t)y * rd->tilerow, (size_t)bytes);
+    }
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'tiff_fill()' - Decode the band of rows holding a row.
+ *
+ * A band is a batch of strips, or one row of tiles.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+tiff_fill(cups_tiffrd_t *rd,		/* I - Strip/tile reader */
+          uint32        row)		/* I - Row in image */
+{
+  int		t;			/* Looping var */
+  uint32	i;			/* Current tile */
+
+
+  if (row >= rd->height)
+    return (-1);
+
+  rd->first = row - row % rd->rows;
+
+  if (rd->tiled)
+  {
+    rd->item0  = 0;
+    rd->nitems = (rd->width + rd->tilew - 1) / rd->tilew;
+    rd->count  = rd->rows;
+  }
+  else
+  {
+    rd->item0  = rd->first / rd->rows;
+    rd->nitems = (rd->height - rd->first + rd->rows - 1) / rd->rows;
+    if (rd->nitems > rd->batch)
+      rd->nitems = rd->batch;
+    rd->count  = rd->nitems * rd->rows;
+  }
+
+  if (rd->count > rd->height - rd->first)
+    rd->count = rd->height - rd->first;
+
+  if ((uint32)rd->num_work > rd->nitems)
+    rd->num_active = (int)rd->nitems;
+  else
+    rd->num_active = rd->num_work;
+
+#ifdef HAVE_PTHREAD_H
+ /*
+  * Start the other threads, decode our own share, and wait for the
+  * others; a thread that cannot be started has its share decoded here...
+  */
+
+  for (t = 1; t < rd->num_active; t ++)
+    rd->work[t].started = !pthread_create(&(rd->work[t].thread), NULL,
+                                          tiff_decode, rd->work + t);
+
+  tiff_decode(rd->work);
+
+  for (t = 1; t < rd->num_active; t ++)
+    if (rd->work[t].started)
+      pthread_join(rd->work[t].thread, NULL);
+    else
+      tiff_decode(rd->work + t);
+#else
+  for (t = 0; t < rd->num_active; t ++)
+    tiff_decode(rd->work + t);
+#endif /* HAVE_PTHREAD_H */
+
+  if (rd->tiled)
+    for (i = 0, rd->badtiles = 0; i < rd->nitems; i ++)
+      rd->badtiles |= rd->bad[i];
+
+  return (0);
+}
+
+
+/*
+ * 'tiff_io_close()' - Close a per-thread TIFF handle.
+ *
+ * The file descriptor is shared with the main TIFF handle and stays open.
+ */
+
+static int				/* O - 0 on success */
+tiff_io_close(thandle_t fd)		/* I - File access */
+{
+  (void)fd;
+
+  return (0);
+}
+
+
+/*
+ * 'tiff_io_map()' - Refuse to map a per-thread TIFF handle.
+ */
+
+static int				/* O - 0 (not mapped) */
+tiff_io_map(thandle_t fd,		/* I - File access */
+            tdata_t   *base,		/* O - Mapped data */
+	    toff_t    *size)		/* O - Size of mapped data */
+{
+  (void)fd;
+  (void)base;
+  (void)size;
+
+  return (0);
+}
+
+
+/*
+ * 'tiff_io_read()' - Read from a per-thread TIFF handle.
+ *
+ * pread() is used so that the threads do not share a file position.
+ */
+
+static tsize_t				/* O - Bytes read or -1 on error */
+tiff_io_read(thandle_t fd,		/* I - File access */
+             tdata_t   buf,		/* O - Buffer */
+	     tsize_t   size)		/* I - Bytes to read */
+{
+  cups_tiffio_t	*io = (cups_tiffio_t *)fd;
+					/* File access */
+  ssize_t	bytes,			/* Bytes read */
+		total;			/* Total bytes read */
+
+
+  for (total = 0; total < size; total += bytes)
+  {
+    if ((bytes = pread(io->fd, (char *)buf + total, (size_t)(size - total),
+                       (off_t)(io->pos + total))) < 0)
+    {
+      if (errno == EINTR)
+      {
+        bytes = 0;
+	continue;
+      }
+
+      return (-1);
+    }
+    else if (bytes == 0)
+      break;
+  }
+
+  io->pos += total;
+
+  return ((tsize_t)total);
+}
+
+
+/*
+ * 'tiff_io_seek()' - Seek a per-thread TIFF handle.
+ */
+
+static toff_t				/* O - New file position */
+tiff_io_seek(thandle_t fd,		/* I - File access */
+             toff_t    off,		/* I - Offset */
+	     int       whence)		/* I - SEEK_SET, SEEK_CUR, or SEEK_END */
+{
+  cups_tiffio_t	*io = (cups_tiffio_t *)fd;
+					/* File access */
+
+
+  switch (whence)
+  {
+    case SEEK_SET :
+        io->pos = off;
+	break;
+    case SEEK_CUR :
+        io->pos += off;
+	break;
+    case SEEK_END :
+        io->pos = tiff_io_size(fd) + off;
+	break;
+    default :
+        return ((toff_t)-1);
+  }
+
+  return (io->pos);
+}
+
+
+/*
+ * 'tiff_io_size()' - Return the size of the TIFF file.
+ */
+
+static toff_t				/* O - Size of file */
+tiff_io_size(thandle_t fd)		/* I - File access */
+{
+  struct stat	fileinfo;		/* File information */
+
+
+  if (fstat(((cups_tiffio_t *)fd)->fd, &fileinfo))
+    return (0);
+
+  return ((toff_t)fileinfo.st_size);
+}
+
+
+/*
+ * 'tiff_io_unmap()' - Unmap a per-thread TIFF handle.
+ */
+
+static void
+tiff_io_unmap(thandle_t fd,		/* I - File access */
+              tdata_t   base,		/* I - Mapped data */
+	      toff_t    size)		/* I - Size of mapped data */
+{
+  (void)fd;
+  (void)base;
+  (void)size;
+}
+
+
+/*
+ * 'tiff_io_write()' - Refuse to write to a per-thread TIFF handle.
+ */
+
+static tsize_t				/* O - -1 (read-only) */
+tiff_io_write(thandle_t fd,		/* I - File access */
+              tdata_t   buf,		/* I - Buffer */
+	      tsize_t   size)		/* I - Bytes to write */
+{
+  (void)fd;
+  (void)buf;
+  (void)size;
+
+  return (-1);
+}
+
+
+/*
+ * 'tiff_open_rows()' - Create a strip/tile reader for a TIFF file.
+ *
+ * Rows are decoded a band at a time with TIFFReadEncodedStrip() or
+ * TIFFReadEncodedTile(), which also reads tiled files that
+ * TIFFReadScanline() cannot.  Strips and tiles are independent, so with
+ * threads each one is decoded on its own TIFF handle (pread()-based, so
+ * the handles do not share a file position).  Old-style JPEG keeps state
+ * between strips and is always decoded by a single thread.
+ */
+
+static cups_tiffrd_t *			/* O - Strip/tile reader or NULL */
+tiff_open_rows(TIFF   *tif,		/* I - TIFF file */
+               int    fd,		/* I - File descriptor of TIFF file */
+	       uint16 compression)	/* I - Type of compression */
+{
+  cups_tiffrd_t	*rd;			/* Strip/tile reader */
+  int		num_threads = 1;	/* Number of decoding threads */
+  uint32	items;			/* Strips in image, or tiles per row */
+  tsize_t	tilesize = 0;		/* Bytes per tile */
+
+
+  if ((rd = (cups_tiffrd_t *)calloc(1, sizeof(cups_tiffrd_t))) == NULL)
+    return (NULL);
+
+  rd->tif       = tif;
+  rd->tiled     = TIFFIsTiled(tif);
+  rd->scanwidth = TIFFScanlineSize(tif);
+
+  TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &(rd->width));
+  TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &(rd->height));
+
+  if (rd->scanwidth <= 0)
+  {
+    free(rd);
+    return (NULL);
+  }
+
+  if (rd->tiled)
+  {
+    if (!TIFFGetField(tif, TIFFTAG_TILEWIDTH, &(rd->tilew)) ||
+        !TIFFGetField(tif, TIFFTAG_TILELENGTH, &(rd->rows)) ||
+	rd->tilew == 0 || rd->rows == 0 ||
+	(rd->tilerow = TIFFTileRowSize(tif)) <= 0 ||
+	(tilesize = TIFFTileSize(tif)) < (tsize_t)rd->rows * rd->tilerow)
+    {
+      free(rd);
+      return (NULL);
+    }
+
+    rd->batch = 1;
+    items     = (rd->width + rd->tilew - 1) / rd->tilew;
+  }
+  else
+  {
+    if (!TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &(rd->rows)) ||
+        rd->rows == 0 || rd->rows > rd->height)
+      rd->rows = rd->height;
+
+    if ((tsize_t)rd->rows * rd->scanwidth > CUPS_TIFF_BAND)
+    {
+     /*
+      * Strips this big (often the whole image in one strip) are read a
+      * row at a time like before instead of being decoded in one piece...
+      */
+
+      rd->byrow = 1;
+
+      fputs("DEBUG: Reading TIFF rows\n", stderr);
+
+      return (rd);
+    }
+
+    items = (rd->height + rd->rows - 1) / rd->rows;
+
+    if ((rd->batch = CUPS_TIFF_BAND / rd->rows / rd->scanwidth) > items)
+      rd->batch = items;
+  }
+
+#if defined(HAVE_PTHREAD_H) && defined(_SC_NPROCESSORS_ONLN)
+  if (compression != COMPRESSION_OJPEG)
+    num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+  (void)compression;
+#endif /* HAVE_PTHREAD_H && _SC_NPROCESSORS_ONLN */
+
+  if (num_threads > CUPS_TIFF_THREADS)
+    num_threads = CUPS_TIFF_THREADS;
+  if (rd->tiled && (uint32)num_threads > items)
+    num_threads = (int)items;
+  else if (!rd->tiled && (uint32)num_threads > rd->batch)
+    num_threads = (int)rd->batch;
+  if (num_threads < 1)
+    num_threads = 1;
+
+  if ((rd->band = (cups_ib_t *)malloc((size_t)rd->batch * rd->rows *
+                                      rd->scanwidth)) == NULL ||
+      (rd->bad = (char *)calloc(rd->tiled ? items : rd->batch, 1)) == NULL)
+  {
+    free(rd->band);
+    rd->band = NULL;
+
+    if (rd->tiled)
+    {
+      free(rd);
+      return (NULL);
+    }
+
+    rd->byrow = 1;
+
+    fputs("DEBUG: Reading TIFF rows\n", stderr);
+
+    return (rd);
+  }
+
+ /*
+  * Open a TIFF handle for each extra thread, using however many could be
+  * opened...
+  */
+
+  for (rd->num_work = 0; rd->num_work < num_threads; rd->num_work ++)
+  {
+    cups_tiffwork_t *w = rd->work + rd->num_work;
+					/* Decoding thread */
+
+    w->rd    = rd;
+    w->index = rd->num_work;
+
+    if (rd->num_work == 0)
+      w->tif = tif;
+    else
+    {
+      w->io.fd  = fd;
+      w->io.pos = 0;
+
+      if ((w->tif = TIFFClientOpen("", "r", (thandle_t)&(w->io),
+                                   tiff_io_read, tiff_io_write,
+				   tiff_io_seek, tiff_io_close,
+				   tiff_io_size, tiff_io_map,
+				   tiff_io_unmap)) == NULL)
+        break;
+    }
+
+    if (rd->tiled && (w->tile = (cups_ib_t *)_TIFFmalloc(tilesize)) == NULL)
+    {
+      if (rd->num_work == 0)
+      {
+        free(rd->band);
+	free(rd->bad);
+	free(rd);
+	return (NULL);
+      }
+
+      TIFFClose(w->tif);
+      w->tif = NULL;
+      break;
+    }
+  }
+
+  fprintf(stderr, "DEBUG: Reading TIFF %s of %u rows with %d thread(s)\n",
+          rd->tiled ? "tiles" : "strips", (unsigned)rd->rows, rd->num_work);
+
+  return (rd);
+}
+
+
+/*
+ * 'tiff_read_row()' - Copy a row from the decoded band.
+ *
+ * The buffer is left alone when the row cannot be read.
+ */
+
+static int				/* O - 1 on success, -1 on error */
+tiff_read_row(cups_tiffrd_t *rd,	/* I - Strip/tile reader */
+              cups_ib_t     *buf,	/* O - Row buffer */
+	      uint32        row)	/* I - Row in image */
+{
+  if (rd->byrow)
+    return (TIFFReadScanline(rd->tif, buf, row, 0) < 0 ? -1 : 1);
+
+  if ((row < rd->first || row >= rd->first + rd->count) &&
+      tiff_fill(rd, row))
+    return (-1);
+
+  if (rd->tiled ? rd->badtiles : rd->bad[(row - rd->first) / rd->rows])
+    return (-1);
+
+  memcpy(buf, rd->band + (size_t)(row - rd->first) * rd->scanwidth,
+         (size_t)rd->scanwidth);
+
+  return (1);
+}
 #endif /* HAVE_LIBTIFF */
 
 
@@ -19,10 +19,45 @@
  *   _cupsImageZoomDelete() - Free a zoom record...
  *   _cupsImageZoomFill()   - Fill a zoom record...
  *   _cupsImageZoomNew()    - Allocate a pixel zoom record...
+ *   filter_bicubic()       - Bicubic (Catmull-Rom) filter kernel.
+ *   filter_col()           - Vertically filter one output row.
+ *   filter_free()          - Free the weights of a resampling filter.
+ *   filter_lanczos()       - Lanczos-3 filter kernel.
+ *   filter_new()           - Compute the weights of a resampling filter.
+ *   filter_row()           - Horizontally filter one input row.
+ *   pool_delete()          - Stop and free filtering threads.
+ *   pool_filter()          - Filter rows using the filtering threads.
+ *   pool_new()             - Start filtering threads.
+ *   pool_run()             - Filter rows until none are left.
+ *   pool_worker()          - Filtering thread.
+ *   rotate_cols()          - Rotate a strip of image columns for the filters.
+ *   zoom_batch()           - Filter a batch of output rows.
  *   zoom_bilinear()        - Fill a zoom record with image data utilizing
  *                            bilinear interpolation.
+ *   zoom_col()             - Get an input row of a rotated image.
+ *   zoom_filter()          - Fill a zoom record with bicubic or Lanczos
+ *                            filtered image data.
  *   zoom_nearest()         - Fill a zoom record quickly using nearest-neighbor
  *                            sampling.
+ *
+ * The bicubic and Lanczos filters are separable: every input row that is
+ * needed is filtered horizontally once into "hrows", and each output row is
+ * then a weighted sum of "num" consecutive rows of "hrows".  The weights
+ * for every output column and row are computed once when the zoom record is
+ * created and are stored as 16-bit fixed-point values that sum to exactly
+ * 1 << CUPS_IZOOM_PREC, so flat areas stay flat.  When shrinking, the
+ * filter is widened by the scale factor so that it also smooths away the
+ * detail that cannot be reproduced.
+ *
+ * Output rows are produced CUPS_IZOOM_BATCH at a time; the input rows and
+ * then the output rows of a batch are shared between the filtering threads.
+ * The SSE2 kernels compute exactly the same sums as the scalar code.
+ *
+ * The input rows of a rotated image are image columns, from right to left.
+ * Rather than walking down the tiles for every column, the columns are
+ * rotated out of whole tiles into "cols" by _cupsImageGetCols(),
+ * CUPS_IZOOM_STRIP at a time, or all the columns a batch needs at once for
+ * the filters.
  */
 
 /*
@@ -30,13 +65,69 @@
  */
 
 #include "image-private.h"
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
+
+
+/*
+ * Two 16-bit weights in the low and high halves of a 32-bit word, for
+ * _mm_madd_epi16()...
+ */
+
+#define WEIGHT_PAIR(w0,w1) \
+	(int)((unsigned short)(w0) | ((unsigned)(unsigned short)(w1) << 16))
+
+
+/*
+ * Types...
+ */
+
+typedef void (*zoom_func_t)(cups_izoom_t *z, int item, cups_ib_t *in);
+
+struct cups_izpool_s			/**** Filtering threads ****/
+{
+  int			num_threads;	/* Number of threads, including caller */
+#ifdef HAVE_PTHREAD_H
+  pthread_t		threads[CUPS_IZOOM_THREADS];
+					/* Worker threads */
+  pthread_mutex_t	mutex;		/* Lock for the fields below */
+  pthread_cond_t	work_cond,	/* Signaled when rows are queued */
+			done_cond;	/* Signaled when all rows are done */
+#endif /* HAVE_PTHREAD_H */
+  cups_izoom_t		*z;		/* Zoom record being filled */
+  zoom_func_t		func;		/* Function to apply to each row */
+  int			next,		/* Next row to filter */
+			last,		/* Last row to filter + 1 */
+			pending,	/* Rows not yet filtered */
+			shutdown;	/* Non-zero to stop the threads */
+};
 
 
 /*
  * Local functions...
  */
 
+static double	filter_bicubic(double x);
+static void	filter_col(cups_izoom_t *z, int y, cups_ib_t *in);
+static void	filter_free(cups_ifilter_t *f);
+static double	filter_lanczos(double x);
+static int	filter_new(cups_ifilter_t *f, int insize, int outsize,
+		           int flip, cups_iztype_t type);
+static void	filter_row(cups_izoom_t *z, int iy, cups_ib_t *in);
+static void	pool_delete(struct cups_izpool_s *pool);
+static void	pool_filter(cups_izoom_t *z, zoom_func_t func, int first,
+		            int last);
+static struct cups_izpool_s *pool_new(cups_izoom_t *z);
+static void	pool_run(struct cups_izpool_s *pool, cups_ib_t *in);
+#ifdef HAVE_PTHREAD_H
+static void	*pool_worker(void *data);
+#endif /* HAVE_PTHREAD_H */
+static void	rotate_cols(cups_izoom_t *z, int strip, cups_ib_t *in);
+static void	zoom_batch(cups_izoom_t *z, int oy);
 static void	zoom_bilinear(cups_izoom_t *z, int iy);
+static cups_ib_t *zoom_col(cups_izoom_t *z, int iy);
+static void	zoom_filter(cups_izoom_t *z, int oy);
 static void	zoom_nearest(cups_izoom_t *z, int iy);
 
 
@@ -47,6 +138,12 @@ static void	zoom_nearest(cups_izoom_t *z, int iy);
 void
 _cupsImageZoomDelete(cups_izoom_t *z)	/* I - Zoom record to free */
 {
+  pool_delete(z->pool);
+  filter_free(&(z->xfilter));
+  filter_free(&(z->yfilter));
+  free(z->hrows);
+  free(z->out);
+  free(z->cols);
   free(z->rows[0]);
   free(z->rows[1]);
   free(z->in);
@@ -57,6 +154,11 @@ _cupsImageZoomDelete(cups_izoom_t *z)	/* I - Zoom record to free */
 /*
  * '_cupsImageZoomFill()' - Fill a zoom record with image data utilizing bilinear
  *                         interpolation.
+ *
+ * For CUPS_IZOOM_FAST and CUPS_IZOOM_NORMAL "iy" is an input row and the
+ * caller interpolates between z->rows[0] and z->rows[1].  For
+ * CUPS_IZOOM_BEST and CUPS_IZOOM_LANCZOS "iy" is an output row and
+ * z->rows[z->row] is the finished row.
  */
 
 void
@@ -69,6 +171,11 @@ _cupsImageZoomFill(cups_izoom_t *z,	/* I - Zoom record to fill */
         zoom_nearest(z, iy);
 	break;
 
+    case CUPS_IZOOM_BEST :
+    case CUPS_IZOOM_LANCZOS :
+        zoom_filter(z, iy);
+	break;
+
     default :
         zoom_bilinear(z, iy);
 	break;
@@ -94,6 +201,10 @@ _cupsImageZoomNew(
 {
   cups_izoom_t	*z;			/* New zoom record */
   int		flip;			/* Flip on X axis? */
+  int		xin,			/* Input columns to filter */
+		yin,			/* Input rows to filter */
+		y,			/* Looping var */
+		last;			/* Last output row of a batch */
 
 
   if (xsize > CUPS_IMAGE_MAX_WIDTH ||
@@ -195,7 +306,7 @@ _cupsImageZoomNew(
     return (NULL);
   }
 
-  if ((z->in = (cups_ib_t *)malloc(z->width * z->depth)) == NULL)
+  if ((z->in = (cups_ib_t *)calloc((z->width + 8) * z->depth + 4, 1)) == NULL)
   {
     free(z->rows[0]);
     free(z->rows[1]);
@@ -203,10 +314,736 @@ _cupsImageZoomNew(
     return (NULL);
   }
 
+  if (type == CUPS_IZOOM_BEST || type == CUPS_IZOOM_LANCZOS)
+  {
+   /*
+    * Only filter the part of the input area that is inside the image...
+    */
+
+    if (rotated)
+    {
+      xin = min((int)z->width, (int)img->ysize - (int)z->yorig);
+      yin = min((int)z->height, (int)z->xorig + 1);
+    }
+    else
+    {
+      xin = min((int)z->width, (int)img->xsize - (int)z->xorig);
+      yin = min((int)z->height, (int)img->ysize - (int)z->yorig);
+    }
+
+    if (xin < 1 || yin < 1 ||
+        filter_new(&(z->xfilter), xin, z->xsize, flip, type) ||
+        filter_new(&(z->yfilter), yin, z->ysize, 0, type))
+    {
+      _cupsImageZoomDelete(z);
+      return (NULL);
+    }
+
+   /*
+    * Find the most input rows that a batch of output rows needs; batches
+    * start wherever the rows are first asked for...
+    */
+
+    for (y = 0; y < (int)z->ysize; y ++)
+    {
+      last = min(y + CUPS_IZOOM_BATCH, (int)z->ysize) - 1;
+
+      if (z->yfilter.start[last] + z->yfilter.num[last] -
+              z->yfilter.start[y] > z->hmax)
+        z->hmax = z->yfilter.start[last] + z->yfilter.num[last] -
+	          z->yfilter.start[y];
+    }
+
+    z->hfirst = -1;
+    z->ofirst = -1;
+    z->simd   = _cupsImageGetSIMD() != CUPS_IMAGE_SIMD_NONE;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    z->num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* _SC_NPROCESSORS_ONLN */
+
+    if (z->num_threads < 1)
+      z->num_threads = 1;
+    else if (z->num_threads > CUPS_IZOOM_THREADS)
+      z->num_threads = CUPS_IZOOM_THREADS;
+
+    if ((z->hrows = (cups_ib_t *)malloc((size_t)z->hmax * z->xsize *
+                                        z->depth + 16)) == NULL ||
+        (z->out = (cups_ib_t *)malloc((size_t)CUPS_IZOOM_BATCH * z->xsize *
+	                              z->depth + 16)) == NULL)
+    {
+      _cupsImageZoomDelete(z);
+      return (NULL);
+    }
+  }
+
+  if (rotated)
+  {
+   /*
+    * Room for the image columns, padded like "in"...
+    */
+
+    if ((z->cols = (cups_ib_t *)calloc((size_t)(z->hmax ? z->hmax :
+                                                CUPS_IZOOM_STRIP) *
+                                       z->width * z->depth +
+				       8 * z->depth + 4, 1)) == NULL)
+    {
+      _cupsImageZoomDelete(z);
+      return (NULL);
+    }
+  }
+
   return (z);
 }
 
 
+/*
+ * 'filter_bicubic()' - Bicubic (Catmull-Rom) filter kernel.
+ */
+
+static double				/* O - Weight */
+filter_bicubic(double x)		/* I - Distance from center */
+{
+  x = fabs(x);
+
+  if (x < 1.0)
+    return ((1.5 * x - 2.5) * x * x + 1.0);
+  else if (x < 2.0)
+    return (((-0.5 * x + 2.5) * x - 4.0) * x + 2.0);
+  else
+    return (0.0);
+}
+
+
+/*
+ * 'filter_col()' - Vertically filter one output row.
+ *
+ * "y" is the output row in the batch; the rows it needs are in hrows.
+ */
+
+static void
+filter_col(cups_izoom_t *z,		/* I - Zoom record */
+           int          y,		/* I - Output row in batch */
+	   cups_ib_t    *in)		/* I - Input buffer (unused) */
+{
+  const cups_ib_t	*rows[2];	/* Input rows for a pair of taps */
+  const short		*w;		/* Weights */
+  cups_ib_t		*out;		/* Output row */
+  int			i,		/* Looping var */
+			k,		/* Current tap */
+			n,		/* Number of taps */
+			bytes,		/* Bytes per row */
+			sum;		/* Weighted sum */
+  const cups_ib_t	*first;		/* First input row */
+
+
+  (void)in;
+
+  bytes = z->xsize * z->depth;
+  out   = z->out + (size_t)y * bytes;
+  y     += z->ofirst;
+  n     = z->yfilter.num[y];
+  w     = z->yfilter.weights + (size_t)y * z->yfilter.taps;
+  first = z->hrows + (size_t)(z->yfilter.start[y] - z->hfirst) * bytes;
+  i     = 0;
+
+#ifdef __SSE2__
+  if (z->simd)
+  {
+    __m128i	zero = _mm_setzero_si128(),
+		round = _mm_set1_epi32(1 << (CUPS_IZOOM_PREC - 1));
+
+    for (; i + 16 <= bytes; i += 16)
+    {
+      __m128i	s0 = round,		/* Sums of bytes 0-3 */
+		s1 = round,		/* Sums of bytes 4-7 */
+		s2 = round,		/* Sums of bytes 8-11 */
+		s3 = round;		/* Sums of bytes 12-15 */
+
+      for (k = 0; k < n; k += 2)
+      {
+        __m128i	a, b, lo, hi, wk;
+
+        rows[0] = first + (size_t)k * bytes + i;
+	a       = _mm_loadu_si128((const __m128i *)rows[0]);
+
+	if (k + 1 < n)
+	{
+	  rows[1] = rows[0] + bytes;
+	  b       = _mm_loadu_si128((const __m128i *)rows[1]);
+	}
+	else
+	  b = zero;
+
+       /*
+        * Interleave the two rows and multiply each pair by its weights...
+	*/
+
+	wk = _mm_set1_epi32(WEIGHT_PAIR(w[k], w[k + 1]));
+	lo = _mm_unpacklo_epi8(a, zero);
+	hi = _mm_unpacklo_epi8(b, zero);
+	s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, hi), wk));
+	s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, hi), wk));
+	lo = _mm_unpackhi_epi8(a, zero);
+	hi = _mm_unpackhi_epi8(b, zero);
+	s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi16(lo, hi), wk));
+	s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi16(lo, hi), wk));
+      }
+
+      s0 = _mm_packs_epi32(_mm_srai_epi32(s0, CUPS_IZOOM_PREC),
+                           _mm_srai_epi32(s1, CUPS_IZOOM_PREC));
+      s2 = _mm_packs_epi32(_mm_srai_epi32(s2, CUPS_IZOOM_PREC),
+                           _mm_srai_epi32(s3, CUPS_IZOOM_PREC));
+      _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(s0, s2));
+    }
+  }
+#endif /* __SSE2__ */
+
+  for (; i < bytes; i ++)
+  {
+    for (k = 0, sum = 1 << (CUPS_IZOOM_PREC - 1); k < n; k ++)
+      sum += first[(size_t)k * bytes + i] * w[k];
+
+    sum >>= CUPS_IZOOM_PREC;
+
+    out[i] = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+  }
+}
+
+
+/*
+ * 'filter_free()' - Free the weights of a resampling filter.
+ */
+
+static void
+filter_free(cups_ifilter_t *f)		/* I - Filter */
+{
+  free(f->start);
+  free(f->num);
+  free(f->weights);
+}
+
+
+/*
+ * 'filter_lanczos()' - Lanczos-3 filter kernel.
+ */
+
+static double				/* O - Weight */
+filter_lanczos(double x)		/* I - Distance from center */
+{
+  if (x == 0.0)
+    return (1.0);
+  else if (x <= -3.0 || x >= 3.0)
+    return (0.0);
+
+  x *= M_PI;
+
+  return (3.0 * sin(x) * sin(x / 3.0) / (x * x));
+}
+
+
+/*
+ * 'filter_new()' - Compute the weights of a resampling filter.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+filter_new(cups_ifilter_t *f,		/* I - Filter */
+           int            insize,	/* I - Number of input pixels */
+	   int            outsize,	/* I - Number of output pixels */
+	   int            flip,		/* I - Mirror the output? */
+	   cups_iztype_t  type)		/* I - CUPS_IZOOM_BEST or _LANCZOS */
+{
+  double	(*kernel)(double),	/* Filter kernel */
+		support,		/* Radius of filter in input pixels */
+		scale,			/* Input pixels per output pixel */
+		fscale,			/* Filter scale */
+		center,			/* Center of output pixel in input */
+		total,			/* Sum of weights */
+		*wd;			/* Weights of one output pixel */
+  int		x,			/* Output pixel */
+		k,			/* Current tap */
+		kmax,			/* Tap with largest weight */
+		nmax,			/* Maximum number of taps */
+		xmin,			/* First input pixel */
+		n,			/* Number of input pixels */
+		sum;			/* Sum of fixed-point weights */
+  short		*w;			/* Fixed-point weights */
+
+
+  if (type == CUPS_IZOOM_LANCZOS)
+  {
+    kernel  = filter_lanczos;
+    support = 3.0;
+  }
+  else
+  {
+    kernel  = filter_bicubic;
+    support = 2.0;
+  }
+
+  scale   = (double)insize / outsize;
+  fscale  = scale > 1.0 ? scale : 1.0;
+  support *= fscale;
+  nmax    = (int)ceil(support) * 2 + 1;
+
+ /*
+  * Pad the weights to a multiple of 8 so that the SIMD kernels can always
+  * read a whole vector of them...
+  */
+
+  f->taps    = (nmax + 7) & ~7;
+  f->start   = (int *)calloc(outsize, sizeof(int));
+  f->num     = (int *)calloc(outsize, sizeof(int));
+  f->weights = (short *)calloc((size_t)outsize * f->taps, sizeof(short));
+
+  if (!f->start || !f->num || !f->weights ||
+      (wd = (double *)malloc(nmax * sizeof(double))) == NULL)
+    return (-1);
+
+  for (x = 0; x < outsize; x ++)
+  {
+    center = (x + 0.5) * scale;
+
+    if ((xmin = (int)(center - support + 0.5)) < 0)
+      xmin = 0;
+
+    if ((n = (int)(center + support + 0.5)) > insize)
+      n = insize;
+
+    n -= xmin;
+
+    if (n > nmax)
+      n = nmax;
+    else if (n < 1)
+    {
+      xmin = min(xmin, insize - 1);
+      n    = 1;
+    }
+
+    for (k = 0, total = 0.0; k < n; k ++)
+    {
+      wd[k] = (*kernel)((k + xmin - center + 0.5) / fscale);
+      total += wd[k];
+    }
+
+   /*
+    * Round the normalized weights and give the rounding error to the
+    * largest one...
+    */
+
+    w = f->weights + (size_t)(flip ? outsize - 1 - x : x) * f->taps;
+
+    for (k = 0, kmax = 0, sum = 0; k < n; k ++)
+    {
+      if (total != 0.0)
+        w[k] = (short)floor(wd[k] / total * (1 << CUPS_IZOOM_PREC) + 0.5);
+      else
+        w[k] = k ? 0 : 1 << CUPS_IZOOM_PREC;
+
+      sum += w[k];
+
+      if (w[k] > w[kmax])
+        kmax = k;
+    }
+
+    w[kmax] += (1 << CUPS_IZOOM_PREC) - sum;
+
+    f->start[flip ? outsize - 1 - x : x] = xmin;
+    f->num[flip ? outsize - 1 - x : x]   = n;
+  }
+
+  free(wd);
+
+  return (0);
+}
+
+
+/*
+ * 'filter_row()' - Horizontally filter one input row.
+ *
+ * "iy" is the input row relative to hfirst and "in" is a buffer for the
+ * unscaled row.
+ */
+
+static void
+filter_row(cups_izoom_t *z,		/* I - Zoom record */
+           int          iy,		/* I - Input row in hrows */
+	   cups_ib_t    *in)		/* I - Input buffer */
+{
+  const cups_ib_t	*p;		/* Input pixels */
+  const short		*w;		/* Weights */
+  cups_ib_t		*out;		/* Output row */
+  int			x,		/* Output pixel */
+			c,		/* Color channel */
+			k,		/* Current tap */
+			n,		/* Number of taps */
+			depth,		/* Bytes per pixel */
+			sum;		/* Weighted sum */
+
+
+  depth = z->depth;
+  out   = z->hrows + (size_t)iy * z->xsize * depth;
+  iy    += z->hfirst;
+
+  if (z->rotated)
+    in = z->cols + (size_t)(z->xorig - iy - z->colx) * z->width * depth;
+  else
+    cupsImageGetRow(z->img, z->xorig, z->yorig + iy, z->width, in);
+
+  for (x = 0; x < (int)z->xsize; x ++, out += depth)
+  {
+    p = in + z->xfilter.start[x] * depth;
+    w = z->xfilter.weights + (size_t)x * z->xfilter.taps;
+    n = z->xfilter.num[x];
+
+#ifdef __SSE2__
+    if (z->simd && depth == 1)
+    {
+     /*
+      * Gray: 8 taps at a time; the zero weights past "n" cover the padding
+      * at the end of the row.
+      */
+
+      __m128i	zero = _mm_setzero_si128(),
+		s = zero;
+
+      for (k = 0; k < n; k += 8)
+        s = _mm_add_epi32(s, _mm_madd_epi16(
+	        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + k)),
+		                  zero),
+		_mm_loadu_si128((const __m128i *)(w + k))));
+
+      s   = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+      s   = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+      sum = (_mm_cvtsi128_si32(s) + (1 << (CUPS_IZOOM_PREC - 1))) >>
+            CUPS_IZOOM_PREC;
+
+      *out = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+      continue;
+    }
+    else if (z->simd && (depth == 3 || depth == 4))
+    {
+     /*
+      * RGB and CMYK: all channels of 2 taps at a time, reading 4 bytes per
+      * pixel...
+      */
+
+      __m128i	zero = _mm_setzero_si128(),
+		s = _mm_set1_epi32(1 << (CUPS_IZOOM_PREC - 1)),
+		p0, p1;
+      int	v;
+
+      for (k = 0; k < n; k += 2)
+      {
+        memcpy(&v, p + k * depth, 4);
+	p0 = _mm_cvtsi32_si128(v);
+        memcpy(&v, p + (k + 1) * depth, 4);
+	p1 = _mm_cvtsi32_si128(v);
+
+        s = _mm_add_epi32(s, _mm_madd_epi16(
+	        _mm_unpacklo_epi8(_mm_unpacklo_epi8(p0, p1), zero),
+		_mm_set1_epi32(WEIGHT_PAIR(w[k], w[k + 1]))));
+      }
+
+      s = _mm_srai_epi32(s, CUPS_IZOOM_PREC);
+      v = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(s, s), zero));
+
+      if (depth == 4)
+        memcpy(out, &v, 4);
+      else
+        memcpy(out, &v, 3);
+      continue;
+    }
+#endif /* __SSE2__ */
+
+    for (c = 0; c < depth; c ++)
+    {
+      for (k = 0, sum = 1 << (CUPS_IZOOM_PREC - 1); k < n; k ++)
+        sum += p[k * depth + c] * w[k];
+
+      sum >>= CUPS_IZOOM_PREC;
+
+      out[c] = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+    }
+  }
+}
+
+
+/*
+ * 'pool_delete()' - Stop and free filtering threads.
+ */
+
+static void
+pool_delete(struct cups_izpool_s *pool)	/* I - Filtering threads */
+{
+#ifdef HAVE_PTHREAD_H
+  int	i;				/* Looping var */
+#endif /* HAVE_PTHREAD_H */
+
+
+  if (!pool)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(pool->mutex));
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&(pool->work_cond));
+  pthread_mutex_unlock(&(pool->mutex));
+
+  for (i = 0; i < pool->num_threads - 1; i ++)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&(pool->work_cond));
+  pthread_cond_destroy(&(pool->done_cond));
+  pthread_mutex_destroy(&(pool->mutex));
+#endif /* HAVE_PTHREAD_H */
+
+  free(pool);
+}
+
+
+/*
+ * 'pool_filter()' - Filter rows using the filtering threads.
+ *
+ * The threads are started the first time they are needed.
+ */
+
+static void
+pool_filter(cups_izoom_t *z,		/* I - Zoom record */
+            zoom_func_t  func,		/* I - Function to apply to each row */
+	    int          first,		/* I - First row */
+	    int          last)		/* I - Last row + 1 */
+{
+  struct cups_izpool_s	*pool;		/* Filtering threads */
+
+
+  if (!z->pool && z->num_threads > 1 &&
+      (z->pool = pool_new(z)) == NULL)
+    z->num_threads = 1;
+
+  pool = z->pool;
+
+  if (!pool || pool->num_threads < 2 || last - first < 2)
+  {
+    for (; first < last; first ++)
+      (*func)(z, first, z->in);
+
+    return;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(pool->mutex));
+
+  pool->func    = func;
+  pool->next    = first;
+  pool->last    = last;
+  pool->pending = last - first;
+
+  pthread_cond_broadcast(&(pool->work_cond));
+
+  pool_run(pool, z->in);
+
+  while (pool->pending > 0)
+    pthread_cond_wait(&(pool->done_cond), &(pool->mutex));
+
+  pthread_mutex_unlock(&(pool->mutex));
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * 'pool_new()' - Start filtering threads.
+ */
+
+static struct cups_izpool_s *		/* O - Filtering threads or NULL */
+pool_new(cups_izoom_t *z)		/* I - Zoom record */
+{
+  struct cups_izpool_s	*pool;		/* Filtering threads */
+
+
+  if ((pool = (struct cups_izpool_s *)calloc(1, sizeof(struct cups_izpool_s))) ==
+          NULL)
+    return (NULL);
+
+  pool->z = z;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&(pool->mutex), NULL);
+  pthread_cond_init(&(pool->work_cond), NULL);
+  pthread_cond_init(&(pool->done_cond), NULL);
+
+  for (pool->num_threads = 1;
+       pool->num_threads < z->num_threads &&
+           pool->num_threads < CUPS_IZOOM_THREADS;
+       pool->num_threads ++)
+    if (pthread_create(pool->threads + pool->num_threads - 1, NULL,
+                       pool_worker, pool))
+      break;
+#else
+  pool->num_threads = 1;
+#endif /* HAVE_PTHREAD_H */
+
+  return (pool);
+}
+
+
+/*
+ * 'pool_run()' - Filter rows until none are left.
+ *
+ * Called and returns with the pool locked.
+ */
+
+static void
+pool_run(struct cups_izpool_s *pool,	/* I - Filtering threads */
+         cups_ib_t            *in)	/* I - Input buffer of this thread */
+{
+  int	item,				/* Row to filter */
+	count,				/* Number of rows taken */
+	i;				/* Looping var */
+
+
+  while (pool->next < pool->last)
+  {
+   /*
+    * Take a few rows at a time to keep the lock out of the way...
+    */
+
+    item       = pool->next;
+    count      = min(4, pool->last - item);
+    pool->next += count;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&(pool->mutex));
+#endif /* HAVE_PTHREAD_H */
+
+    for (i = 0; i < count; i ++)
+      (*pool->func)(pool->z, item + i, in);
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&(pool->mutex));
+
+    if ((pool->pending -= count) == 0)
+      pthread_cond_signal(&(pool->done_cond));
+#endif /* HAVE_PTHREAD_H */
+  }
+}
+
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * 'pool_worker()' - Filtering thread.
+ */
+
+static void *				/* O - Thread exit value */
+pool_worker(void *data)			/* I - Filtering threads */
+{
+  struct cups_izpool_s	*pool = (struct cups_izpool_s *)data;
+					/* Filtering threads */
+  cups_ib_t		*in;		/* Input buffer of this thread */
+
+
+  in = (cups_ib_t *)calloc((pool->z->width + 8) * pool->z->depth + 4, 1);
+
+  pthread_mutex_lock(&(pool->mutex));
+
+  while (!pool->shutdown)
+  {
+    if (in && pool->next < pool->last)
+      pool_run(pool, in);
+    else
+      pthread_cond_wait(&(pool->work_cond), &(pool->mutex));
+  }
+
+  pthread_mutex_unlock(&(pool->mutex));
+
+  free(in);
+
+  return (NULL);
+}
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * 'rotate_cols()' - Rotate a strip of image columns for the filters.
+ */
+
+static void
+rotate_cols(cups_izoom_t *z,		/* I - Zoom record */
+            int          strip,		/* I - Strip of columns in cols */
+	    cups_ib_t    *in)		/* I - Input buffer (unused) */
+{
+  int	x;				/* First column of strip */
+
+
+  (void)in;
+
+  x = z->colx + strip * CUPS_IZOOM_STRIP;
+
+  _cupsImageGetCols(z->img, x, z->yorig,
+                    min(CUPS_IZOOM_STRIP, z->colx + z->colcount - x),
+                    z->width,
+		    z->cols + (size_t)(x - z->colx) * z->width * z->depth);
+}
+
+
+/*
+ * 'zoom_batch()' - Filter a batch of output rows.
+ */
+
+static void
+zoom_batch(cups_izoom_t *z,		/* I - Zoom record */
+           int          oy)		/* I - First output row */
+{
+  int			last,		/* Last output row */
+			start,		/* First input row needed */
+			end,		/* Last input row needed + 1 */
+			keep,		/* Input rows already filtered */
+			bytes;		/* Bytes per row */
+
+
+  last  = min(oy + CUPS_IZOOM_BATCH, (int)z->ysize) - 1;
+  start = z->yfilter.start[oy];
+  end   = z->yfilter.start[last] + z->yfilter.num[last];
+  bytes = z->xsize * z->depth;
+
+ /*
+  * Keep the input rows that the previous batch already filtered...
+  */
+
+  if (z->hcount > 0 && start >= z->hfirst && start < z->hfirst + z->hcount)
+  {
+    keep = min(z->hfirst + z->hcount, end) - start;
+
+    if (start > z->hfirst)
+      memmove(z->hrows, z->hrows + (size_t)(start - z->hfirst) * bytes,
+              (size_t)keep * bytes);
+  }
+  else
+    keep = 0;
+
+  z->hfirst = start;
+  z->hcount = end - start;
+  z->ofirst = oy;
+  z->ocount = last - oy + 1;
+
+  if (z->rotated && keep < z->hcount)
+  {
+   /*
+    * Rotate the image columns of the new input rows...
+    */
+
+    z->colx     = z->xorig - (end - 1);
+    z->colcount = z->hcount - keep;
+
+    pool_filter(z, rotate_cols, 0,
+                (z->colcount + CUPS_IZOOM_STRIP - 1) / CUPS_IZOOM_STRIP);
+  }
+
+  pool_filter(z, filter_row, keep, z->hcount);
+  pool_filter(z, filter_col, 0, z->ocount);
+}
+
+
 /*
  * 'zoom_bilinear()' - Fill a zoom record with image data utilizing bilinear
  *                     interpolation.
@@ -217,6 +1054,7 @@ zoom_bilinear(cups_izoom_t *z,		/* I - Zoom record to fill */
               int          iy)		/* I - Zoom image row */
 {
   cups_ib_t	*r,			/* Row pointer */
+		*in,			/* Input row */
 		*inptr;			/* Pixel pointer */
   int		xerr0,			/* X error counter */
 		xerr1;			/* ... */
@@ -248,14 +1086,17 @@ zoom_bilinear(cups_izoom_t *z,		/* I - Zoom record to fill */
   z_inincr = z->inincr;
 
   if (z->rotated)
-    cupsImageGetCol(z->img, z->xorig - iy, z->yorig, z->width, z->in);
+    in = zoom_col(z, iy);
   else
+  {
     cupsImageGetRow(z->img, z->xorig, z->yorig + iy, z->width, z->in);
+    in = z->in;
+  }
 
   if (z_inincr < 0)
-    inptr = z->in + (z->width - 1) * z_depth;
+    inptr = in + (z->width - 1) * z_depth;
   else
-    inptr = z->in;
+    inptr = in;
 
   for (x = z_xsize, xerr0 = z_xsize, xerr1 = 0, ix = 0, r = z->rows[z->row];
        x > 0;
@@ -288,6 +1129,68 @@ zoom_bilinear(cups_izoom_t *z,		/* I - Zoom record to fill */
 }
 
 
+/*
+ * 'zoom_col()' - Get an input row of a rotated image.
+ *
+ * Rotated input rows run from right to left through the image, so the
+ * strip ends with the requested column.
+ */
+
+static cups_ib_t *			/* O - Input row */
+zoom_col(cups_izoom_t *z,		/* I - Zoom record */
+         int          iy)		/* I - Zoom image row */
+{
+  int	x;				/* Image column */
+
+
+  x = z->xorig - iy;
+
+  if (x < 0)
+    x = 0;
+  else if (x >= (int)z->img->xsize)
+    x = z->img->xsize - 1;
+
+  if (x < z->colx || x >= z->colx + z->colcount)
+  {
+    z->colx     = max(x - CUPS_IZOOM_STRIP + 1, 0);
+    z->colcount = x - z->colx + 1;
+
+    _cupsImageGetCols(z->img, z->colx, z->yorig, z->colcount, z->width,
+                      z->cols);
+  }
+
+  return (z->cols + (size_t)(x - z->colx) * z->width * z->depth);
+}
+
+
+/*
+ * 'zoom_filter()' - Fill a zoom record with bicubic or Lanczos filtered image
+ *                   data.
+ */
+
+static void
+zoom_filter(cups_izoom_t *z,		/* I - Zoom record to fill */
+            int          oy)		/* I - Output row */
+{
+  int	bytes;				/* Bytes per row */
+
+
+  if (oy < 0)
+    oy = 0;
+  else if (oy >= (int)z->ysize)
+    oy = z->ysize - 1;
+
+  if (oy < z->ofirst || oy >= z->ofirst + z->ocount)
+    zoom_batch(z, oy);
+
+  z->row ^= 1;
+
+  bytes = z->xsize * z->depth;
+
+  memcpy(z->rows[z->row], z->out + (size_t)(oy - z->ofirst) * bytes, bytes);
+}
+
+
 /*
  * 'zoom_nearest()' - Fill a zoom record quickly using nearest-neighbor
  *                    sampling.
@@ -298,6 +1201,7 @@ zoom_nearest(cups_izoom_t *z,		/* I - Zoom record to fill */
              int          iy)		/* I - Zoom image row */
 {
   cups_ib_t	*r,			/* Row pointer */
+		*in,			/* Input row */
 		*inptr;			/* Pixel pointer */
   int		xerr0;			/* X error counter */
   int		ix,
@@ -326,14 +1230,17 @@ zoom_nearest(cups_izoom_t *z,		/* I - Zoom record to fill */
   z_inincr = z->inincr;
 
   if (z->rotated)
-    cupsImageGetCol(z->img, z->xorig - iy, z->yorig, z->width, z->in);
+    in = zoom_col(z, iy);
   else
+  {
     cupsImageGetRow(z->img, z->xorig, z->yorig + iy, z->width, z->in);
+    in = z->in;
+  }
 
   if (z_inincr < 0)
-    inptr = z->in + (z->width - 1) * z_depth;
+    inptr = in + (z->width - 1) * z_depth;
   else
-    inptr = z->in;
+    inptr = in;
 
   for (x = z_xsize, xerr0 = z_xsize, ix = 0, r = z->rows[z->row];
        x > 0;
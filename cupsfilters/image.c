@@ -18,6 +18,8 @@
  *
  *   cupsImageClose()         - Close an image file.
  *   cupsImageGetCol()        - Get a column of pixels from an image.
+ *   _cupsImageGetCols()      - Get a block of columns of pixels from an
+ *                              image.
  *   cupsImageGetColorSpace() - Get the image colorspace.
  *   cupsImageGetDepth()      - Get the number of bytes per pixel.
  *   cupsImageGetHeight()     - Get the height of an image.
@@ -26,11 +28,21 @@
  *   cupsImageGetXPPI()       - Get the horizontal resolution of an image.
  *   cupsImageGetYPPI()       - Get the vertical resolution of an image.
  *   cupsImageOpen()          - Open an image file and read it into memory.
+ *   _cupsImageOpenScaled()   - Open an image file, decoding it at a reduced
+ *                              size when the reader supports it.
  *   _cupsImagePutCol()       - Put a column of pixels to an image.
  *   _cupsImagePutRow()       - Put a row of pixels to an image.
  *   cupsImageSetMaxTiles()   - Set the maximum number of tiles to cache.
- *   flush_tile()             - Flush the least-recently-used tile in the cache.
+ *   decode_tiles()           - Decode a row of tiles of a lazily read image.
+ *   flush_tile()             - Flush the least-recently-used tile in a shard.
  *   get_tile()               - Get a cached tile.
+ *   init_tiles()             - Create the tile array of an image.
+ *   open_cache()             - Create and map the tile swap file.
+ *   prefetch_tiles()         - Prefetch the next row of swapped tiles.
+ *   release_tile()           - Release a tile returned by get_tile().
+ *   set_tile_size()          - Choose the tile geometry of an image.
+ *   transpose_block()        - Copy a block of pixels, swapping rows and
+ *                              columns.
  */
 
 /*
@@ -38,14 +50,27 @@
  */
 
 #include "image-private.h"
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
 
 
 /*
  * Local functions...
  */
 
-static void		flush_tile(cups_image_t *img);
-static cups_ib_t	*get_tile(cups_image_t *img, int x, int y);
+static void		decode_tiles(cups_image_t *img, int tiley);
+static void		flush_tile(cups_image_t *img, cups_ishard_t *shard);
+static cups_ib_t	*get_tile(cups_image_t *img, int x, int y,
+			          cups_ishard_t **shard);
+static int		init_tiles(cups_image_t *img);
+static int		open_cache(cups_image_t *img);
+static void		prefetch_tiles(cups_image_t *img, int tiley);
+static void		release_tile(cups_ishard_t *shard);
+static void		set_tile_size(cups_image_t *img);
+static void		transpose_block(const cups_ib_t *src, int srcpitch,
+			                cups_ib_t *dst, int dstpitch,
+					int width, int height, int bpp);
 
 
 /*
@@ -55,14 +80,61 @@ static cups_ib_t	*get_tile(cups_image_t *img, int x, int y);
 void
 cupsImageClose(cups_image_t *img)	/* I - Image to close */
 {
+  int		i;			/* Looping var */
   cups_ic_t	*current,		/* Current cached tile */
 		*next;			/* Next cached tile */
+  unsigned long	hits,			/* Tile lookups served from memory */
+		misses,			/* Tile lookups that were not */
+		evictions;		/* Tiles written to the swap file */
+  int		decoded;		/* Tile rows decoded on demand */
 
 
+ /*
+  * Close the image file of a lazily read image...
+  */
+
+  if (img->decode_done)
+    (img->decode_done)(img);
+
+  if (img->decoded)
+  {
+    for (i = 0, decoded = 0; i < img->ytiles; i ++)
+      decoded += img->decoded[i];
+
+    fprintf(stderr, "DEBUG: Decoded %d of %d image tile rows\n", decoded,
+            img->ytiles);
+
+    free(img->decoded);
+  }
+
+ /*
+  * Report the tile cache statistics...
+  */
+
+  if (img->tiles != NULL)
+  {
+    for (i = 0, hits = 0, misses = 0, evictions = 0; i < CUPS_TILE_SHARDS; i ++)
+    {
+      hits      += img->shards[i].hits;
+      misses    += img->shards[i].misses;
+      evictions += img->shards[i].evictions;
+    }
+
+    fprintf(stderr, "DEBUG: Image tile cache: %lu hits, %lu misses, "
+                    "%lu evictions, swap file %s\n", hits, misses, evictions,
+	    img->cachemap ? "mapped" :
+	        img->cachefile >= 0 ? "not mapped" : "not used");
+  }
+
  /*
   * Wipe the tile cache file (if any)...
   */
 
+#ifdef HAVE_SYS_MMAN_H
+  if (img->cachemap != NULL)
+    munmap(img->cachemap, img->cachesize);
+#endif /* HAVE_SYS_MMAN_H */
+
   if (img->cachefile >= 0)
   {
     DEBUG_printf(("Closing/removing swap file \"%s\"...\n", img->cachename));
@@ -77,14 +149,28 @@ cupsImageClose(cups_image_t *img)	/* I - Image to close */
 
   DEBUG_puts("Freeing memory...");
 
-  for (current = img->first, next = NULL; current != NULL; current = next)
+  for (i = 0; i < CUPS_TILE_SHARDS; i ++)
   {
-    DEBUG_printf(("Freeing cache (%p, next = %p)...\n", current, next));
+    for (current = img->shards[i].first, next = NULL;
+         current != NULL;
+	 current = next)
+    {
+      DEBUG_printf(("Freeing cache (%p, next = %p)...\n", current, next));
+
+      next = current->next;
+      free(current);
+    }
 
-    next = current->next;
-    free(current);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&(img->shards[i].mutex));
+#endif /* HAVE_PTHREAD_H */
   }
 
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&(img->mutex));
+  pthread_mutex_destroy(&(img->decode_mutex));
+#endif /* HAVE_PTHREAD_H */
+
  /*
   * Free the rest of memory...
   */
@@ -119,6 +205,7 @@ cupsImageGetCol(cups_image_t *img,	/* I - Image */
 			twidth,		/* Tile width */
 			count;		/* Number of pixels to get */
   const cups_ib_t	*ib;		/* Pointer into tile */
+  cups_ishard_t		*shard;		/* Cache shard holding the tile */
 
 
   if (img == NULL || x < 0 || x >= img->xsize || y >= img->ysize)
@@ -136,17 +223,22 @@ cupsImageGetCol(cups_image_t *img,	/* I - Image */
   if (height < 1)
     return (-1);
 
+  if (img->tiles == NULL && init_tiles(img))
+    return (-1);
+
   bpp    = cupsImageGetDepth(img);
-  twidth = bpp * (CUPS_TILE_SIZE - 1);
+  twidth = bpp * (img->tilew - 1);
 
   while (height > 0)
   {
-    ib = get_tile(img, x, y);
+    decode_tiles(img, y / img->tileh);
+
+    ib = get_tile(img, x, y, &shard);
 
     if (ib == NULL)
       return (-1);
 
-    count = CUPS_TILE_SIZE - (y & (CUPS_TILE_SIZE - 1));
+    count = img->tileh - y % img->tileh;
     if (count > height)
       count = height;
 
@@ -165,6 +257,87 @@ cupsImageGetCol(cups_image_t *img,	/* I - Image */
             *pixels++ = *ib++;
             break;
       }
+
+    release_tile(shard);
+  }
+
+  return (0);
+}
+
+
+/*
+ * '_cupsImageGetCols()' - Get a block of columns of pixels from an image.
+ *
+ * Column x + i is stored at pixels + i * height * bpp, so each column is
+ * contiguous just like the result of cupsImageGetCol().  The columns are
+ * rotated out of one tile at a time, which touches each tile once instead
+ * of once per column.
+ */
+
+int					/* O - -1 on error, 0 on success */
+_cupsImageGetCols(cups_image_t *img,	/* I - Image */
+                  int          x,	/* I - First column */
+		  int          y,	/* I - Start row */
+		  int          width,	/* I - Number of columns */
+		  int          height,	/* I - Column height */
+		  cups_ib_t    *pixels)	/* O - Pixel data */
+{
+  int			bpp,		/* Bytes per pixel */
+			pitch,		/* Bytes per column in pixels */
+			tx,		/* Current column */
+			ty,		/* Current row */
+			cols,		/* Number of columns in tile */
+			rows;		/* Number of rows in tile */
+  const cups_ib_t	*ib;		/* Pointer into tile */
+  cups_ishard_t		*shard;		/* Cache shard holding the tile */
+
+
+  if (img == NULL || x < 0 || x + width > img->xsize || y >= img->ysize ||
+      width < 1)
+    return (-1);
+
+  bpp   = cupsImageGetDepth(img);
+  pitch = height * bpp;
+
+  if (y < 0)
+  {
+    pixels -= y * bpp;
+    height += y;
+    y      = 0;
+  }
+
+  if ((y + height) > img->ysize)
+    height = img->ysize - y;
+
+  if (height < 1)
+    return (-1);
+
+  if (img->tiles == NULL && init_tiles(img))
+    return (-1);
+
+  for (ty = y; ty < y + height; ty += rows)
+  {
+    rows = img->tileh - ty % img->tileh;
+    if (rows > y + height - ty)
+      rows = y + height - ty;
+
+    decode_tiles(img, ty / img->tileh);
+
+    for (tx = x; tx < x + width; tx += cols)
+    {
+      cols = img->tilew - tx % img->tilew;
+      if (cols > x + width - tx)
+        cols = x + width - tx;
+
+      if ((ib = get_tile(img, tx, ty, &shard)) == NULL)
+        return (-1);
+
+      transpose_block(ib, img->tilew * bpp,
+                      pixels + (size_t)(tx - x) * pitch + (ty - y) * bpp,
+		      pitch, cols, rows, bpp);
+
+      release_tile(shard);
+    }
   }
 
   return (0);
@@ -219,6 +392,7 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
   int			bpp,		/* Bytes per pixel */
 			count;		/* Number of pixels to get */
   const cups_ib_t	*ib;		/* Pointer to pixels */
+  cups_ishard_t		*shard;		/* Cache shard holding the tile */
 
 
   if (img == NULL || y < 0 || y >= img->ysize || x >= img->xsize)
@@ -236,19 +410,27 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
   if (width < 1)
     return (-1);
 
+  if (img->tiles == NULL && init_tiles(img))
+    return (-1);
+
   bpp = img->colorspace < 0 ? -img->colorspace : img->colorspace;
 
+  decode_tiles(img, y / img->tileh);
+
+  prefetch_tiles(img, y / img->tileh);
+
   while (width > 0)
   {
-    ib = get_tile(img, x, y);
+    ib = get_tile(img, x, y, &shard);
 
     if (ib == NULL)
       return (-1);
 
-    count = CUPS_TILE_SIZE - (x & (CUPS_TILE_SIZE - 1));
+    count = img->tilew - x % img->tilew;
     if (count > width)
       count = width;
     memcpy(pixels, ib, count * bpp);
+    release_tile(shard);
     pixels += count * bpp;
     x      += count;
     width  -= count;
@@ -303,17 +485,47 @@ cupsImageOpen(
     int             saturation,		/* I - Color saturation level */
     int             hue,		/* I - Color hue adjustment */
     const cups_ib_t *lut)		/* I - RGB gamma/brightness LUT */
+{
+  return (_cupsImageOpenScaled(filename, primary, secondary, saturation, hue,
+                               lut, 0, 0));
+}
+
+
+/*
+ * '_cupsImageOpenScaled()' - Open an image file, decoding it at a reduced
+ *                            size when the reader supports it.
+ *
+ * "xhint" and "yhint" give the largest size in pixels that the image will be
+ * printed at.  Readers that can decode a smaller image cheaply (JPEG) pick
+ * the smallest size that still fills that box in either orientation and
+ * scale the image resolution to match, so the printed size does not change.
+ * Pass 0 for both to always decode the full image.
+ */
+
+cups_image_t *				/* O - New image */
+_cupsImageOpenScaled(
+    const char      *filename,		/* I - Filename of image */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut,		/* I - RGB gamma/brightness LUT */
+    int             xhint,		/* I - Printed width in pixels or 0 */
+    int             yhint)		/* I - Printed height in pixels or 0 */
 {
   FILE		*fp;			/* File pointer */
   unsigned char	header[16],		/* First 16 bytes of file */
 		header2[16];		/* Bytes 2048-2064 (PhotoCD) */
   cups_image_t	*img;			/* New image buffer */
   int		status;			/* Status of load... */
+#ifdef HAVE_PTHREAD_H
+  int		i;			/* Looping var */
+#endif /* HAVE_PTHREAD_H */
 
 
-  DEBUG_printf(("cupsImageOpen(\"%s\", %d, %d, %d, %d, %p)\n",
+  DEBUG_printf(("_cupsImageOpenScaled(\"%s\", %d, %d, %d, %d, %p, %d, %d)\n",
         	filename ? filename : "(null)", primary, secondary,
-		saturation, hue, lut));
+		saturation, hue, lut, xhint, yhint));
 
  /*
   * Figure out the file type...
@@ -354,6 +566,19 @@ cupsImageOpen(
   img->xppi      = 128;
   img->yppi      = 128;
 
+  if (xhint > 0 && yhint > 0)
+  {
+    img->xhint = xhint;
+    img->yhint = yhint;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&(img->mutex), NULL);
+  pthread_mutex_init(&(img->decode_mutex), NULL);
+  for (i = 0; i < CUPS_TILE_SHARDS; i ++)
+    pthread_mutex_init(&(img->shards[i].mutex), NULL);
+#endif /* HAVE_PTHREAD_H */
+
   if (!memcmp(header, "GIF87a", 6) || !memcmp(header, "GIF89a", 6))
     status = _cupsImageReadGIF(img, fp, primary, secondary, saturation, hue,
                                lut);
@@ -400,9 +625,21 @@ cupsImageOpen(
     status = -1;
   }
 
+  if (!status && img->decode)
+  {
+   /*
+    * The reader decodes rows on demand; create the tiles now so that threads
+    * reading the image do not race to do it...
+    */
+
+    if (init_tiles(img) ||
+        (img->decoded = calloc(img->ytiles, 1)) == NULL)
+      status = -1;
+  }
+
   if (status)
   {
-    free(img);
+    cupsImageClose(img);
     return (NULL);
   }
   else
@@ -428,6 +665,7 @@ _cupsImagePutCol(
   int		tilex,			/* Column within tile */
 		tiley;			/* Row within tile */
   cups_ib_t	*ib;			/* Pointer to pixels in tile */
+  cups_ishard_t	*shard;			/* Cache shard holding the tile */
 
 
   if (img == NULL || x < 0 || x >= img->xsize || y >= img->ysize)
@@ -445,14 +683,17 @@ _cupsImagePutCol(
   if (height < 1)
     return (-1);
 
+  if (img->tiles == NULL && init_tiles(img))
+    return (-1);
+
   bpp    = cupsImageGetDepth(img);
-  twidth = bpp * (CUPS_TILE_SIZE - 1);
-  tilex  = x / CUPS_TILE_SIZE;
-  tiley  = y / CUPS_TILE_SIZE;
+  twidth = bpp * (img->tilew - 1);
+  tilex  = x / img->tilew;
+  tiley  = y / img->tileh;
 
   while (height > 0)
   {
-    ib = get_tile(img, x, y);
+    ib = get_tile(img, x, y, &shard);
 
     if (ib == NULL)
       return (-1);
@@ -460,7 +701,7 @@ _cupsImagePutCol(
     img->tiles[tiley][tilex].dirty = 1;
     tiley ++;
 
-    count = CUPS_TILE_SIZE - (y & (CUPS_TILE_SIZE - 1));
+    count = img->tileh - y % img->tileh;
     if (count > height)
       count = height;
 
@@ -479,6 +720,8 @@ _cupsImagePutCol(
             *ib++ = *pixels++;
             break;
       }
+
+    release_tile(shard);
   }
 
   return (0);
@@ -502,6 +745,7 @@ _cupsImagePutRow(
   int		tilex,			/* Column within tile */
 		tiley;			/* Row within tile */
   cups_ib_t	*ib;			/* Pointer to pixels in tile */
+  cups_ishard_t	*shard;			/* Cache shard holding the tile */
 
 
   if (img == NULL || y < 0 || y >= img->ysize || x >= img->xsize)
@@ -519,23 +763,27 @@ _cupsImagePutRow(
   if (width < 1)
     return (-1);
 
+  if (img->tiles == NULL && init_tiles(img))
+    return (-1);
+
   bpp   = img->colorspace < 0 ? -img->colorspace : img->colorspace;
-  tilex = x / CUPS_TILE_SIZE;
-  tiley = y / CUPS_TILE_SIZE;
+  tilex = x / img->tilew;
+  tiley = y / img->tileh;
 
   while (width > 0)
   {
-    ib = get_tile(img, x, y);
+    ib = get_tile(img, x, y, &shard);
 
     if (ib == NULL)
       return (-1);
 
     img->tiles[tiley][tilex].dirty = 1;
 
-    count = CUPS_TILE_SIZE - (x & (CUPS_TILE_SIZE - 1));
+    count = img->tilew - x % img->tilew;
     if (count > width)
       count = width;
     memcpy(ib, pixels, count * bpp);
+    release_tile(shard);
     pixels += count * bpp;
     x      += count;
     width  -= count;
@@ -551,6 +799,8 @@ _cupsImagePutRow(
  *
  * If the "max_tiles" argument is 0 then the maximum number of tiles is
  * computed from the image size or the RIP_CACHE environment variable.
+ * This limits the tiles copied into memory; when the swap file can be
+ * mapped, the tiles beyond it are paged in and out by the kernel.
  */
 
 void
@@ -565,16 +815,15 @@ cupsImageSetMaxTiles(
 	cache_units[255];		/* Cache size units */
 
 
-  min_tiles = max(CUPS_TILE_MINIMUM,
-                  1 + max((img->xsize + CUPS_TILE_SIZE - 1) / CUPS_TILE_SIZE,
-                          (img->ysize + CUPS_TILE_SIZE - 1) / CUPS_TILE_SIZE));
+  if (img->tiles == NULL)
+    set_tile_size(img);
+
+  min_tiles = max(CUPS_TILE_MINIMUM, 1 + max(img->xtiles, img->ytiles));
 
   if (max_tiles == 0)
-    max_tiles = ((img->xsize + CUPS_TILE_SIZE - 1) / CUPS_TILE_SIZE) *
-                ((img->ysize + CUPS_TILE_SIZE - 1) / CUPS_TILE_SIZE);
+    max_tiles = img->xtiles * img->ytiles;
 
-  cache_size = max_tiles * CUPS_TILE_SIZE * CUPS_TILE_SIZE *
-               cupsImageGetDepth(img);
+  cache_size = max_tiles * img->tilew * img->tileh * cupsImageGetDepth(img);
 
   if ((cache_env = getenv("RIP_MAX_CACHE")) != NULL)
   {
@@ -584,7 +833,7 @@ cupsImageSetMaxTiles(
           max_size = 32 * 1024 * 1024;
 	  break;
       case 1 :
-          max_size *= 4 * CUPS_TILE_SIZE * CUPS_TILE_SIZE;
+          max_size *= 4 * img->tilew * img->tileh;
 	  break;
       case 2 :
           if (tolower(cache_units[0] & 255) == 'g')
@@ -594,7 +843,7 @@ cupsImageSetMaxTiles(
 	  else if (tolower(cache_units[0] & 255) == 'k')
 	    max_size *= 1024;
 	  else if (tolower(cache_units[0] & 255) == 't')
-	    max_size *= 4 * CUPS_TILE_SIZE * CUPS_TILE_SIZE;
+	    max_size *= 4 * img->tilew * img->tileh;
 	  break;
     }
   }
@@ -602,8 +851,7 @@ cupsImageSetMaxTiles(
     max_size = 32 * 1024 * 1024;
 
   if (cache_size > max_size)
-    max_tiles = max_size / CUPS_TILE_SIZE / CUPS_TILE_SIZE /
-                cupsImageGetDepth(img);
+    max_tiles = max_size / img->tilew / img->tileh / cupsImageGetDepth(img);
 
   if (max_tiles < min_tiles)
     max_tiles = min_tiles;
@@ -615,18 +863,74 @@ cupsImageSetMaxTiles(
 
 
 /*
- * 'flush_tile()' - Flush the least-recently-used tile in the cache.
+ * 'decode_tiles()' - Decode a row of tiles of a lazily read image.
+ *
+ * Readers that can seek to any row of the file set img->decode instead of
+ * loading the whole image, and each row of tiles is then decoded the first
+ * time one of its pixels is read.  The decoder has its own lock, which is
+ * never taken while a tile is held, so it can store the rows with
+ * _cupsImagePutRow().
+ *
+ * A decoder that fails (a short or unreadable file) stores the rows it
+ * could read first.  The failure is logged and the tile row is still
+ * marked as decoded, so the missing rows read as unwritten (zero) pixels
+ * rather than retrying the file on every lookup.
  */
 
 static void
-flush_tile(cups_image_t *img)		/* I - Image */
+decode_tiles(cups_image_t *img,		/* I - Image */
+             int          tiley)	/* I - Tile row */
+{
+  int	y,				/* First row to decode */
+	height;				/* Number of rows to decode */
+
+
+  if (img->decode == NULL)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(img->decode_mutex));
+#endif /* HAVE_PTHREAD_H */
+
+  if (!img->decoded[tiley])
+  {
+    DEBUG_printf(("Decoding tile row %d...\n", tiley));
+
+    img->decoded[tiley] = 1;
+
+    y      = tiley * img->tileh;
+    height = min(img->tileh, (int)img->ysize - y);
+
+    if ((img->decode)(img, y, height))
+      fprintf(stderr, "DEBUG: Unable to decode image rows %d to %d!\n", y,
+              y + height - 1);
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(img->decode_mutex));
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * 'flush_tile()' - Flush the least-recently-used tile in a shard.
+ *
+ * The shard must be locked by the caller.  Each tile has a fixed slot in
+ * the swap file, so shards can write their tiles concurrently.
+ */
+
+static void
+flush_tile(cups_image_t  *img,		/* I - Image */
+           cups_ishard_t *shard)	/* I - Cache shard */
 {
   int		bpp;			/* Bytes per pixel */
+  size_t	bytes;			/* Bytes per tile */
   cups_itile_t	*tile;			/* Pointer to tile */
 
 
-  bpp  = cupsImageGetDepth(img);
-  tile = img->first->tile;
+  bpp   = cupsImageGetDepth(img);
+  bytes = bpp * img->tilew * img->tileh;
+  tile  = shard->first->tile;
 
   if (!tile->dirty)
   {
@@ -634,39 +938,21 @@ flush_tile(cups_image_t *img)		/* I - Image */
     return;
   }
 
-  if (img->cachefile < 0)
+  if (open_cache(img))
   {
-    if ((img->cachefile = cupsTempFd(img->cachename,
-                                     sizeof(img->cachename))) < 0)
-    {
-      tile->ic    = NULL;
-      tile->dirty = 0;
-      return;
-    }
-
-    DEBUG_printf(("Created swap file \"%s\"...\n", img->cachename));
+    tile->ic    = NULL;
+    tile->dirty = 0;
+    return;
   }
 
-  if (tile->pos >= 0)
-  {
-    if (lseek(img->cachefile, tile->pos, SEEK_SET) != tile->pos)
-    {
-      tile->ic    = NULL;
-      tile->dirty = 0;
-      return;
-    }
-  }
-  else
-  {
-    if ((tile->pos = lseek(img->cachefile, 0, SEEK_END)) < 0)
-    {
-      tile->ic    = NULL;
-      tile->dirty = 0;
-      return;
-    }
-  }
+  shard->evictions ++;
+
+  tile->pos = (off_t)(tile - img->tiles[0]) * bytes;
 
-  write(img->cachefile, tile->ic->pixels, bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE);
+  if (img->cachemap != NULL)
+    memcpy(img->cachemap + tile->pos, tile->ic->pixels, bytes);
+  else if (pwrite(img->cachefile, tile->ic->pixels, bytes, tile->pos) != bytes)
+    tile->pos = -1;
 
   tile->ic    = NULL;
   tile->dirty = 0;
@@ -675,78 +961,115 @@ flush_tile(cups_image_t *img)		/* I - Image */
 
 /*
  * 'get_tile()' - Get a cached tile.
+ *
+ * On success the shard holding the tile is returned locked, and the caller
+ * must call release_tile() once it is done with the pixels.
+ *
+ * Once a shard holds its share of the cache and the swap file is mapped,
+ * the tiles it has not loaded are used in place in the mapping.  These
+ * tiles are outside the cache size limit (RIP_MAX_CACHE); the kernel keeps
+ * as many of them in memory as it can spare.
  */
 
 static cups_ib_t *			/* O - Pointer to tile or NULL */
-get_tile(cups_image_t *img,		/* I - Image */
-         int          x,		/* I - Column in image */
-         int          y)		/* I - Row in image */
+get_tile(cups_image_t  *img,		/* I - Image */
+         int           x,		/* I - Column in image */
+         int           y,		/* I - Row in image */
+	 cups_ishard_t **shard)		/* O - Locked cache shard */
 {
   int		bpp,			/* Bytes per pixel */
 		tilex,			/* Column within tile */
-		tiley,			/* Row within tile */
-		xtiles,			/* Number of tiles horizontally */
-		ytiles;			/* Number of tiles vertically */
+		tiley;			/* Row within tile */
+  size_t	bytes;			/* Bytes per tile */
+  unsigned	max_ics;		/* Maximum number of tiles in shard */
   cups_ic_t	*ic;			/* Cache pointer */
   cups_itile_t	*tile;			/* Tile pointer */
+  cups_ishard_t	*sh;			/* Cache shard */
 
 
-  if (img->tiles == NULL)
-  {
-    xtiles = (img->xsize + CUPS_TILE_SIZE - 1) / CUPS_TILE_SIZE;
-    ytiles = (img->ysize + CUPS_TILE_SIZE - 1) / CUPS_TILE_SIZE;
+  if (img->tiles == NULL && init_tiles(img))
+    return (NULL);
+
+  bpp   = cupsImageGetDepth(img);
+  bytes = bpp * img->tilew * img->tileh;
+  tilex = x / img->tilew;
+  tiley = y / img->tileh;
+  tile  = img->tiles[tiley] + tilex;
+  x     %= img->tilew;
+  y     %= img->tileh;
+
+ /*
+  * Neighboring tiles in both directions go to different shards, so that
+  * threads reading different rows or columns rarely wait for each other...
+  */
 
-    DEBUG_printf(("Creating tile array (%dx%d)\n", xtiles, ytiles));
+  sh      = img->shards + (tilex + tiley) % CUPS_TILE_SHARDS;
+  max_ics = (img->max_ics + CUPS_TILE_SHARDS - 1) / CUPS_TILE_SHARDS;
 
-    if ((img->tiles = calloc(sizeof(cups_itile_t *), ytiles)) == NULL)
-      return (NULL);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(sh->mutex));
+#endif /* HAVE_PTHREAD_H */
 
-    if ((tile = calloc(xtiles * sizeof(cups_itile_t), ytiles)) == NULL)
-      return (NULL);
+  if ((ic = tile->ic) == NULL && !sh->mapped && sh->num_ics >= max_ics &&
+      !open_cache(img))
+    sh->mapped = img->cachemap != NULL;
 
-    for (tiley = 0; tiley < ytiles; tiley ++)
+  if (ic != NULL)
+    sh->hits ++;
+  else if (sh->mapped)
+  {
+   /*
+    * The cache is full and the swap file is mapped, so use the tile in
+    * place and let the kernel page it in and out.  Only the first use of
+    * such a tile counts as a miss...
+    */
+
+    if (tile->mapped)
+      sh->hits ++;
+    else
     {
-      img->tiles[tiley] = tile;
-      for (tilex = xtiles; tilex > 0; tilex --, tile ++)
-        tile->pos = -1;
+      sh->misses ++;
+
+      tile->pos    = (off_t)(tile - img->tiles[0]) * bytes;
+      tile->mapped = 1;
     }
-  }
 
-  bpp   = cupsImageGetDepth(img);
-  tilex = x / CUPS_TILE_SIZE;
-  tiley = y / CUPS_TILE_SIZE;
-  tile  = img->tiles[tiley] + tilex;
-  x     &= (CUPS_TILE_SIZE - 1);
-  y     &= (CUPS_TILE_SIZE - 1);
+    *shard = sh;
 
-  if ((ic = tile->ic) == NULL)
+    return (img->cachemap + tile->pos + bpp * (y * img->tilew + x));
+  }
+  else
   {
-    if (img->num_ics < img->max_ics)
+    sh->misses ++;
+
+    if (sh->num_ics < max_ics)
     {
-      if ((ic = calloc(sizeof(cups_ic_t) +
-                       bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE, 1)) == NULL)
+      if ((ic = calloc(sizeof(cups_ic_t) + bytes, 1)) == NULL)
       {
-        if (img->num_ics == 0)
+        if (sh->num_ics == 0)
+	{
+	  release_tile(sh);
 	  return (NULL);
+	}
 
-        flush_tile(img);
-	ic = img->first;
+        flush_tile(img, sh);
+	ic = sh->first;
       }
       else
       {
 	ic->pixels = ((cups_ib_t *)ic) + sizeof(cups_ic_t);
 
-	img->num_ics ++;
+	sh->num_ics ++;
 
-	DEBUG_printf(("Allocated cache tile %d (%p)...\n", img->num_ics, ic));
+	DEBUG_printf(("Allocated cache tile %d (%p)...\n", sh->num_ics, ic));
       }
     }
     else
     {
-      DEBUG_printf(("Flushing old cache tile (%p)...\n", img->first));
+      DEBUG_printf(("Flushing old cache tile (%p)...\n", sh->first));
 
-      flush_tile(img);
-      ic = img->first;
+      flush_tile(img, sh);
+      ic = sh->first;
     }
 
     ic->tile = tile;
@@ -757,37 +1080,30 @@ get_tile(cups_image_t *img,		/* I - Image */
       DEBUG_printf(("Loading cache tile from file position " CUPS_LLFMT "...\n",
                     CUPS_LLCAST tile->pos));
 
-      lseek(img->cachefile, tile->pos, SEEK_SET);
-      read(img->cachefile, ic->pixels, bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE);
+      if (img->cachemap != NULL)
+        memcpy(ic->pixels, img->cachemap + tile->pos, bytes);
+      else
+        pread(img->cachefile, ic->pixels, bytes, tile->pos);
     }
     else
     {
       DEBUG_puts("Clearing cache tile...");
 
-      memset(ic->pixels, 0, bpp * CUPS_TILE_SIZE * CUPS_TILE_SIZE);
+      memset(ic->pixels, 0, bytes);
     }
   }
 
-  if (ic == img->first)
-  {
-    if (ic->next != NULL)
-      ic->next->prev = NULL;
-
-    img->first = ic->next;
-    ic->next   = NULL;
-    ic->prev   = NULL;
-  }
-  else if (img->first == NULL)
-    img->first = ic;
-
-  if (ic != img->last)
+  if (ic != sh->last)
   {
    /*
-    * Remove the cache entry from the list...
+    * Remove the cache entry from the list (new entries are not in it)...
     */
 
     if (ic->prev != NULL)
       ic->prev->next = ic->next;
+    else if (ic == sh->first)
+      sh->first = ic->next;
+
     if (ic->next != NULL)
       ic->next->prev = ic->prev;
 
@@ -795,16 +1111,433 @@ get_tile(cups_image_t *img,		/* I - Image */
     * And add it to the end...
     */
 
-    if (img->last != NULL)
-      img->last->next = ic;
+    if (sh->last != NULL)
+      sh->last->next = ic;
+    else
+      sh->first = ic;
+
+    ic->prev = sh->last;
+    ic->next = NULL;
+    sh->last = ic;
+  }
+
+  *shard = sh;
+
+  return (ic->pixels + bpp * (y * img->tilew + x));
+}
+
+
+/*
+ * 'init_tiles()' - Create the tile array of an image.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+init_tiles(cups_image_t *img)		/* I - Image */
+{
+  int		tilex,			/* Looping var */
+		tiley;			/* Looping var */
+  cups_itile_t	**tiles,		/* Tile rows */
+		*tile;			/* Tile pointer */
+
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(img->mutex));
+#endif /* HAVE_PTHREAD_H */
+
+  if (img->tiles == NULL)
+  {
+    set_tile_size(img);
+
+    img->readrow = -1;
+
+    DEBUG_printf(("Creating tile array (%dx%d)\n", img->xtiles, img->ytiles));
+
+    if ((tiles = calloc(sizeof(cups_itile_t *), img->ytiles)) != NULL)
+    {
+      if ((tile = calloc(img->xtiles * sizeof(cups_itile_t),
+                         img->ytiles)) == NULL)
+      {
+        free(tiles);
+	tiles = NULL;
+      }
+      else
+      {
+	for (tiley = 0; tiley < img->ytiles; tiley ++)
+	{
+	  tiles[tiley] = tile;
+	  for (tilex = img->xtiles; tilex > 0; tilex --, tile ++)
+	    tile->pos = -1;
+	}
+      }
+    }
+
+    img->tiles = tiles;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(img->mutex));
+#endif /* HAVE_PTHREAD_H */
+
+  return (img->tiles == NULL ? -1 : 0);
+}
+
+
+/*
+ * 'open_cache()' - Create and map the tile swap file.
+ *
+ * The file is sized to hold every tile of the image, and tiles that no
+ * longer fit in memory are then used directly from the mapping.  If the
+ * file cannot be mapped the tiles are copied in and out with pread/pwrite.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+open_cache(cups_image_t *img)		/* I - Image */
+{
+#ifdef HAVE_SYS_MMAN_H
+  size_t	ntiles,			/* Number of tiles in image */
+		bytes;			/* Bytes per tile */
+  void		*map;			/* Mapping of swap file */
+#endif /* HAVE_SYS_MMAN_H */
+
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(img->mutex));
+#endif /* HAVE_PTHREAD_H */
+
+  if (img->cachefile < 0 &&
+      (img->cachefile = cupsTempFd(img->cachename,
+                                   sizeof(img->cachename))) >= 0)
+  {
+    DEBUG_printf(("Created swap file \"%s\"...\n", img->cachename));
+
+#ifdef HAVE_SYS_MMAN_H
+    ntiles = (size_t)img->xtiles * img->ytiles;
+    bytes  = cupsImageGetDepth(img) * img->tilew * img->tileh;
+
+    if (ntiles <= (size_t)-1 / bytes &&
+        (off_t)(ntiles * bytes) / bytes == ntiles &&
+        !ftruncate(img->cachefile, (off_t)(ntiles * bytes)) &&
+	(map = mmap(NULL, ntiles * bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+	            img->cachefile, 0)) != MAP_FAILED)
+    {
+      DEBUG_printf(("Mapped %u bytes of swap file...\n",
+                    (unsigned)(ntiles * bytes)));
+
+      img->cachemap  = (cups_ib_t *)map;
+      img->cachesize = ntiles * bytes;
+    }
+#endif /* HAVE_SYS_MMAN_H */
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(img->mutex));
+#endif /* HAVE_PTHREAD_H */
+
+  return (img->cachefile < 0 ? -1 : 0);
+}
+
+
+/*
+ * 'prefetch_tiles()' - Prefetch the next row of swapped tiles.
+ *
+ * Called with the tile row a reader is on; when the reading gets past the
+ * furthest tile row so far, the swap file pages of the following row are
+ * requested from the kernel ahead of time.  Threads reading different rows
+ * thus prefetch each row only once, and rows read again or backwards take
+ * no lock at all.
+ */
+
+static void
+prefetch_tiles(cups_image_t *img,	/* I - Image */
+               int          tiley)	/* I - Tile row being read */
+{
+  int		next;			/* Tile row to prefetch */
+  size_t	length;			/* Bytes per tile row */
+  off_t		offset;			/* Offset of tile row in file */
+#ifdef HAVE_SYS_MMAN_H
+  size_t	pad;			/* Offset from page boundary */
+#endif /* HAVE_SYS_MMAN_H */
+
+
+ /*
+  * Both values only change with the image lock held; a stale value costs
+  * at most one prefetch or a second check below...
+  */
+
+  if (img->cachefile < 0 || tiley <= img->readrow)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(img->mutex));
+#endif /* HAVE_PTHREAD_H */
 
-    ic->prev  = img->last;
-    img->last = ic;
+  if (img->cachefile >= 0 && tiley > img->readrow)
+  {
+    next         = tiley + 1;
+    img->readrow = tiley;
+
+    if (next < img->ytiles)
+    {
+      length = (size_t)img->xtiles * img->tilew * img->tileh *
+               cupsImageGetDepth(img);
+      offset = (off_t)next * length;
+
+      DEBUG_printf(("Prefetching tile row %d...\n", next));
+
+#ifdef HAVE_SYS_MMAN_H
+      if (img->cachemap != NULL)
+      {
+        pad = (size_t)offset % sysconf(_SC_PAGESIZE);
+
+#  ifdef MADV_WILLNEED
+	madvise(img->cachemap + offset - pad, length + pad, MADV_WILLNEED);
+#  endif /* MADV_WILLNEED */
+      }
+      else
+#endif /* HAVE_SYS_MMAN_H */
+      {
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(img->cachefile, offset, length, POSIX_FADV_WILLNEED);
+#endif /* POSIX_FADV_WILLNEED */
+      }
+    }
   }
 
-  ic->next = NULL;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(img->mutex));
+#endif /* HAVE_PTHREAD_H */
+}
+
 
-  return (ic->pixels + bpp * (y * CUPS_TILE_SIZE + x));
+/*
+ * 'release_tile()' - Release a tile returned by get_tile().
+ */
+
+static void
+release_tile(cups_ishard_t *shard)	/* I - Cache shard to unlock */
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(shard->mutex));
+#else
+  (void)shard;
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+
+/*
+ * 'set_tile_size()' - Choose the tile geometry of an image.
+ *
+ * The RIP_TILE_SIZE environment variable selects "N" for NxN pixel tiles or
+ * "WxH" for W by H pixel tiles; a width of 0 selects full-width strips of H
+ * rows.  The default is CUPS_TILE_SIZE square tiles.
+ */
+
+static void
+set_tile_size(cups_image_t *img)	/* I - Image */
+{
+  int	tilew,				/* Tile width */
+	tileh;				/* Tile height */
+  char	*tile_env;			/* Tile size environment variable */
+
+
+  tilew = tileh = CUPS_TILE_SIZE;
+
+  if ((tile_env = getenv("RIP_TILE_SIZE")) != NULL)
+  {
+    switch (sscanf(tile_env, "%dx%d", &tilew, &tileh))
+    {
+      case 1 :
+          tileh = tilew;
+	  break;
+      case 2 :
+          break;
+      default :
+          tilew = tileh = CUPS_TILE_SIZE;
+	  break;
+    }
+
+    if (tilew == 0)
+      tilew = img->xsize;
+
+    if (tilew < 1 || tileh < 1 || tilew > CUPS_TILE_MAXPIXELS ||
+        tileh > CUPS_TILE_MAXPIXELS)
+      tilew = tileh = CUPS_TILE_SIZE;
+    else if (tileh > CUPS_TILE_MAXPIXELS / tilew)
+      tileh = CUPS_TILE_MAXPIXELS / tilew;
+  }
+
+  img->tilew  = tilew;
+  img->tileh  = tileh;
+  img->xtiles = (img->xsize + tilew - 1) / tilew;
+  img->ytiles = (img->ysize + tileh - 1) / tileh;
+
+  DEBUG_printf(("Tile size %dx%d, %dx%d tiles...\n", tilew, tileh,
+                img->xtiles, img->ytiles));
+}
+
+
+/*
+ * 'transpose_block()' - Copy a block of pixels, swapping rows and columns.
+ *
+ * Pixel (c, r) of the source goes to pixel (r, c) of the destination.  The
+ * block is copied 8 by 8 pixels at a time so that the source rows and the
+ * destination columns both stay in the cache.
+ */
+
+static void
+transpose_block(
+    const cups_ib_t *src,		/* I - First source pixel */
+    int             srcpitch,		/* I - Bytes per source row */
+    cups_ib_t       *dst,		/* I - First destination pixel */
+    int             dstpitch,		/* I - Bytes per destination row */
+    int             width,		/* I - Width of source block */
+    int             height,		/* I - Height of source block */
+    int             bpp)		/* I - Bytes per pixel */
+{
+  int			bx, by,		/* Current 8x8 block */
+			bw, bh,		/* Size of current block */
+			c, r;		/* Column and row in block */
+  const cups_ib_t	*s;		/* Source pixel */
+  cups_ib_t		*d;		/* Destination pixel */
+
+
+  for (by = 0; by < height; by += 8)
+    for (bx = 0; bx < width; bx += 8)
+    {
+      bw = width - bx < 8 ? width - bx : 8;
+      bh = height - by < 8 ? height - by : 8;
+      s  = src + by * srcpitch + bx * bpp;
+      d  = dst + bx * dstpitch + by * bpp;
+
+#ifdef __SSE2__
+      if (bw == 8 && bh == 8 && bpp == 1)
+      {
+        __m128i	a0, a1, a2, a3,		/* Rows interleaved by 2 */
+		b0, b1, b2, b3;		/* Rows interleaved by 4 */
+
+        a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)s),
+	                       _mm_loadl_epi64((const __m128i *)(s + srcpitch)));
+	s  += 2 * srcpitch;
+        a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)s),
+	                       _mm_loadl_epi64((const __m128i *)(s + srcpitch)));
+	s  += 2 * srcpitch;
+        a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)s),
+	                       _mm_loadl_epi64((const __m128i *)(s + srcpitch)));
+	s  += 2 * srcpitch;
+        a3 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)s),
+	                       _mm_loadl_epi64((const __m128i *)(s + srcpitch)));
+
+	b0 = _mm_unpacklo_epi16(a0, a1);
+	b1 = _mm_unpackhi_epi16(a0, a1);
+	b2 = _mm_unpacklo_epi16(a2, a3);
+	b3 = _mm_unpackhi_epi16(a2, a3);
+
+	a0 = _mm_unpacklo_epi32(b0, b2);
+	a1 = _mm_unpackhi_epi32(b0, b2);
+	a2 = _mm_unpacklo_epi32(b1, b3);
+	a3 = _mm_unpackhi_epi32(b1, b3);
+
+        _mm_storel_epi64((__m128i *)d, a0);
+        _mm_storel_epi64((__m128i *)(d + dstpitch), _mm_srli_si128(a0, 8));
+	d += 2 * dstpitch;
+        _mm_storel_epi64((__m128i *)d, a1);
+        _mm_storel_epi64((__m128i *)(d + dstpitch), _mm_srli_si128(a1, 8));
+	d += 2 * dstpitch;
+        _mm_storel_epi64((__m128i *)d, a2);
+        _mm_storel_epi64((__m128i *)(d + dstpitch), _mm_srli_si128(a2, 8));
+	d += 2 * dstpitch;
+        _mm_storel_epi64((__m128i *)d, a3);
+        _mm_storel_epi64((__m128i *)(d + dstpitch), _mm_srli_si128(a3, 8));
+	continue;
+      }
+      else if (bw == 8 && bh == 8 && bpp == 4)
+      {
+        int	i;			/* 4x4 quadrant */
+	__m128i	r0, r1, r2, r3,		/* Source rows */
+		t0, t1, t2, t3;		/* Rows interleaved by 2 */
+
+        for (i = 0; i < 4; i ++)
+	{
+	  const cups_ib_t *qs = s + (i & 2) * 2 * srcpitch + (i & 1) * 16;
+	  cups_ib_t	  *qd = d + (i & 1) * 4 * dstpitch + (i & 2) * 8;
+
+	  r0 = _mm_loadu_si128((const __m128i *)qs);
+	  r1 = _mm_loadu_si128((const __m128i *)(qs + srcpitch));
+	  r2 = _mm_loadu_si128((const __m128i *)(qs + 2 * srcpitch));
+	  r3 = _mm_loadu_si128((const __m128i *)(qs + 3 * srcpitch));
+
+	  t0 = _mm_unpacklo_epi32(r0, r1);
+	  t1 = _mm_unpacklo_epi32(r2, r3);
+	  t2 = _mm_unpackhi_epi32(r0, r1);
+	  t3 = _mm_unpackhi_epi32(r2, r3);
+
+	  _mm_storeu_si128((__m128i *)qd, _mm_unpacklo_epi64(t0, t1));
+	  _mm_storeu_si128((__m128i *)(qd + dstpitch),
+	                   _mm_unpackhi_epi64(t0, t1));
+	  _mm_storeu_si128((__m128i *)(qd + 2 * dstpitch),
+	                   _mm_unpacklo_epi64(t2, t3));
+	  _mm_storeu_si128((__m128i *)(qd + 3 * dstpitch),
+	                   _mm_unpackhi_epi64(t2, t3));
+	}
+	continue;
+      }
+#endif /* __SSE2__ */
+
+      if (bpp == 3)
+      {
+       /*
+        * Copy RGB pixels down each destination row with 4-byte moves.  The
+	* extra byte read belongs to the next source pixel, except in the
+	* last column, and the extra byte written is overwritten by the next
+	* destination pixel...
+	*/
+
+        for (c = 0; c < bw; c ++, s += 3, d += dstpitch)
+	{
+	  const cups_ib_t	*sp = s;/* Source pixel */
+	  cups_ib_t		*dp = d;/* Destination pixel */
+	  unsigned		v;	/* Pixel value */
+
+	  if (bx + c < width - 1)
+	  {
+	    for (r = bh - 1; r > 0; r --, sp += srcpitch, dp += 3)
+	    {
+	      memcpy(&v, sp, 4);
+	      memcpy(dp, &v, 4);
+	    }
+	  }
+	  else
+	  {
+	    for (r = bh - 1; r > 0; r --, sp += srcpitch, dp += 3)
+	    {
+	      dp[0] = sp[0];
+	      dp[1] = sp[1];
+	      dp[2] = sp[2];
+	    }
+	  }
+
+	  dp[0] = sp[0];
+	  dp[1] = sp[1];
+	  dp[2] = sp[2];
+	}
+	continue;
+      }
+
+      for (r = 0; r < bh; r ++, s += srcpitch, d += bpp)
+        switch (bpp)
+	{
+	  case 1 :
+	      for (c = 0; c < bw; c ++)
+	        d[c * dstpitch] = s[c];
+	      break;
+
+	  default :
+	      for (c = 0; c < bw; c ++)
+	        memcpy(d + c * dstpitch, s + c * bpp, bpp);
+	      break;
+	}
+    }
 }
 
 
@@ -26,6 +26,32 @@
  */
 
 #include "driver.h"
+#include <stddef.h>
+#include <string.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
+
+
+/*
+ * Types...
+ */
+
+typedef struct cups_rgb_priv_s		/**** Color separation and private data ****/
+{
+  int			input_offset[3][256];
+					/* Cube offsets for 8-bit R, G, B */
+  int			input_mult[256];/* Multipliers for 8-bit input */
+  cups_rgb_t		rgb;		/* Public color separation (last) */
+} cups_rgb_priv_t;
+
+
+/*
+ * Macros...
+ */
+
+#define RGB_PRIV(r)	((cups_rgb_priv_t *)((char *)(r) - \
+			 offsetof(cups_rgb_priv_t, rgb)))
 
 
 /*
@@ -42,7 +68,7 @@ cupsRGBDelete(cups_rgb_t *rgbptr)	/* I - Color separation */
   free(rgbptr->colors[0][0]);
   free(rgbptr->colors[0]);
   free(rgbptr->colors);
-  free(rgbptr);
+  free(RGB_PRIV(rgbptr));
 }
 
 
@@ -161,6 +187,11 @@ cupsRGBDoGray(cups_rgb_t          *rgbptr,
 
 /*
  * 'cupsRGBDoRGB()' - Do a RGB separation...
+ *
+ * The sRGB curve, cube index, and multiplier for each 8-bit input value are
+ * looked up in tables made by cupsRGBNew(), and with SSE2 all color
+ * channels of a pixel are interpolated at once with exactly the same
+ * integer arithmetic as the scalar loop.
  */
 
 void
@@ -173,20 +204,26 @@ cupsRGBDoRGB(cups_rgb_t          *rgbptr,
 	     int                 num_pixels)
 					/* I - Number of pixels */
 {
+  const cups_rgb_priv_t	*priv;		/* Per-input lookup tables */
+  int			rgb;		/* Current RGB color */
+  unsigned		rm0, rm1, rs,	/* Current red multipliers and row offset */
+			gm0, gm1, gs,	/* Current green ... */
+			bm0, bm1, bs;	/* Current blue ... */
+  const unsigned char	*base,		/* Start of color cube */
+			*color;		/* Current color data */
+  int			rgbsize;	/* Separation data size */
+#ifdef __SSE2__
+  __m128i		zero,		/* Zero for unpacking */
+			wb, wgb, wg, wr,/* Multiplier pairs */
+			t0, t1,		/* Interpolated colors */
+			r0, r1;		/* ... */
+  int			c[8];		/* Corner colors */
+#else
   int			i;		/* Looping var */
-  int			rgb,		/* Current RGB color */
-			lastrgb;	/* Previous RGB color */
-  int			r, ri, rm0, rm1, rs,
-					/* Current red index, multipliexs, and row offset */
-			g, gi, gm0, gm1, gs,
-					/* Current green ... */
-			b, bi, bm0, bm1, bs;
-					/* Current blue ... */
-  const unsigned char	*color;		/* Current color data */
-  int			tempr,		/* Current separation colors */
+  unsigned		tempr,		/* Current separation colors */
 			tempg,		/* ... */
-			tempb ;		/* ... */
-  int			rgbsize;	/* Separation data size */
+			tempb;		/* ... */
+#endif /* __SSE2__ */
 
 
  /*
@@ -200,49 +237,36 @@ cupsRGBDoRGB(cups_rgb_t          *rgbptr,
   * Initialize variables used for the duration of the separation...
   */
 
-  lastrgb = -1;
+  priv    = RGB_PRIV(rgbptr);
   rgbsize = rgbptr->num_channels;
   rs      = rgbptr->cube_size * rgbptr->cube_size * rgbptr->num_channels;
   gs      = rgbptr->cube_size * rgbptr->num_channels;
   bs      = rgbptr->num_channels;
+  base    = rgbptr->colors[0][0][0];
+
+#ifdef __SSE2__
+  zero = _mm_setzero_si128();
+#endif /* __SSE2__ */
 
  /*
   * Loop through it all...
   */
 
-  while (num_pixels > 0)
+  for (; num_pixels > 0; num_pixels --, input += 3, output += rgbsize)
   {
    /*
     * See if the next pixel is a cached value...
     */
 
-    num_pixels --;
-
-    r   = cups_srgb_lut[*input++];
-    g   = cups_srgb_lut[*input++];
-    b   = cups_srgb_lut[*input++];
-    rgb = (((r << 8) | g) << 8) | b;
-
-    if (rgb == lastrgb)
-    {
-     /*
-      * Copy previous color and continue...
-      */
-
-      memcpy(output, output - rgbptr->num_channels, rgbsize);
+    rgb = (((input[0] << 8) | input[1]) << 8) | input[2];
 
-      output += rgbptr->num_channels;
-      continue;
-    }
-    else if (rgb == 0x000000 && rgbptr->cache_init)
+    if (rgb == 0x000000 && rgbptr->cache_init)
     {
      /*
       * Copy black color and continue...
       */
 
       memcpy(output, rgbptr->black, rgbsize);
-
-      output += rgbptr->num_channels;
       continue;
     }
     else if (rgb == 0xffffff && rgbptr->cache_init)
@@ -252,8 +276,6 @@ cupsRGBDoRGB(cups_rgb_t          *rgbptr,
       */
 
       memcpy(output, rgbptr->white, rgbsize);
-
-      output += rgbptr->num_channels;
       continue;
     }
 
@@ -261,21 +283,68 @@ cupsRGBDoRGB(cups_rgb_t          *rgbptr,
     * Nope, figure this one out on our own...
     */
 
-    ri  = rgbptr->cube_index[r];
-    rm0 = rgbptr->cube_mult[r];
+    rm0 = priv->input_mult[input[0]];
     rm1 = 256 - rm0;
 
-    gi  = rgbptr->cube_index[g];
-    gm0 = rgbptr->cube_mult[g];
+    gm0 = priv->input_mult[input[1]];
     gm1 = 256 - gm0;
 
-    bi  = rgbptr->cube_index[b];
-    bm0 = rgbptr->cube_mult[b];
+    bm0 = priv->input_mult[input[2]];
     bm1 = 256 - bm0;
 
-    color = rgbptr->colors[ri][gi][bi];
+    color = base + priv->input_offset[0][input[0]] +
+            priv->input_offset[1][input[1]] +
+            priv->input_offset[2][input[2]];
+
+#ifdef __SSE2__
+   /*
+    * Interleave the channels of two corners as 16-bit values and multiply
+    * them by a pair of multipliers with pmaddwd; the color cube has
+    * CUPS_MAX_RGB bytes of padding so reading 4 channels is always safe...
+    */
+
+    memcpy(c + 0, color, 4);
+    memcpy(c + 1, color + bs, 4);
+    memcpy(c + 2, color + gs, 4);
+    memcpy(c + 3, color + gs + bs, 4);
+    memcpy(c + 4, color + rs, 4);
+    memcpy(c + 5, color + rs + bs, 4);
+    memcpy(c + 6, color + rs + gs, 4);
+    memcpy(c + 7, color + rs + gs + bs, 4);
+
+    wb  = _mm_set1_epi32((int)((bm1 << 16) | bm0));
+    wgb = _mm_set1_epi32((int)((bm1 << 16) | gm0));
+    wg  = _mm_set1_epi32((int)((gm1 << 16) | gm0));
+    wr  = _mm_set1_epi32((int)((rm1 << 16) | rm0));
+
+#  define CORNERS(a,b,w) \
+	_mm_srli_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8( \
+	    _mm_cvtsi32_si128(a), _mm_cvtsi32_si128(b)), zero), w), 8)
+#  define BLEND(x,y,w) \
+	_mm_srli_epi32(_mm_madd_epi16(_mm_or_si128(x, _mm_slli_epi32(y, 16)), \
+	                              w), 8)
+
+    t0 = CORNERS(c[0], c[1], wb);
+    t1 = CORNERS(c[2], c[3], wgb);
+    r0 = BLEND(t0, t1, wg);
+
+    t0 = CORNERS(c[4], c[5], wb);
+    t1 = CORNERS(c[6], c[7], wb);
+    r1 = BLEND(t0, t1, wg);
+
+    r0 = BLEND(r0, r1, wr);
 
-    for (i = rgbptr->num_channels; i > 0; i --, color ++)
+#  undef CORNERS
+#  undef BLEND
+
+    r0   = _mm_packs_epi32(r0, r0);
+    r0   = _mm_packus_epi16(r0, r0);
+    c[0] = _mm_cvtsi128_si32(r0);
+
+    memcpy(output, c, rgbsize);
+
+#else
+    for (i = 0; i < rgbsize; i ++, color ++)
     {
       tempb = (color[0] * bm0 + color[bs] * bm1) / 256;
       tempg = tempb  * gm0;
@@ -292,12 +361,11 @@ cupsRGBDoRGB(cups_rgb_t          *rgbptr,
       tempr = (tempr + tempg * rm1) / 256;
 
       if (tempr > 255)
-        *output++ = 255;
-      else if (tempr < 0)
-        *output++ = 0;
+        output[i] = 255;
       else
-        *output++ = tempr;
+        output[i] = tempr;
     }
+#endif /* __SSE2__ */
   }
 }
 
@@ -427,6 +495,7 @@ cupsRGBNew(int           num_samples,	/* I - Number of samples */
 	   int           cube_size,	/* I - Size of LUT cube */
            int           num_channels)	/* I - Number of color components */
 {
+  cups_rgb_priv_t	*priv;		/* New color separation and tables */
   cups_rgb_t		*rgbptr;	/* New color separation */
   int			i;		/* Looping var */
   int			r, g, b;	/* Current RGB */
@@ -450,23 +519,26 @@ cupsRGBNew(int           num_samples,	/* I - Number of samples */
   * Allocate memory for the separation...
   */
 
-  if ((rgbptr = calloc(1, sizeof(cups_rgb_t))) == NULL)
+  if ((priv = calloc(1, sizeof(cups_rgb_priv_t))) == NULL)
     return (NULL);
 
+  rgbptr = &(priv->rgb);
+
  /*
   * Allocate memory for the samples and the LUT cube...
   */
 
   tempsize = cube_size * cube_size * cube_size;	/* FUTURE: num_samples < cs^3 */
 
-  tempc = calloc(tempsize, num_channels);
+  tempc = calloc(tempsize * num_channels + CUPS_MAX_RGB, 1);
+					/* Padding for cupsRGBDoRGB() */
   tempb = calloc(tempsize, sizeof(unsigned char *));
   tempg = calloc(cube_size * cube_size, sizeof(unsigned char **));
   tempr = calloc(cube_size, sizeof(unsigned char ***));
 
   if (tempc == NULL || tempb  == NULL || tempg == NULL || tempr == NULL)
   {
-    free(rgbptr);
+    free(priv);
 
     if (tempc)
       free(tempc);
@@ -527,6 +599,20 @@ cupsRGBNew(int           num_samples,	/* I - Number of samples */
       rgbptr->cube_mult[i] = 255 - ((i * (cube_size - 1)) & 255);
   }
 
+ /*
+  * ... and the same for 8-bit input values, including the sRGB curve...
+  */
+
+  for (i = 0; i < 256; i ++)
+  {
+    r = rgbptr->cube_index[cups_srgb_lut[i]];
+
+    priv->input_offset[0][i] = r * cube_size * cube_size * num_channels;
+    priv->input_offset[1][i] = r * cube_size * num_channels;
+    priv->input_offset[2][i] = r * num_channels;
+    priv->input_mult[i]      = rgbptr->cube_mult[cups_srgb_lut[i]];
+  }
+
  /*
   * Generate the black and white cache values for the separation...
   */
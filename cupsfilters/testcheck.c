@@ -0,0 +1,172 @@
+/*
+ * "$Id$"
+ *
+ *   Byte checking test program for CUPS.
+ *
+ *   Copyright 2026 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Main entry...
+ *   check_line() - Compare the check functions with a byte loop.
+ *
+ * Usage:
+ *
+ *   testcheck [bytes [passes]]
+ *
+ * Every line length up to 300 bytes is checked with differing bytes at
+ * every offset and alignment, then the speed of cupsCheckBytes() on a
+ * blank line of the given size is shown.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "driver.h"
+#include <string.h>
+#include <sys/time.h>
+
+
+/*
+ * Local functions...
+ */
+
+static int	check_line(const unsigned char *line, int length,
+		           unsigned char value);
+
+
+/*
+ * 'main()' - Main entry...
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			align,		/* Alignment of line */
+			length,		/* Length of line */
+			i, j,		/* Offsets of differing bytes */
+			bytes,		/* Size of timed line */
+			passes,		/* Number of timed passes */
+			status = 0;	/* Exit status */
+  unsigned char		buffer[320],	/* Test line buffer */
+			*line,		/* Test line */
+			*big;		/* Timed line */
+  struct timeval	start,		/* Start time */
+			end;		/* End time */
+  double		secs;		/* Elapsed seconds */
+
+
+  bytes  = argc > 1 ? atoi(argv[1]) : 4960;	/* 600dpi CMYK letter line */
+  passes = argc > 2 ? atoi(argv[2]) : 100000;
+
+  if (bytes < 1 || passes < 1)
+  {
+    puts("Usage: testcheck [bytes [passes]]");
+    return (1);
+  }
+
+ /*
+  * Compare against the simple byte loop...
+  */
+
+  for (align = 0; align < 16; align ++)
+    for (length = 0; length <= 300 - align; length ++)
+    {
+      line = buffer + align;
+
+      memset(line, 0, length);
+      status |= check_line(line, length, 0);
+
+      memset(line, 0x55, length);
+      status |= check_line(line, length, 0x55);
+
+      for (i = 0; i < length; i ++)
+      {
+        line[i] = 0x54;
+	status |= check_line(line, length, 0x55);
+
+        for (j = i + 1; j < length; j += 7)
+	{
+	  line[j] = 0;
+	  status |= check_line(line, length, 0x55);
+	  line[j] = 0x55;
+	}
+
+        line[i] = 0x55;
+      }
+    }
+
+  puts(status ? "Check functions: FAIL" : "Check functions: PASS");
+
+ /*
+  * Time a blank line...
+  */
+
+  if ((big = calloc(1, bytes)) == NULL)
+  {
+    puts("Unable to allocate line!");
+    return (1);
+  }
+
+  gettimeofday(&start, NULL);
+  for (i = 0, j = 0; i < passes; i ++)
+    j += cupsCheckBytes(big, bytes);
+  gettimeofday(&end, NULL);
+
+  secs = end.tv_sec - start.tv_sec + 0.000001 * (end.tv_usec - start.tv_usec);
+
+  printf("cupsCheckBytes: %d of %d %d-byte lines blank, %.1f Mbytes/sec\n",
+         j, passes, bytes,
+	 secs > 0.0 ? 0.000001 * bytes * passes / secs : 0.0);
+
+  free(big);
+
+  return (status);
+}
+
+
+/*
+ * 'check_line()' - Compare the check functions with a byte loop.
+ */
+
+static int				/* O - 0 on success, 1 on mismatch */
+check_line(const unsigned char *line,	/* I - Line to check */
+           int                 length,	/* I - Length of line */
+	   unsigned char       value)	/* I - Blank value */
+{
+  int	i,				/* Looping var */
+	first = -1,			/* Expected first offset */
+	last = -1;			/* Expected last offset */
+
+
+  for (i = 0; i < length; i ++)
+    if (line[i] != value)
+    {
+      if (first < 0)
+        first = i;
+      last = i;
+    }
+
+  if (cupsCheckFirst(line, length, value) != first ||
+      cupsCheckLast(line, length, value) != last ||
+      cupsCheckValue(line, length, value) != (first < 0) ||
+      (value == 0 && cupsCheckBytes(line, length) != (first < 0)))
+  {
+    printf("FAIL: length %d, value %d: expected first %d, last %d, got %d, %d\n",
+           length, value, first, last, cupsCheckFirst(line, length, value),
+	   cupsCheckLast(line, length, value));
+    return (1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * End of "$Id$".
+ */
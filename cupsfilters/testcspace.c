@@ -0,0 +1,218 @@
+/*
+ * "$Id$"
+ *
+ *   Colorspace conversion test and benchmark program for CUPS.
+ *
+ *   Copyright 2026 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Main entry...
+ *   test_conv()  - Compare and time one conversion at every SIMD level.
+ *
+ * Usage:
+ *
+ *   testcspace [pixels [passes]]
+ *
+ * Every conversion that has SIMD kernels is run with the scalar code and
+ * with each SIMD level the CPU supports.  The outputs must be identical, and
+ * the speed of each is shown in megapixels per second.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+#include <sys/time.h>
+
+
+/*
+ * Conversion functions...
+ */
+
+typedef void (*conv_func_t)(const cups_ib_t *in, cups_ib_t *out, int count);
+
+typedef struct
+{
+  const char	*name;			/* Name of conversion */
+  conv_func_t	func;			/* Conversion function */
+  int		inbpp,			/* Input bytes per pixel */
+		outbpp;			/* Output bytes per pixel */
+} conv_t;
+
+static const conv_t	convs[] =	/* Conversions to test */
+{
+  { "CMYKToRGB",   cupsImageCMYKToRGB,   4, 3 },
+  { "CMYKToWhite", cupsImageCMYKToWhite, 4, 1 },
+  { "RGBToBlack",  cupsImageRGBToBlack,  3, 1 },
+  { "RGBToCMY",    cupsImageRGBToCMY,    3, 3 },
+  { "RGBToCMYK",   cupsImageRGBToCMYK,   3, 4 },
+  { "RGBToWhite",  cupsImageRGBToWhite,  3, 1 }
+};
+
+static const char	*levels[] =	/* Names of SIMD levels */
+{
+  "scalar",
+  "ssse3",
+  "avx2"
+};
+
+
+/*
+ * Local functions...
+ */
+
+static int	test_conv(const conv_t *conv, const cups_ib_t *in,
+		          cups_ib_t *ref, cups_ib_t *out, int pixels,
+			  int passes, const char *profile);
+
+
+/*
+ * 'main()' - Main entry...
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i,			/* Looping var */
+		pixels,			/* Number of pixels */
+		passes,			/* Number of timed passes */
+		status;			/* Exit status */
+  cups_ib_t	*in,			/* Input pixels */
+		*ref,			/* Scalar output pixels */
+		*out;			/* SIMD output pixels */
+  static float	matrix[3][3] =		/* Color profile matrix */
+		{
+		  {  0.9f, -0.1f,  0.05f },
+		  { -0.2f,  1.1f, -0.05f },
+		  {  0.1f, -0.15f, 1.2f  }
+		};
+
+
+ /*
+  * Use an odd number of pixels so the scalar tail code is run, too...
+  */
+
+  pixels = argc > 1 ? atoi(argv[1]) : 1000003;
+  passes = argc > 2 ? atoi(argv[2]) : 10;
+
+  if (pixels < 1 || passes < 1)
+  {
+    puts("Usage: testcspace [pixels [passes]]");
+    return (1);
+  }
+
+  in  = malloc(4 * (size_t)pixels);
+  ref = malloc(4 * (size_t)pixels);
+  out = malloc(4 * (size_t)pixels);
+
+  if (!in || !ref || !out)
+  {
+    puts("Unable to allocate pixel buffers!");
+    return (1);
+  }
+
+  srand(1);
+  for (i = 0; i < 4 * pixels; i ++)
+    in[i] = rand();
+
+ /*
+  * Make sure every channel value and pixel extreme is present...
+  */
+
+  for (i = 0; i < 256 && i < pixels; i ++)
+  {
+    in[4 * i]     = i;
+    in[4 * i + 1] = 255 - i;
+    in[4 * i + 2] = i & 1 ? 0 : 255;
+    in[4 * i + 3] = i & 2 ? 0 : i;
+  }
+
+  printf("%d pixels, %d passes, best SIMD level is %s\n", pixels, passes,
+         levels[_cupsImageSetSIMD(-1)]);
+
+  status = 0;
+
+  for (i = 0; i < (int)(sizeof(convs) / sizeof(convs[0])); i ++)
+    status |= test_conv(convs + i, in, ref, out, pixels, passes, "");
+
+  cupsImageSetProfile(0.9f, 1.8f, matrix);
+
+  for (i = 0; i < (int)(sizeof(convs) / sizeof(convs[0])); i ++)
+    status |= test_conv(convs + i, in, ref, out, pixels, passes, "+profile");
+
+  free(in);
+  free(ref);
+  free(out);
+
+  return (status);
+}
+
+
+/*
+ * 'test_conv()' - Compare and time one conversion at every SIMD level.
+ */
+
+static int				/* O - 0 on success, 1 on mismatch */
+test_conv(const conv_t    *conv,	/* I - Conversion */
+          const cups_ib_t *in,		/* I - Input pixels */
+          cups_ib_t       *ref,		/* I - Buffer for scalar output */
+          cups_ib_t       *out,		/* I - Buffer for SIMD output */
+          int             pixels,	/* I - Number of pixels */
+	  int             passes,	/* I - Number of timed passes */
+	  const char      *profile)	/* I - Profile suffix for name */
+{
+  int			level,		/* SIMD level */
+			pass,		/* Current pass */
+			status = 0;	/* Return status */
+  cups_ib_t		*buffer;	/* Output buffer */
+  struct timeval	start,		/* Start time */
+			end;		/* End time */
+  double		secs;		/* Elapsed seconds */
+  char			name[255];	/* Name of conversion */
+
+
+  snprintf(name, sizeof(name), "%s%s", conv->name, profile);
+
+  for (level = CUPS_IMAGE_SIMD_NONE; level <= CUPS_IMAGE_SIMD_AVX2; level ++)
+  {
+    if (_cupsImageSetSIMD(level) != level)
+      break;
+
+    buffer = level == CUPS_IMAGE_SIMD_NONE ? ref : out;
+    memset(buffer, 0, (size_t)pixels * conv->outbpp);
+
+    gettimeofday(&start, NULL);
+    for (pass = 0; pass < passes; pass ++)
+      (*conv->func)(in, buffer, pixels);
+    gettimeofday(&end, NULL);
+
+    secs = end.tv_sec - start.tv_sec + 0.000001 * (end.tv_usec - start.tv_usec);
+
+    printf("%-22s %-6s %9.1f Mpixels/sec", name, levels[level],
+           secs > 0.0 ? 0.000001 * pixels * passes / secs : 0.0);
+
+    if (buffer == out &&
+        memcmp(ref, out, (size_t)pixels * conv->outbpp))
+    {
+      puts("  FAIL (output differs from scalar code)");
+      status = 1;
+    }
+    else
+      putchar('\n');
+  }
+
+  _cupsImageSetSIMD(-1);
+
+  return (status);
+}
+
+
+/*
+ * End of "$Id$".
+ */
@@ -12,6 +12,10 @@
  *       testdither 0 210 383 > filename.ppm
  *       testdither 0 82 255 > filename.ppm
  *
+ *   "testdither -b [lines [threads]]" times 6-channel lines at 1440 DPI
+ *   with and without dithering threads and checks that the threaded output
+ *   does not depend on the number of threads.
+ *
  *   Copyright 2007-2011 by Apple Inc.
  *   Copyright 1993-2005 by Easy Software Products.
  *
@@ -23,8 +27,9 @@
  *
  * Contents:
  *
- *   main()  - Test dithering and output a PPM file.
- *   usage() - Show program usage...
+ *   main()      - Test dithering and output a PPM file.
+ *   benchmark() - Time dithering of 1440 DPI lines.
+ *   usage()     - Show program usage...
  */
 
 /*
@@ -35,12 +40,15 @@
 #include <config.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 
 /*
  * Local functions...
  */
 
+int	benchmark(int lines, int threads);
 void	usage(void);
 
 
@@ -68,6 +76,10 @@ main(int  argc,			/* I - Number of command-line arguments */
   * See if we have lookup table values on the command-line...
   */
 
+  if (argc > 1 && !strcmp(argv[1], "-b"))
+    return (benchmark(argc > 2 ? atoi(argv[2]) : 1000,
+                      argc > 3 ? atoi(argv[3]) : 0));
+
   if (argc > 1)
   {
    /*
@@ -168,6 +180,14 @@ main(int  argc,			/* I - Number of command-line arguments */
   cupsDitherDelete(dither);
   cupsLutDelete(lut);
 
+ /*
+  * Make sure threaded dithering matches when run as a test, with at least
+  * two threads even on a single CPU...
+  */
+
+  if (argc == 1)
+    return (benchmark(64, 4));
+
  /*
   * Return with no errors...
   */
@@ -176,6 +196,134 @@ main(int  argc,			/* I - Number of command-line arguments */
 }
 
 
+/*
+ * 'benchmark()' - Time dithering of 1440 DPI lines.
+ *
+ * Dithers a letter-width line of 6 channels, like an inkjet with light
+ * cyan and magenta, once in the calling thread and once with a dithering
+ * pool.  The pool's output is then compared with that of a pool with a
+ * different number of threads.
+ */
+
+int					/* O - Exit status */
+benchmark(int lines,			/* I - Number of lines */
+          int threads)			/* I - Number of threads, 0 for all */
+{
+  int			i, c, x, y;	/* Looping vars */
+  const int		width = 12240,	/* 8.5" at 1440 DPI */
+			channels = 6;	/* KCMYcm */
+  short			*data;		/* Separation data */
+  unsigned char		*pixels[3][6];	/* Output pixels */
+  cups_lut_t		*luts[6];	/* Lookup tables */
+  cups_dither_t		*dithers[3][6];	/* Dither states */
+  cups_dither_pool_t	*pools[3];	/* No threads, tested and reference pool */
+  unsigned		sums[3][6];	/* Output checksums */
+  struct timeval	start,		/* Start time */
+			end;		/* End time */
+  double		secs[3];	/* Elapsed seconds */
+  static const float	lutvals[3] =	/* 3-level dot sizes */
+			{ 0.0, 0.5, 1.0 };
+
+
+  if (lines < 1)
+    usage();
+
+#ifdef _SC_NPROCESSORS_ONLN
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* _SC_NPROCESSORS_ONLN */
+
+  pools[0] = NULL;
+  pools[1] = cupsDitherPoolNew(threads);
+  pools[2] = threads > 1 ? cupsDitherPoolNew(threads == 2 ? 3 : 2) : NULL;
+  data     = malloc(16 * width * channels * sizeof(short));
+
+ /*
+  * Make 16 lines where each channel is a ramp at a different angle with
+  * some blank areas...
+  */
+
+  for (y = 0; y < 16; y ++)
+    for (x = 0; x < width; x ++)
+      for (c = 0; c < channels; c ++)
+	data[(y * width + x) * channels + c] =
+	    ((x / 64 + y * c) % 17) ? ((x + y + c * 683) * (c + 1)) % 4096 : 0;
+
+  for (c = 0; c < channels; c ++)
+  {
+    luts[c] = cupsLutNew(3, lutvals);
+
+    for (i = 0; i < 3; i ++)
+    {
+      dithers[i][c] = cupsDitherNew(width);
+      pixels[i][c]  = malloc(width);
+    }
+  }
+
+  for (i = 0; i < 3; i ++)
+  {
+    if (i == 2 && !pools[2])
+      break;
+
+    memset(sums[i], 0, sizeof(sums[i]));
+
+    gettimeofday(&start, NULL);
+
+    for (y = 0; y < lines; y ++)
+    {
+      cupsDitherLines(pools[i], dithers[i], luts,
+                      data + (y & 15) * width * channels, channels,
+		      pixels[i]);
+
+      for (c = 0; c < channels; c ++)
+        for (x = 0; x < width; x ++)
+	  sums[i][c] = sums[i][c] * 31 + pixels[i][c][x];
+    }
+
+    gettimeofday(&end, NULL);
+
+    secs[i] = end.tv_sec - start.tv_sec +
+              0.000001 * (end.tv_usec - start.tv_usec);
+  }
+
+  fprintf(stderr, "testdither: %d lines of %d pixels, %d channels\n", lines,
+          width, channels);
+  fprintf(stderr, "testdither: 1 thread %.0f lines/sec, pool %.0f lines/sec\n",
+          lines / secs[0], lines / secs[1]);
+
+  if (pools[2])
+  {
+    i = memcmp(sums[1], sums[2], sizeof(sums[1])) != 0;
+
+    fprintf(stderr, "testdither: threaded output %s\n",
+	    i ? "DIFFERS (FAIL)" : "matches (PASS)");
+  }
+  else
+  {
+    i = 0;
+
+    fputs("testdither: no threads, threaded output not checked\n", stderr);
+  }
+
+  for (c = 0; c < channels; c ++)
+  {
+    cupsLutDelete(luts[c]);
+
+    for (x = 0; x < 3; x ++)
+    {
+      cupsDitherDelete(dithers[x][c]);
+      free(pixels[x][c]);
+    }
+  }
+
+  free(data);
+  cupsDitherPoolDelete(pools[1]);
+  cupsDitherPoolDelete(pools[2]);
+
+  return (i);
+}
+
+
 /*
  * 'usage()' - Show program usage...
  */
@@ -184,6 +332,7 @@ void
 usage(void)
 {
   puts("Usage: testdither [val1 val2 [... val16]] >filename.ppm");
+  puts("       testdither -b [lines [threads]]");
   exit(1);
 }
 
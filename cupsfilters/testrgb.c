@@ -17,6 +17,8 @@
  *   main()       - Do color rgb tests.
  *   test_gray()  - Test grayscale rgbs...
  *   test_rgb()   - Test color rgbs...
+ *   test_speed() - Time and check RGB separations.
+ *   reference()  - Separate RGB pixels by indexing the color cube directly.
  */
 
 /*
@@ -28,6 +30,7 @@
 #include <ctype.h>
 #include "driver.h"
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #ifdef USE_LCMS1
 #  include <lcms.h>
@@ -39,6 +42,9 @@ void	test_gray(cups_sample_t *samples, int num_samples,
 void	test_rgb(cups_sample_t *samples, int num_samples,
 		 int cube_size, int num_comps,
 		 const char *basename);
+int	test_speed(int width, int height);
+void	reference(cups_rgb_t *rgbptr, const unsigned char *input,
+		  unsigned char *output, int num_pixels);
 
 
 /*
@@ -49,6 +55,7 @@ int						/* O - Exit status */
 main(int  argc,					/* I - Number of command-line arguments */
      char *argv[])				/* I - Command-line arguments */
 {
+  struct stat		fileinfo;		/* Test image information */
   static cups_sample_t	CMYK[] =		/* Basic 4-color sep */
 			{
 			  /*{ r,   g,   b   }, { C,   M,   Y,   K   }*/
@@ -70,18 +77,22 @@ main(int  argc,					/* I - Number of command-line arguments */
   mkdir("test", 0755);
 
  /*
-  * Run tests for CMYK and CMYK separations...
+  * Run tests for CMYK and CMYK separations if we have the test images...
   */
 
-  test_rgb(CMYK, 8, 2, 4, "test/rgb-cmyk");
+  if (!stat("image.ppm", &fileinfo))
+    test_rgb(CMYK, 8, 2, 4, "test/rgb-cmyk");
 
-  test_gray(CMYK, 8, 2, 4, "test/gray-cmyk");
+  if (!stat("image.pgm", &fileinfo))
+    test_gray(CMYK, 8, 2, 4, "test/gray-cmyk");
 
  /*
-  * Return with no errors...
+  * Check and time cupsRGBDoRGB(), "testrgb width height" to change the
+  * image size...
   */
 
-  return (0);
+  return (test_speed(argc > 1 ? atoi(argv[1]) : 4800,
+                     argc > 2 ? atoi(argv[2]) : 256));
 }
 
 
@@ -345,6 +356,211 @@ test_rgb(cups_sample_t *samples,	/* I - Sample values */
 }
 
 
+/*
+ * 'test_speed()' - Time and check RGB separations.
+ *
+ * A smooth, slightly noisy "photo" and random colors are separated with a
+ * 9x9x9 CMYK profile; cupsRGBDoRGB() must match reference() exactly.
+ */
+
+int					/* O - 0 on success, 1 on failure */
+test_speed(int width,			/* I - Width of test image */
+           int height)			/* I - Height of test image */
+{
+  int			i, x, y;	/* Looping vars */
+  int			r, g, b, k;	/* Current color */
+  int			status = 0;	/* Exit status */
+  cups_sample_t		samples[729],	/* 9x9x9 CMYK samples */
+			*sample;	/* Current sample */
+  cups_rgb_t		*rgb;		/* Color separation */
+  unsigned char		*input,		/* RGB image */
+			*expected,	/* Reference CMYK */
+			*output;	/* cupsRGBDoRGB() CMYK */
+  struct timeval	start,		/* Start time */
+			end;		/* End time */
+  double		secs[2];	/* Elapsed seconds */
+  const char		*name;		/* Name of test image */
+
+
+  if (width < 1 || height < 1)
+  {
+    puts("Usage: testrgb [width height]");
+    return (1);
+  }
+
+ /*
+  * Make a simple profile with gray component replacement...
+  */
+
+  for (r = 0, sample = samples; r < 9; r ++)
+    for (g = 0; g < 9; g ++)
+      for (b = 0; b < 9; b ++, sample ++)
+      {
+        sample->rgb[0] = r * 255 / 8;
+        sample->rgb[1] = g * 255 / 8;
+        sample->rgb[2] = b * 255 / 8;
+
+        k = 255 - max(sample->rgb[0], max(sample->rgb[1], sample->rgb[2]));
+
+        sample->colors[0] = 255 - sample->rgb[0] - k;
+        sample->colors[1] = 255 - sample->rgb[1] - k;
+        sample->colors[2] = 255 - sample->rgb[2] - k;
+        sample->colors[3] = k;
+      }
+
+  rgb = cupsRGBNew(729, samples, 9, 4);
+
+  input    = malloc((size_t)width * height * 3);
+  expected = malloc((size_t)width * height * 4);
+  output   = malloc((size_t)width * height * 4);
+
+  for (i = 0; i < 2; i ++)
+  {
+    if (i == 0)
+    {
+      name = "photo";
+
+      for (y = 0; y < height; y ++)
+        for (x = 0; x < width; x ++)
+        {
+          r = 128 + (int)(100.0 * sin(x / 300.0) * cos(y / 200.0));
+          g = 128 + (int)(100.0 * sin((x + y) / 400.0));
+          b = 128 + (int)(100.0 * cos(x / 500.0));
+
+          input[(y * width + x) * 3]     = r + rand() % 5 - 2;
+          input[(y * width + x) * 3 + 1] = g + rand() % 5 - 2;
+          input[(y * width + x) * 3 + 2] = b + rand() % 5 - 2;
+        }
+    }
+    else
+    {
+      name = "random";
+
+      for (x = width * height * 3 - 1; x >= 0; x --)
+        input[x] = rand();
+    }
+
+    gettimeofday(&start, NULL);
+
+    for (y = 0; y < height; y ++)
+      reference(rgb, input + y * width * 3, expected + y * width * 4, width);
+
+    gettimeofday(&end, NULL);
+
+    secs[0] = end.tv_sec - start.tv_sec +
+              0.000001 * (end.tv_usec - start.tv_usec);
+
+    gettimeofday(&start, NULL);
+
+    for (y = 0; y < height; y ++)
+      cupsRGBDoRGB(rgb, input + y * width * 3, output + y * width * 4, width);
+
+    gettimeofday(&end, NULL);
+
+    secs[1] = end.tv_sec - start.tv_sec +
+              0.000001 * (end.tv_usec - start.tv_usec);
+
+    if (memcmp(output, expected, (size_t)width * height * 4))
+    {
+      printf("testrgb: %s separation differs (FAIL)\n", name);
+      status = 1;
+    }
+
+    printf("testrgb: %s %dx%d, %.1f Mpixels/sec reference, %.1f "
+           "Mpixels/sec cupsRGBDoRGB\n", name, width, height,
+	   width * height / secs[0] / 1000000.0,
+	   width * height / secs[1] / 1000000.0);
+  }
+
+  if (!status)
+    puts("testrgb: separations match (PASS)");
+
+  free(input);
+  free(expected);
+  free(output);
+
+  cupsRGBDelete(rgb);
+
+  return (status);
+}
+
+
+/*
+ * 'reference()' - Separate RGB pixels by indexing the color cube directly.
+ *
+ * This is the original per-pixel trilinear interpolation.
+ */
+
+void
+reference(cups_rgb_t          *rgbptr,	/* I - Color separation */
+          const unsigned char *input,	/* I - Input RGB pixels */
+	  unsigned char       *output,	/* O - Output Device-N pixels */
+	  int                 num_pixels)	/* I - Number of pixels */
+{
+  int			i;		/* Looping var */
+  int			r, ri, rm0, rm1, rs,
+					/* Current red index, multipliers, and row offset */
+			g, gi, gm0, gm1, gs,
+					/* Current green ... */
+			b, bi, bm0, bm1, bs;
+					/* Current blue ... */
+  const unsigned char	*color;		/* Current color data */
+  int			tempr,		/* Current separation colors */
+			tempg,		/* ... */
+			tempb;		/* ... */
+
+
+  rs = rgbptr->cube_size * rgbptr->cube_size * rgbptr->num_channels;
+  gs = rgbptr->cube_size * rgbptr->num_channels;
+  bs = rgbptr->num_channels;
+
+  for (; num_pixels > 0; num_pixels --)
+  {
+    r = cups_srgb_lut[*input++];
+    g = cups_srgb_lut[*input++];
+    b = cups_srgb_lut[*input++];
+
+    ri  = rgbptr->cube_index[r];
+    rm0 = rgbptr->cube_mult[r];
+    rm1 = 256 - rm0;
+
+    gi  = rgbptr->cube_index[g];
+    gm0 = rgbptr->cube_mult[g];
+    gm1 = 256 - gm0;
+
+    bi  = rgbptr->cube_index[b];
+    bm0 = rgbptr->cube_mult[b];
+    bm1 = 256 - bm0;
+
+    color = rgbptr->colors[ri][gi][bi];
+
+    for (i = rgbptr->num_channels; i > 0; i --, color ++)
+    {
+      tempb = (color[0] * bm0 + color[bs] * bm1) / 256;
+      tempg = tempb  * gm0;
+      tempb = (color[gs] * gm0 + color[gs + bs] * bm1) / 256;
+      tempg = (tempg + tempb  * gm1) / 256;
+
+      tempr = tempg * rm0;
+
+      tempb = (color[rs] * bm0 + color[rs + bs] * bm1) / 256;
+      tempg = tempb  * gm0;
+      tempb = (color[rs + gs] * bm0 + color[rs + gs + bs] * bm1) / 256;
+      tempg = (tempg + tempb  * gm1) / 256;
+
+      tempr = (tempr + tempg * rm1) / 256;
+
+      if (tempr > 255)
+        *output++ = 255;
+      else if (tempr < 0)
+        *output++ = 0;
+      else
+        *output++ = tempr;
+    }
+  }
+}
+
+
 /*
  * End of "$Id$".
  */
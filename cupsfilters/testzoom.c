@@ -0,0 +1,458 @@
+/*
+ * "$Id$"
+ *
+ *   Image zoom test and benchmark program for CUPS.
+ *
+ *   Copyright 2026 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Main entry...
+ *   test_flat()  - Check that a flat image stays flat with every zoom type.
+ *   test_zoom()  - Compare and time one zoom type.
+ *   write_ppm()  - Write a test image.
+ *   zoom_image() - Zoom a whole image the way imagetoraster does.
+ *
+ * Usage:
+ *
+ *   testzoom [width height [passes]]
+ *
+ * A width x height test image is enlarged 2.5 times and reduced to a third
+ * with every zoom type, in gray, RGB and CMYK, and the speed of each is shown
+ * in output megapixels per second.  The bicubic and Lanczos filters are run
+ * with the scalar code in one thread and with the SIMD code in several
+ * threads; the outputs must be identical.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+#include <sys/time.h>
+
+
+/*
+ * Local globals...
+ */
+
+static const char	*types[] =	/* Names of zoom types */
+{
+  "nearest",
+  "bilinear",
+  "bicubic",
+  "lanczos"
+};
+
+
+/*
+ * Local functions...
+ */
+
+static int	test_flat(const char *filename, cups_icspace_t cspace);
+static int	test_zoom(cups_image_t *img, cups_iztype_t type, int xsize,
+		          int ysize, int passes);
+static int	write_ppm(const char *filename, int width, int height,
+		          int flat);
+static double	zoom_image(cups_image_t *img, cups_iztype_t type, int xsize,
+		           int ysize, int rotated, int threads,
+			   cups_ib_t *out);
+
+
+/*
+ * 'main()' - Main entry...
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			width,		/* Width of test image */
+			height,		/* Height of test image */
+			passes,		/* Number of timed passes */
+			status,		/* Exit status */
+			i;		/* Looping var */
+  cups_iztype_t		type;		/* Zoom type */
+  cups_image_t		*img;		/* Test image */
+  char			filename[256];	/* Test image file */
+  static const cups_icspace_t cspaces[] =
+			{		/* Colorspaces to test */
+			  CUPS_IMAGE_WHITE,
+			  CUPS_IMAGE_RGB,
+			  CUPS_IMAGE_CMYK
+			};
+  static const char	*cnames[] =	/* Names of colorspaces */
+			{
+			  "gray",
+			  "rgb",
+			  "cmyk"
+			};
+
+
+ /*
+  * Use odd sizes so the SIMD tail code and the filter edges are run...
+  */
+
+  width  = argc > 2 ? atoi(argv[1]) : 1001;
+  height = argc > 2 ? atoi(argv[2]) : 751;
+  passes = argc > 3 ? atoi(argv[3]) : 2;
+
+  if (width < 3 || height < 3 || passes < 1)
+  {
+    puts("Usage: testzoom [width height [passes]]");
+    return (1);
+  }
+
+  snprintf(filename, sizeof(filename), "%s/testzoom%d.ppm",
+           getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", (int)getpid());
+
+  status = 0;
+
+ /*
+  * Flat images must come out exactly flat...
+  */
+
+  if (write_ppm(filename, 97, 61, 1))
+    return (1);
+
+  for (i = 0; i < 3; i ++)
+    status |= test_flat(filename, cspaces[i]);
+
+  if (!status)
+    puts("flat images stay flat: PASS");
+
+ /*
+  * Compare and time the zoom types...
+  */
+
+  if (write_ppm(filename, width, height, 0))
+    return (1);
+
+  printf("%dx%d pixels, %d passes\n", width, height, passes);
+
+  for (i = 0; i < 3; i ++)
+  {
+    if ((img = cupsImageOpen(filename, cspaces[i], CUPS_IMAGE_WHITE, 100, 0,
+                             NULL)) == NULL)
+    {
+      perror(filename);
+      status = 1;
+      break;
+    }
+
+    printf("%s:\n", cnames[i]);
+
+    for (type = CUPS_IZOOM_FAST; type <= CUPS_IZOOM_LANCZOS; type ++)
+    {
+      status |= test_zoom(img, type, width * 5 / 2, height * 5 / 2, passes);
+      status |= test_zoom(img, type, width / 3, height / 3, passes);
+    }
+
+    cupsImageClose(img);
+  }
+
+  unlink(filename);
+
+  return (status);
+}
+
+
+/*
+ * 'test_flat()' - Check that a flat image stays flat with every zoom type.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+test_flat(const char     *filename,	/* I - Flat image file */
+          cups_icspace_t cspace)	/* I - Colorspace */
+{
+  cups_image_t	*img;			/* Flat image */
+  cups_iztype_t	type;			/* Zoom type */
+  cups_ib_t	*out,			/* Zoomed image */
+		pixel[4];		/* Color of the image */
+  int		i,			/* Looping var */
+		size,			/* Output size */
+		rotated,		/* Rotate image? */
+		depth,			/* Bytes per pixel */
+		status = 0;		/* Return status */
+
+
+  if ((img = cupsImageOpen(filename, cspace, CUPS_IMAGE_WHITE, 100, 0,
+                           NULL)) == NULL)
+  {
+    perror(filename);
+    return (1);
+  }
+
+  depth = cupsImageGetDepth(img);
+  out   = malloc(300 * 300 * depth);
+
+  cupsImageGetRow(img, 0, 0, 1, pixel);
+
+  for (type = CUPS_IZOOM_FAST; type <= CUPS_IZOOM_LANCZOS; type ++)
+    for (size = 7; size <= 300; size += 293)
+      for (rotated = 0; rotated < 2; rotated ++)
+      {
+	zoom_image(img, type, size, size, rotated, 1, out);
+
+	for (i = 0; i < size * size * depth; i ++)
+	  if (out[i] != pixel[i % depth])
+	  {
+	    printf("flat %d-channel image, %s to %dx%d%s: FAIL (%d != %d at "
+	           "%d)\n", depth, types[type], size, size,
+		   rotated ? " rotated" : "", out[i], pixel[i % depth], i);
+	    status = 1;
+	    break;
+	  }
+      }
+
+  free(out);
+  cupsImageClose(img);
+
+  return (status);
+}
+
+
+/*
+ * 'test_zoom()' - Compare and time one zoom type.
+ */
+
+static int				/* O - 0 on success, 1 on mismatch */
+test_zoom(cups_image_t  *img,		/* I - Image */
+          cups_iztype_t type,		/* I - Zoom type */
+	  int           xsize,		/* I - Width of output */
+	  int           ysize,		/* I - Height of output */
+	  int           passes)		/* I - Number of timed passes */
+{
+  int		pass,			/* Current pass */
+		rotated,		/* Rotate image? */
+		threads,		/* Number of threads */
+		status = 0;		/* Return status */
+  size_t	bytes;			/* Size of output */
+  cups_ib_t	*ref,			/* Scalar output */
+		*out;			/* SIMD and threaded output */
+  double	secs;			/* Elapsed seconds */
+
+
+  bytes = (size_t)xsize * ysize * cupsImageGetDepth(img);
+  ref   = malloc(bytes);
+  out   = malloc(bytes);
+
+  if (!ref || !out)
+  {
+    puts("Unable to allocate output buffers!");
+    free(ref);
+    free(out);
+    return (1);
+  }
+
+  for (rotated = 0; rotated < 2; rotated ++)
+  {
+    for (pass = 0, secs = 0.0; pass < passes; pass ++)
+      secs += zoom_image(img, type, xsize, ysize, rotated, 1, out);
+
+    printf("  %-8s %5dx%-5d %-7s %-7s %9.1f Mpixels/sec", types[type],
+           xsize, ysize, rotated ? "rotated" : "", "",
+	   secs > 0.0 ? 0.000001 * xsize * ysize * passes / secs : 0.0);
+
+    if (type < CUPS_IZOOM_BEST)
+    {
+      putchar('\n');
+      continue;
+    }
+
+   /*
+    * The scalar code in one thread is the reference for the SIMD code and
+    * the threads...
+    */
+
+    _cupsImageSetSIMD(CUPS_IMAGE_SIMD_NONE);
+
+    for (pass = 0, secs = 0.0; pass < passes; pass ++)
+      secs += zoom_image(img, type, xsize, ysize, rotated, 1, ref);
+
+    _cupsImageSetSIMD(-1);
+
+    printf(", scalar %.1f", secs > 0.0 ?
+               0.000001 * xsize * ysize * passes / secs : 0.0);
+
+    if (memcmp(ref, out, bytes))
+    {
+      puts("  FAIL (SIMD output differs from scalar code)");
+      status = 1;
+      continue;
+    }
+
+    for (threads = 2; threads <= 4; threads += 2)
+    {
+      memset(out, 0, bytes);
+
+      for (pass = 0, secs = 0.0; pass < passes; pass ++)
+	secs += zoom_image(img, type, xsize, ysize, rotated, threads, out);
+
+      printf(", %d threads %.1f", threads, secs > 0.0 ?
+		 0.000001 * xsize * ysize * passes / secs : 0.0);
+
+      if (memcmp(ref, out, bytes))
+      {
+	printf("  FAIL (%d thread output differs)", threads);
+	status = 1;
+	break;
+      }
+    }
+
+    putchar('\n');
+  }
+
+  free(ref);
+  free(out);
+
+  return (status);
+}
+
+
+/*
+ * 'write_ppm()' - Write a test image.
+ *
+ * The image has smooth gradients, sharp edges and some noise.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_ppm(const char *filename,		/* I - File to create */
+          int        width,		/* I - Width of image */
+	  int        height,		/* I - Height of image */
+	  int        flat)		/* I - Make a flat image? */
+{
+  FILE	*fp;				/* Image file */
+  int	x, y;				/* Looping vars */
+
+
+  if ((fp = fopen(filename, "wb")) == NULL)
+  {
+    perror(filename);
+    return (-1);
+  }
+
+  fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+  srand(1);
+
+  for (y = 0; y < height; y ++)
+    for (x = 0; x < width; x ++)
+      if (flat)
+      {
+        putc(200, fp);
+        putc(90, fp);
+        putc(17, fp);
+      }
+      else
+      {
+        putc(255 * x / width, fp);
+	putc(((x / 16 + y / 16) & 1) ? 240 : 15, fp);
+	putc((255 * y / height + rand() % 32) & 255, fp);
+      }
+
+  if (fclose(fp))
+  {
+    perror(filename);
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'zoom_image()' - Zoom a whole image the way imagetoraster does.
+ */
+
+static double				/* O - Elapsed seconds */
+zoom_image(cups_image_t  *img,		/* I - Image */
+           cups_iztype_t type,		/* I - Zoom type */
+	   int           xsize,		/* I - Width of output */
+	   int           ysize,		/* I - Height of output */
+	   int           rotated,	/* I - Rotate image? */
+	   int           threads,	/* I - Number of filtering threads */
+	   cups_ib_t     *out)		/* O - Zoomed image */
+{
+  cups_izoom_t		*z;		/* Zoom record */
+  cups_ib_t		*r0,		/* Top row */
+			*r1;		/* Bottom row */
+  int			x,		/* Current byte */
+			y,		/* Current output row */
+			iy,		/* Current input row */
+			last_iy,	/* Previous input row */
+			yerr0,		/* Top Y error value */
+			yerr1,		/* Bottom Y error value */
+			bytes;		/* Bytes per output row */
+  struct timeval	start,		/* Start time */
+			end;		/* End time */
+
+
+  gettimeofday(&start, NULL);
+
+  if ((z = _cupsImageZoomNew(img, 0, 0, cupsImageGetWidth(img) - 1,
+                             cupsImageGetHeight(img) - 1, xsize, ysize,
+			     rotated, type)) == NULL)
+  {
+    puts("Unable to create zoom record!");
+    exit(1);
+  }
+
+  z->num_threads = threads;
+  bytes          = z->xsize * z->depth;
+
+  for (y = z->ysize, yerr0 = 0, yerr1 = z->ysize, iy = 0, last_iy = -2;
+       y > 0;
+       y --, out += bytes)
+  {
+    if (type >= CUPS_IZOOM_BEST)
+    {
+      _cupsImageZoomFill(z, z->ysize - y);
+      memcpy(out, z->rows[z->row], bytes);
+      continue;
+    }
+
+    if (iy != last_iy)
+    {
+      if (type != CUPS_IZOOM_FAST && (iy - last_iy) > 1)
+	_cupsImageZoomFill(z, iy);
+
+      _cupsImageZoomFill(z, iy + z->yincr);
+
+      last_iy = iy;
+    }
+
+    r0 = z->rows[z->row];
+    r1 = z->rows[1 - z->row];
+
+    if (type == CUPS_IZOOM_FAST)
+      memcpy(out, r0, bytes);
+    else
+      for (x = 0; x < bytes; x ++)
+        out[x] = (r0[x] * yerr0 + r1[x] * yerr1) / z->ysize;
+
+    iy    += z->ystep;
+    yerr0 += z->ymod;
+    yerr1 -= z->ymod;
+    if (yerr1 <= 0)
+    {
+      yerr0 -= z->ysize;
+      yerr1 += z->ysize;
+      iy    += z->yincr;
+    }
+  }
+
+  _cupsImageZoomDelete(z);
+
+  gettimeofday(&end, NULL);
+
+  return (end.tv_sec - start.tv_sec + 0.000001 * (end.tv_usec - start.tv_usec));
+}
+
+
+/*
+ * End of "$Id$".
+ */
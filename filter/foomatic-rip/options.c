@@ -81,6 +81,15 @@ char **qualifier = NULL;
 option_t *optionlist = NULL;
 option_t *optionlist_sorted_by_order = NULL;
 
+/* Options and choices are also indexed by their case-insensitive names, so
+   that looking them up does not scan the lists */
+#define OPTION_HASH_SIZE 1024
+#define CHOICE_HASH_SIZE 64
+
+static option_t *optionlist_last = NULL;
+static option_t *option_hash[OPTION_HASH_SIZE];
+static size_t option_num = 0;
+
 int optionset_alloc, optionset_count;
 char **optionsets;
 
@@ -266,6 +275,7 @@ static void free_option(option_t *opt)
         opt->choicelist = opt->choicelist->next;
         free(choice);
     }
+    free(opt->choice_hash);
     while (opt->paramlist) {
         param = opt->paramlist;
         opt->paramlist = opt->paramlist->next;
@@ -310,6 +320,10 @@ void options_free()
         optionlist = optionlist->next;
         free_option(opt);
     }
+    optionlist_last = NULL;
+    optionlist_sorted_by_order = NULL;
+    memset(option_hash, 0, sizeof(option_hash));
+    option_num = 0;
 
     if (postpipe)
         free_dstr(postpipe);
@@ -319,36 +333,54 @@ void options_free()
     free_dstr(pagesetupprepend);
 }
 
+/* Case-insensitive FNV-1a hash of an option or choice name */
+static unsigned hash_name(const char *name, unsigned size)
+{
+    unsigned hash = 2166136261u;
+
+    for (; *name; name++)
+        hash = (hash ^ (unsigned char)tolower((unsigned char)*name)) * 16777619u;
+    return hash & (size - 1);
+}
+
 size_t option_count()
+{
+    return option_num;
+}
+
+static option_t * find_option_in_hash(const char *name)
 {
     option_t *opt;
-    size_t cnt = 0;
 
-    for (opt = optionlist; opt; opt = opt->next)
-        cnt++;
-    return cnt;
+    for (opt = option_hash[hash_name(name, OPTION_HASH_SIZE)]; opt;
+         opt = opt->next_in_hash) {
+        if (!strcasecmp(opt->name, name))
+            return opt;
+    }
+    return NULL;
 }
 
 option_t * find_option(const char *name)
 {
-    option_t *opt;
+    option_t *opt, *noopt;
 
     /* PageRegion and PageSize are the same options, just store one of them */
     if (!strcasecmp(name, "PageRegion"))
         return find_option("PageSize");
 
-    for (opt = optionlist; opt; opt = opt->next) {
-      if ((!strcasecmp(opt->name, name)) ||
-	  ((!strcasecmp(opt->name, &name[2])) &&
-	   (!prefixcasecmp(name, "no"))))
-            return opt;
-    }
-    return NULL;
+    /* "noFoo" also finds "Foo"; if both exist, the one added first wins */
+    opt = find_option_in_hash(name);
+    if (!prefixcasecmp(name, "no") &&
+        (noopt = find_option_in_hash(&name[2])) &&
+        (!opt || noopt->index < opt->index))
+        opt = noopt;
+    return opt;
 }
 
 option_t * assure_option(const char *name)
 {
-    option_t *opt, *last;
+    option_t *opt;
+    unsigned hash;
 
     if ((opt = find_option(name)))
         return opt;
@@ -372,12 +404,17 @@ option_t * assure_option(const char *name)
     opt->type = TYPE_NONE;
 
     /* append opt to optionlist */
-    if (optionlist) {
-        for (last = optionlist; last->next; last = last->next);
-        last->next = opt;
-    }
+    if (optionlist_last)
+        optionlist_last->next = opt;
     else
         optionlist = opt;
+    optionlist_last = opt;
+    opt->index = option_num++;
+
+    /* add opt to the hash index */
+    hash = hash_name(opt->name, OPTION_HASH_SIZE);
+    opt->next_in_hash = option_hash[hash];
+    option_hash[hash] = opt;
 
     /* prepend opt to optionlist_sorted_by_order
        (0 is always at the beginning) */
@@ -484,7 +521,10 @@ static choice_t * option_find_choice(option_t *opt, const char *name)
 {
     choice_t *choice;
     assert(opt && name);
-    for (choice = opt->choicelist; choice; choice = choice->next) {
+    if (!opt->choice_hash)
+        return NULL;
+    for (choice = opt->choice_hash[hash_name(name, CHOICE_HASH_SIZE)];
+         choice; choice = choice->next_in_hash) {
         if (!strcasecmp(choice->value, name))
             return choice;
     }
@@ -1127,21 +1167,26 @@ void option_set_from_string(option_t *opt, const char *str)
 
 static choice_t * option_assure_choice(option_t *opt, const char *name)
 {
-    choice_t *choice, *last = NULL;
+    choice_t *choice;
+    unsigned hash;
 
-    for (choice = opt->choicelist; choice; choice = choice->next) {
-        if (!strcasecmp(choice->value, name))
-            return choice;
-        last = choice;
-    }
-    if (!choice) {
-        choice = calloc(1, sizeof(choice_t));
-        if (last)
-            last->next = choice;
-        else
-            opt->choicelist = choice;
-        strlcpy(choice->value, name, 128);
-    }
+    if ((choice = option_find_choice(opt, name)))
+        return choice;
+
+    choice = calloc(1, sizeof(choice_t));
+    if (opt->choicelist_last)
+        opt->choicelist_last->next = choice;
+    else
+        opt->choicelist = choice;
+    opt->choicelist_last = choice;
+    strlcpy(choice->value, name, 128);
+
+    /* add choice to the hash index, by its possibly truncated value */
+    if (!opt->choice_hash)
+        opt->choice_hash = calloc(CHOICE_HASH_SIZE, sizeof(choice_t *));
+    hash = hash_name(choice->value, CHOICE_HASH_SIZE);
+    choice->next_in_hash = opt->choice_hash[hash];
+    opt->choice_hash[hash] = choice;
     return choice;
 }
 
@@ -2254,8 +2299,18 @@ void set_options_for_page(int optset, int page)
     int score, bestscore;
     option_t *opt;
     value_t *val, *bestvalue;
-    const char *ranges;
-    const char *optsetname;
+    int *scores;
+    int i, count;
+
+    /* Score every "pages:" option set for this page once, rather than
+       parsing its page ranges again for each option which has a value in
+       it */
+    count = optionset_count;
+    scores = calloc(count ? count : 1, sizeof(int));
+    for (i = 0; i < count; i++) {
+        if (startswith(optionsets[i], "pages:"))
+            scores[i] = get_page_score(&optionsets[i][6], page);
+    }
 
     for (opt = optionlist; opt; opt = opt->next) {
 
@@ -2263,12 +2318,10 @@ void set_options_for_page(int optset, int page)
         bestvalue = NULL;
         for (val = opt->valuelist; val; val = val->next) {
 
-            optsetname = optionset_name(val->optionset);
-            if (!startswith(optsetname, "pages:"))
+            if (val->optionset < 0 || val->optionset >= count)
                 continue;
 
-            ranges = &optsetname[6]; /* after "pages:" */
-            score = get_page_score(ranges, page);
+            score = scores[val->optionset];
             if (score && score < bestscore) {
                 bestscore = score;
                 bestvalue = val;
@@ -2278,5 +2331,6 @@ void set_options_for_page(int optset, int page)
         if (bestvalue)
             option_set_value(opt, optset, bestvalue->value);
     }
-}
 
+    free(scores);
+}
@@ -57,6 +57,8 @@ typedef struct choice_s {
     char text [128];
     char command[65536];
     struct choice_s *next;
+    struct choice_s *next_in_hash;  /* next choice in the same bucket of
+                                       the option's choice_hash */
 } choice_t;
 
 /* Custom option parameter */
@@ -89,6 +91,9 @@ typedef struct option_s {
     int notfirst;               /* TODO remove */
 
     choice_t *choicelist;
+    choice_t *choicelist_last;
+    choice_t **choice_hash;     /* choices by case-insensitive value,
+                                   CHOICE_HASH_SIZE buckets */
 
     /* Foomatic PPD extensions */
     char *proto;                /* *FoomaticRIPOptionPrototype: if this is set
@@ -105,6 +110,9 @@ typedef struct option_s {
 
     struct option_s *next;
     struct option_s *next_by_order;
+    struct option_s *next_in_hash;  /* next option in the same bucket of the
+                                       option hash */
+    size_t index;                   /* position in optionlist */
 } option_t;
 
 
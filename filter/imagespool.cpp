@@ -0,0 +1,64 @@
+/*
+ *   Spool file for the compressed page images of the raster to PDF filters.
+ *
+ *   Copyright 2026 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ */
+
+#include "imagespool.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+SpoolProvider::SpoolProvider(const char *prefix)
+  : bytes(0), spool(NULL), start(0)
+{
+    const char * tmpdir = getenv("TMPDIR");
+    std::string name = std::string(tmpdir ? tmpdir : "/tmp") + "/" + prefix + "-XXXXXX";
+    int fd;
+
+    if ((fd = mkstemp(&name[0])) < 0)
+        return;
+    unlink(name.c_str());
+
+    if ((spool = fdopen(fd, "w+b")) == NULL)
+        close(fd);
+}
+
+SpoolProvider::~SpoolProvider()
+{
+    if (spool) fclose(spool);
+}
+
+FILE * SpoolProvider::begin()
+{
+    fseeko(spool, 0, SEEK_END);
+    start = ftello(spool);
+    return spool;
+}
+
+void SpoolProvider::end(QPDFObjectHandle stream)
+{
+    off_t end = ftello(spool);
+
+    extents[stream.getObjectID()] = std::make_pair(start, end);
+    bytes += end - start;
+}
+
+void SpoolProvider::provideStreamData(int objid, int generation, Pipeline* pipeline)
+{
+    std::pair<off_t, off_t> extent = extents[objid];
+    unsigned char buf[65536];
+    size_t n;
+
+    if (fseeko(spool, extent.first, SEEK_SET) != 0) die("Unable to read spooled image data");
+    for (off_t left = extent.second - extent.first; left > 0; left -= n)
+    {
+        n = fread(buf, 1, (left < (off_t)sizeof(buf)) ? (size_t)left : sizeof(buf), spool);
+        if (n == 0) die("Unable to read spooled image data");
+        pipeline->write(buf, n);
+    }
+    pipeline->finish();
+}
@@ -0,0 +1,46 @@
+/*
+ *   Spool file for the compressed page images of the raster to PDF filters.
+ *
+ *   Copyright 2026 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ */
+
+#ifndef IMAGESPOOL_H
+#define IMAGESPOOL_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <map>
+#include <qpdf/QPDFObjectHandle.hh>
+
+#define PRE_COMPRESS
+
+// Compressed page images are written to an unlinked temporary file as soon as
+// a page is finished and read back by QPDFWriter at the end, so only the page
+// currently being decoded is kept in memory.
+class SpoolProvider : public QPDFObjectHandle::StreamDataProvider
+{
+public:
+    SpoolProvider(const char *prefix);  // prefix of the temporary file name
+    ~SpoolProvider();
+
+    bool ok() const { return spool != NULL; }
+    // start the data of a new stream at the end of the spool file
+    FILE * begin();
+    // make everything written since begin() the data of stream
+    void end(QPDFObjectHandle stream);
+    void provideStreamData(int objid, int generation, Pipeline* pipeline);
+
+    long long bytes;  // compressed bytes spooled so far
+private:
+    FILE * spool;
+    off_t start;
+    std::map<int, std::pair<off_t, off_t> > extents;  // objid -> start, end
+};
+
+// reports a fatal error and exits; provided by the filter
+void die(const char * str);
+
+#endif
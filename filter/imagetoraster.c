@@ -176,6 +176,7 @@ main(int  argc,				/* I - Number of command-line arguments */
   float			b;		/* Brightness factor */
   float			zoom;		/* Zoom facter */
   int			xppi, yppi;	/* Pixels-per-inch */
+  int			xhint, yhint;	/* Largest printed size in pixels */
   int			hue, sat;	/* Hue and saturation adjustment */
   cups_izoom_t		*z;		/* Image zoom buffer */
   cups_iztype_t		zoom_type;	/* Image zoom type */
@@ -708,12 +709,32 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   fputs("INFO: Loading print file.\n", stderr);
 
+  if (zoom > 0.0)
+  {
+   /*
+    * The image is scaled to a percentage of the imageable area, so it never
+    * needs more pixels than that area has at the output resolution.  Let the
+    * image reader decode large images (JPEG) at a reduced size...
+    */
+
+    xhint = zoom * (PageRight - PageLeft) / 72.0 *
+            max(header.HWResolution[0], header.HWResolution[1]);
+    yhint = zoom * (PageTop - PageBottom) / 72.0 *
+            max(header.HWResolution[0], header.HWResolution[1]);
+
+    fprintf(stderr, "DEBUG: Image size hint is %dx%d pixels\n", xhint, yhint);
+  }
+  else
+    xhint = yhint = 0;
+
   if (header.cupsColorSpace == CUPS_CSPACE_CIEXYZ ||
       header.cupsColorSpace == CUPS_CSPACE_CIELab ||
       header.cupsColorSpace >= CUPS_CSPACE_ICC1)
-    img = cupsImageOpen(filename, primary, secondary, sat, hue, NULL);
+    img = _cupsImageOpenScaled(filename, primary, secondary, sat, hue, NULL,
+                               xhint, yhint);
   else
-    img = cupsImageOpen(filename, primary, secondary, sat, hue, lut);
+    img = _cupsImageOpenScaled(filename, primary, secondary, sat, hue, lut,
+                               xhint, yhint);
 
   if (argc == 6)
     unlink(filename);
@@ -1151,7 +1172,27 @@ main(int  argc,				/* I - Number of command-line arguments */
     num_planes = 1;
 
   if (header.cupsBitsPerColor >= 8)
+  {
+   /*
+    * Interpolate continuous-tone output; high print quality or the
+    * "zoom-filter" option select the bicubic or Lanczos filters...
+    */
+
     zoom_type = CUPS_IZOOM_NORMAL;
+
+    if ((val = cupsGetOption("zoom-filter", num_options, options)) != NULL)
+    {
+      if (!strcasecmp(val, "nearest"))
+        zoom_type = CUPS_IZOOM_FAST;
+      else if (!strcasecmp(val, "bicubic"))
+        zoom_type = CUPS_IZOOM_BEST;
+      else if (!strcasecmp(val, "lanczos"))
+        zoom_type = CUPS_IZOOM_LANCZOS;
+    }
+    else if ((val = cupsGetOption("print-quality", num_options,
+                                  options)) != NULL && atoi(val) == 5)
+      zoom_type = CUPS_IZOOM_BEST;
+  }
   else
     zoom_type = CUPS_IZOOM_FAST;
 
@@ -1298,14 +1339,30 @@ main(int  argc,				/* I - Number of command-line arguments */
                y > 0;
                y --)
 	  {
-	    if (iy != last_iy)
+	    if (zoom_type >= CUPS_IZOOM_BEST)
+	    {
+	     /*
+	      * The bicubic and Lanczos filters return finished rows...
+	      */
+
+              _cupsImageZoomFill(z, z->ysize - y);
+
+	      r0 = r1 = z->rows[z->row];
+	    }
+	    else
 	    {
-	      if (zoom_type != CUPS_IZOOM_FAST && (iy - last_iy) > 1)
-        	_cupsImageZoomFill(z, iy);
+	      if (iy != last_iy)
+	      {
+		if (zoom_type != CUPS_IZOOM_FAST && (iy - last_iy) > 1)
+        	  _cupsImageZoomFill(z, iy);
 
-              _cupsImageZoomFill(z, iy + z->yincr);
+		_cupsImageZoomFill(z, iy + z->yincr);
 
-              last_iy = iy;
+		last_iy = iy;
+	      }
+
+              r0 = z->rows[z->row];
+              r1 = z->rows[1 - z->row];
 	    }
 
            /*
@@ -1314,9 +1371,6 @@ main(int  argc,				/* I - Number of command-line arguments */
 
     	    blank_line(&header, row);
 
-            r0 = z->rows[z->row];
-            r1 = z->rows[1 - z->row];
-
             switch (header.cupsColorSpace)
 	    {
 	      case CUPS_CSPACE_W :
@@ -3,8 +3,13 @@
 // Copyright (c) 2006-2011, BBR Inc.  All rights reserved.
 // MIT Licensed.
 
+#include <config.h>
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <cups/cups.h>
 #include <cups/ppd.h>
 #if (CUPS_VERSION_MAJOR > 1) || (CUPS_VERSION_MINOR > 6)
@@ -585,6 +590,9 @@ bool checkFeature(const char *feature, int num_options, cups_option_t *options)
   // TODO?!  choose default by whether pdfautoratate filter has already been run (e.g. by mimetype)
   param.autoRotate=( !is_false(cupsGetOption("pdfAutoRotate",num_options,options)) &&
                      !is_false(cupsGetOption("pdftopdfAutoRotate",num_options,options)) );
+
+  // emit one set of pages; copy count and collation go into the PDFTOPDF comments
+  param.downstreamCopies=is_true(cupsGetOption("pdftopdfDownstreamCopies",num_options,options));
 }
 // }}}
 
@@ -623,6 +631,9 @@ void calculate(ppd_file_t *ppd,ProcessingParameters &param) // {{{
     param.deviceCopies=1;
     // collate is never needed for a single copy
     param.collate=false; // (does not make a big difference for us)
+  } else if (param.downstreamCopies) { // next filter makes the copies (e.g. pstops, raster header)
+    param.deviceCopies=param.numCopies;
+    param.deviceCollate=param.collate;
   } else if ( (ppd)&&(!ppd->manual_copies) ) { // hw copy generation available
     param.deviceCopies=param.numCopies;
     if (param.collate) { // collate requested by user
@@ -666,26 +677,64 @@ void calculate(ppd_file_t *ppd,ProcessingParameters &param) // {{{
 // TODO? to extra file (also used in pdftoijs, e.g.)
 FILE *copy_stdin_to_temp() // {{{
 {
-  char buf[BUFSIZ];
-  int n;
+  char name[1024];
+  const size_t bufsize=256*1024;
+  long long copied=0;
+  ssize_t n;
 
-  // FIXME:  what does >buf mean here?
-  int fd=cupsTempFd(buf,sizeof(buf));
+  int fd=cupsTempFd(name,sizeof(name));
   if (fd<0) {
     error("Can't create temporary file");
     return NULL;
   }
   // remove name
-  unlink(buf);
+  unlink(name);
+
+#ifdef HAVE_SPLICE
+  // move the data from a pipe into the file without copying it through
+  // user space; falls through to read/write if stdin is not a pipe
+  while ( (n=splice(0,NULL,fd,NULL,bufsize,SPLICE_F_MOVE|SPLICE_F_MORE)) > 0) {
+    copied+=n;
+  }
+  if ( (n<0)&&((copied>0)||(errno!=EINVAL)) ) {
+    error("Can't copy stdin to temporary file");
+    close(fd);
+    return NULL;
+  }
+#endif
 
   // copy stdin to the tmp file
-  while ( (n=read(0,buf,BUFSIZ)) > 0) {
-    if (write(fd,buf,n) != n) {
-      error("Can't copy stdin to temporary file");
-      close(fd);
-      return NULL;
+  char *buf=new char[bufsize];
+  while ( (n=read(0,buf,bufsize)) != 0) {
+    if (n<0) {
+      if (errno==EINTR) {
+        continue;
+      }
+      break;
+    }
+    for (ssize_t pos=0,w;pos<n;pos+=w) {
+      if ( (w=write(fd,buf+pos,n-pos)) < 0) {
+        if (errno==EINTR) {
+          w=0;
+          continue;
+        }
+        n=-1;
+        break;
+      }
     }
+    if (n<0) {
+      break;
+    }
+    copied+=n;
   }
+  delete[] buf;
+  if (n<0) {
+    error("Can't copy stdin to temporary file");
+    close(fd);
+    return NULL;
+  }
+  fprintf(stderr,"DEBUG: Copied %lld bytes from stdin to temporary file\n",copied);
+
   if (lseek(fd,0,SEEK_SET) < 0) {
     error("Can't rewind temporary file");
     close(fd);
@@ -702,6 +751,28 @@ FILE *copy_stdin_to_temp() // {{{
 }
 // }}}
 
+FILE *open_stdin() // {{{
+{
+  // QPDF needs to seek; a regular file that starts at the current offset
+  // can be read in place instead of being copied
+  struct stat st;
+  if ( (fstat(0,&st)==0)&&(S_ISREG(st.st_mode))&&
+       (lseek(0,0,SEEK_CUR)==0) ) {
+    int fd=dup(0);
+    FILE *f;
+    if ( (fd>=0)&&((f=fdopen(fd,"rb"))!=0) ) {
+      fprintf(stderr,"DEBUG: Reading %lld bytes from stdin in place\n",
+              (long long)st.st_size);
+      return f;
+    }
+    if (fd>=0) {
+      close(fd);
+    }
+  }
+  return copy_stdin_to_temp();
+}
+// }}}
+
 int main(int argc,char **argv)
 {
   if ( (argc<6)||(argc>7) ) {
@@ -773,7 +844,7 @@ proc1->emitFilename("out.pdf");
         return 1;
       }
     } else {
-      FILE *f=copy_stdin_to_temp();
+      FILE *f=open_stdin();
       if ( (!f)||
            (!proc->loadFile(f,TakeOwnership)) ) {
         ppdClose(ppd);
@@ -91,6 +91,9 @@ void ProcessingParameters::dump() const // {{{
   fprintf(stderr,"autoRotate: %s\n",
                  (autoRotate)?"true":"false");
 
+  fprintf(stderr,"downstreamCopies: %s\n",
+                 (downstreamCopies)?"true":"false");
+
   fprintf(stderr,"emitJCL: %s\n",
                  (emitJCL)?"true":"false");
   fprintf(stderr,"deviceCopies: %d\n",
@@ -34,6 +34,8 @@ struct ProcessingParameters {
 
       autoRotate(false),
 
+      downstreamCopies(false),
+
       emitJCL(true),deviceCopies(1),deviceReverse(false),
       deviceCollate(false),setDuplex(false)
   {
@@ -77,6 +79,8 @@ struct ProcessingParameters {
 
   bool autoRotate;
 
+  bool downstreamCopies; // leave copies to printer/next filter, via %%PDFTOPDFNumCopies
+
   // ppd/jcl changes
   bool emitJCL;
   int deviceCopies;
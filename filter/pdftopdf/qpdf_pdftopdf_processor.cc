@@ -516,6 +516,26 @@ void QPDF_PDFTOPDF_Processor::multiply(int copies,bool collate) // {{{
   std::vector<QPDFObjectHandle> pages=pdf->getAllPages(); // need copy
   const int len=pages.size();
 
+  if (copies==1) {
+    return;
+  }
+
+  // shallowCopy() only duplicates the page dictionary; direct objects in it
+  // would still be written out once per copy. Make the bulky ones indirect,
+  // so every copy just references a single instance.
+  for (int iB=0;iB<len;iB++) {
+    static const char * const shared[]={"/Resources","/Contents"};
+    for (size_t iC=0;iC<sizeof(shared)/sizeof(shared[0]);iC++) {
+      if (!pages[iB].hasKey(shared[iC])) {
+        continue;
+      }
+      QPDFObjectHandle val=pages[iB].getKey(shared[iC]);
+      if ( (!val.isIndirect())&&( (val.isDictionary())||(val.isArray()) ) ) {
+        pages[iB].replaceKey(shared[iC],pdf->makeIndirectObject(val));
+      }
+    }
+  }
+
   if (collate) {
     for (int iA=1;iA<copies;iA++) {
       for (int iB=0;iB<len;iB++) {
@@ -594,6 +614,19 @@ void QPDF_PDFTOPDF_Processor::setComments(const std::vector<std::string> &commen
 }
 // }}}
 
+void QPDF_PDFTOPDF_Processor::setupWriter(QPDFWriter &out) // {{{
+{
+  if (hasCM) {
+    out.setMinimumPDFVersion("1.4");
+  } else {
+    out.setMinimumPDFVersion("1.2");
+  }
+  if (!extraheader.empty()) {
+    out.setExtraHeaderText(extraheader);
+  }
+}
+// }}}
+
 void QPDF_PDFTOPDF_Processor::emitFile(FILE *f,ArgOwnership take) // {{{
 {
   if (!pdf) {
@@ -611,14 +644,7 @@ void QPDF_PDFTOPDF_Processor::emitFile(FILE *f,ArgOwnership take) // {{{
     error("emitFile with MustDuplicate is not supported");
     return;
   }
-  if (hasCM) {
-    out.setMinimumPDFVersion("1.4");
-  } else {
-    out.setMinimumPDFVersion("1.2");
-  }
-  if (!extraheader.empty()) {
-    out.setExtraHeaderText(extraheader);
-  }
+  setupWriter(out);
   out.write();
 }
 // }}}
@@ -630,14 +656,7 @@ void QPDF_PDFTOPDF_Processor::emitFilename(const char *name) // {{{
   }
   // special case: name==NULL -> stdout
   QPDFWriter out(*pdf,name);
-  if (hasCM) {
-    out.setMinimumPDFVersion("1.4");
-  } else {
-    out.setMinimumPDFVersion("1.2");
-  }
-  if (!extraheader.empty()) {
-    out.setExtraHeaderText(extraheader);
-  }
+  setupWriter(out);
   out.write();
 }
 // }}}
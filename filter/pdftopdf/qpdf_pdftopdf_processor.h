@@ -4,6 +4,8 @@
 #include "pdftopdf_processor.h"
 #include <qpdf/QPDF.hh>
 
+class QPDFWriter;
+
 class QPDF_PDFTOPDF_PageHandle : public PDFTOPDF_PageHandle {
 public:
   virtual PageRect getRect() const;
@@ -61,6 +63,7 @@ private:
   void closeFile();
   void error(const char *fmt,...);
   void start();
+  void setupWriter(QPDFWriter &out);
 private:
   std::unique_ptr<QPDF> pdf;
   std::vector<QPDFObjectHandle> orig_pages;
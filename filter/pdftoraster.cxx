@@ -58,6 +58,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <splash/SplashBitmap.h>
 #include <strings.h>
 #include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
 #ifdef USE_LCMS1
 #include <lcms.h>
 #define cmsColorSpaceSignature icColorSpaceSignature
@@ -108,6 +112,8 @@ namespace {
 
   int exitCode = 0;
   int pwgraster = 0;
+  int nworkers = 1; /* number of processes rendering pages */
+  unsigned int stripHeight = 0; /* render pages in strips of these lines */
   int deviceCopies = 1;
   bool deviceCollate = false;
   cups_page_header2_t header;
@@ -189,6 +195,9 @@ namespace {
   cmsHPROFILE colorProfile = NULL;
   cmsHPROFILE popplerColorProfile = NULL;
   cmsHTRANSFORM colorTransform = NULL;
+  unsigned char *cmsLineBuf = NULL; /* one line after colorTransform */
+  unsigned char *cmsLineSrc = NULL; /* source line held in cmsLineBuf */
+  unsigned int cmsPixelBytes; /* bytes per pixel in cmsLineBuf */
   cmsCIEXYZ D65WhitePoint;
   int renderingIntent = INTENT_PERCEPTUAL;
   int cm_disabled = 0;
@@ -459,6 +468,7 @@ static void parseOpts(int argc, char **argv)
   GooString profilePath;
   char * profile = 0;
   ppd_attr_t *attr;
+  const char *val;
 
   if (argc < 6 || argc > 7) {
     pdfError(-1,const_cast<char *>("%s job-id user title copies options [file]"),
@@ -581,6 +591,29 @@ static void parseOpts(int argc, char **argv)
     exit(1);
 #endif /* HAVE_CUPS_1_7 */
   }
+
+  /* number of pages rendered in parallel */
+  if ((val = cupsGetOption("pdftorasterWorkers",num_options,options))
+      != NULL) {
+    nworkers = atoi(val);
+  } else if (ppd != NULL
+      && (attr = ppdFindAttr(ppd,"pdftorasterWorkers",NULL)) != NULL
+      && attr->value != NULL) {
+    nworkers = atoi(attr->value);
+  }
+  if (nworkers < 1) {
+    nworkers = 1;
+  }
+
+  /* render the pages in strips to bound memory use */
+  if ((val = cupsGetOption("pdftorasterStripHeight",num_options,options))
+      != NULL) {
+    stripHeight = atoi(val);
+  } else if (ppd != NULL
+      && (attr = ppdFindAttr(ppd,"pdftorasterStripHeight",NULL)) != NULL
+      && attr->value != NULL) {
+    stripHeight = atoi(attr->value);
+  }
 }
 
 static void parsePDFTOPDFComment(FILE *fp)
@@ -865,19 +898,18 @@ static unsigned char *convertCSpaceNone(unsigned char *src,
   return src;
 }
 
+/* The convertCSpace functions for color profiles get pixels which have
+   already been converted by transformLine() */
 static unsigned char *convertCSpaceWithProfiles(unsigned char *src,
   unsigned char *pixelBuf, unsigned int x, unsigned int y)
 {
-  cmsDoTransform(colorTransform,src,pixelBuf,1);
-  return pixelBuf;
+  return src;
 }
 
 static unsigned char *convertCSpaceXYZ8(unsigned char *src,
   unsigned char *pixelBuf, unsigned int x, unsigned int y)
 {
-  double alab[3];
-
-  cmsDoTransform(colorTransform,src,alab,1);
+  double *alab = (double *)src;
   cmsCIELab lab;
   cmsCIEXYZ xyz;
 
@@ -895,10 +927,8 @@ static unsigned char *convertCSpaceXYZ8(unsigned char *src,
 static unsigned char *convertCSpaceXYZ16(unsigned char *src,
   unsigned char *pixelBuf, unsigned int x, unsigned int y)
 {
-  double alab[3];
+  double *alab = (double *)src;
   unsigned short *sd = (unsigned short *)pixelBuf;
-
-  cmsDoTransform(colorTransform,src,alab,1);
   cmsCIELab lab;
   cmsCIEXYZ xyz;
 
@@ -916,8 +946,7 @@ static unsigned char *convertCSpaceXYZ16(unsigned char *src,
 static unsigned char *convertCSpaceLab8(unsigned char *src,
   unsigned char *pixelBuf, unsigned int x, unsigned int y)
 {
-  double lab[3];
-  cmsDoTransform(colorTransform,src,lab,1);
+  double *lab = (double *)src;
   pixelBuf[0] = 2.55*lab[0]+0.5;
   pixelBuf[1] = lab[1]+128.5;
   pixelBuf[2] = lab[2]+128.5;
@@ -927,8 +956,7 @@ static unsigned char *convertCSpaceLab8(unsigned char *src,
 static unsigned char *convertCSpaceLab16(unsigned char *src,
   unsigned char *pixelBuf, unsigned int x, unsigned int y)
 {
-  double lab[3];
-  cmsDoTransform(colorTransform,src,lab,1);
+  double *lab = (double *)src;
   unsigned short *sd = (unsigned short *)pixelBuf;
   sd[0] = 655.35*lab[0]+0.5;
   sd[1] = 256*(lab[1]+128)+0.5;
@@ -1250,17 +1278,38 @@ static void writePlanePixel16(unsigned char *dst,
   dst[pixeli*2+1] = pixelBuf[plane*2+1];
 }
 
+/* Run a whole line through colorTransform with one cmsDoTransform() call
+   instead of one call per pixel. Banded output converts the same source
+   line once per band, so the last converted line is kept. */
+static unsigned char *transformLine(unsigned char *src, unsigned int pixels,
+  unsigned int *pixelBytes)
+{
+  if (colorTransform == NULL) {
+    *pixelBytes = popplerNumColors;
+    return src;
+  }
+  if (src != cmsLineSrc) {
+    cmsDoTransform(colorTransform,src,cmsLineBuf,pixels);
+    cmsLineSrc = src;
+  }
+  *pixelBytes = cmsPixelBytes;
+  return cmsLineBuf;
+}
+
 static unsigned char *convertLineChunked(unsigned char *src, unsigned char *dst,
      unsigned int row, unsigned int plane, unsigned int pixels,
      unsigned int size)
 {
+  unsigned int pixelBytes;
+
+  src = transformLine(src,pixels,&pixelBytes);
   /* Assumed that BitsPerColor is 8 */
   for (unsigned int i = 0;i < pixels;i++) {
       unsigned char pixelBuf1[MAX_BYTES_PER_PIXEL];
       unsigned char pixelBuf2[MAX_BYTES_PER_PIXEL];
       unsigned char *pb;
 
-      pb = convertCSpace(src+i*popplerNumColors,pixelBuf1,i,row);
+      pb = convertCSpace(src+i*pixelBytes,pixelBuf1,i,row);
       pb = convertBits(pb,pixelBuf2,i,row);
       writePixel(dst,0,i,pb);
   }
@@ -1271,13 +1320,16 @@ static unsigned char *convertLineChunkedSwap(unsigned char *src,
      unsigned char *dst, unsigned int row, unsigned int plane,
      unsigned int pixels, unsigned int size)
 {
+  unsigned int pixelBytes;
+
+  src = transformLine(src,pixels,&pixelBytes);
   /* Assumed that BitsPerColor is 8 */
   for (unsigned int i = 0;i < pixels;i++) {
       unsigned char pixelBuf1[MAX_BYTES_PER_PIXEL];
       unsigned char pixelBuf2[MAX_BYTES_PER_PIXEL];
       unsigned char *pb;
 
-      pb = convertCSpace(src+(pixels-i-1)*popplerNumColors,pixelBuf1,i,row);
+      pb = convertCSpace(src+(pixels-i-1)*pixelBytes,pixelBuf1,i,row);
       pb = convertBits(pb,pixelBuf2,i,row);
       writePixel(dst,0,i,pb);
   }
@@ -1288,13 +1340,16 @@ static unsigned char *convertLinePlane(unsigned char *src, unsigned char *dst,
      unsigned int row, unsigned int plane, unsigned int pixels,
      unsigned int size)
 {
+  unsigned int pixelBytes;
+
+  src = transformLine(src,pixels,&pixelBytes);
   /* Assumed that BitsPerColor is 8 */
   for (unsigned int i = 0;i < pixels;i++) {
       unsigned char pixelBuf1[MAX_BYTES_PER_PIXEL];
       unsigned char pixelBuf2[MAX_BYTES_PER_PIXEL];
       unsigned char *pb;
 
-      pb = convertCSpace(src+i*popplerNumColors,pixelBuf1,i,row);
+      pb = convertCSpace(src+i*pixelBytes,pixelBuf1,i,row);
       pb = convertBits(pb,pixelBuf2,i,row);
       writePixel(dst,plane,i,pb);
   }
@@ -1305,12 +1360,15 @@ static unsigned char *convertLinePlaneSwap(unsigned char *src,
     unsigned char *dst, unsigned int row, unsigned int plane,
     unsigned int pixels, unsigned int size)
 {
+  unsigned int pixelBytes;
+
+  src = transformLine(src,pixels,&pixelBytes);
   for (unsigned int i = 0;i < pixels;i++) {
       unsigned char pixelBuf1[MAX_BYTES_PER_PIXEL];
       unsigned char pixelBuf2[MAX_BYTES_PER_PIXEL];
       unsigned char *pb;
 
-      pb = convertCSpace(src+(pixels-i-1)*popplerNumColors,pixelBuf1,i,row);
+      pb = convertCSpace(src+(pixels-i-1)*pixelBytes,pixelBuf1,i,row);
       pb = convertBits(pb,pixelBuf2,i,row);
       writePixel(dst,plane,i,pb);
   }
@@ -1467,6 +1525,7 @@ static void selectConvertFunc(cups_raster_t *raster)
       break;
     }
     convertBits = convertBitsNoop; /* convert bits in convertCSpace */
+    cmsPixelBytes = header.cupsNumColors*(bytes == 0 ? sizeof(double) : bytes);
     if (popplerColorProfile == NULL) {
       popplerColorProfile = cmsCreate_sRGBProfile();
     }
@@ -1632,6 +1691,10 @@ static void writePageImage(cups_raster_t *raster, SplashBitmap *bitmap,
   unsigned int rowsize = bitmap->getRowSize();
 
   if (allocLineBuf) lineBuf = new unsigned char [bytesPerLine];
+  if (colorTransform != NULL) {
+    cmsLineBuf = new unsigned char [header.cupsWidth*cmsPixelBytes];
+    cmsLineSrc = NULL;
+  }
   if ((pageNo & 1) == 0) {
     convertLine = convertLineEven;
   } else {
@@ -1669,12 +1732,80 @@ static void writePageImage(cups_raster_t *raster, SplashBitmap *bitmap,
     }
   }
   if (allocLineBuf) delete[] lineBuf;
+  if (cmsLineBuf != NULL) {
+    delete[] cmsLineBuf;
+    cmsLineBuf = NULL;
+  }
+}
+
+/* Render the page in strips of stripHeight lines with displayPageSlice()
+   and write each strip before rendering the next one, so that only one
+   strip bitmap is held at a time. The page content is interpreted once
+   per strip (and once per plane for CUPS_ORDER_PLANAR). */
+static void writePageImageStrips(cups_raster_t *raster, PDFDoc *doc,
+  SplashOutputDev *out, int pageNo, int rotate)
+{
+  ConvertLineFunc convertLine;
+  unsigned char *lineBuf = NULL;
+  unsigned char *dp;
+  bool reverse = header.Duplex && (pageNo & 1) == 0 && swap_image_y;
+
+  if (allocLineBuf) lineBuf = new unsigned char [bytesPerLine];
+  if (colorTransform != NULL) {
+    cmsLineBuf = new unsigned char [header.cupsWidth*cmsPixelBytes];
+  }
+  if ((pageNo & 1) == 0) {
+    convertLine = convertLineEven;
+  } else {
+    convertLine = convertLineOdd;
+  }
+  for (unsigned int plane = 0;plane < nplanes;plane++) {
+    for (unsigned int y = 0;y < header.cupsHeight;y += stripHeight) {
+      unsigned int n = header.cupsHeight - y;
+      unsigned int top;
+      SplashBitmap *bitmap;
+      unsigned char *bp;
+      int rowsize;
+
+      if (n > stripHeight) n = stripHeight;
+      /* with reverse the strips are taken from the bottom of the page */
+      top = reverse ? header.cupsHeight - y - n : y;
+      doc->displayPageSlice(out,pageNo,header.HWResolution[0],
+		       header.HWResolution[1],rotate,gTrue,gTrue,gTrue,
+		       bitmapoffset[0],bitmapoffset[1] + top,
+		       header.cupsWidth,n);
+      bitmap = out->getBitmap();
+      rowsize = bitmap->getRowSize();
+      bp = (unsigned char *)(bitmap->getDataPtr());
+      /* the strip bitmap is reused, do not take its lines for cached ones */
+      cmsLineSrc = NULL;
+      if (reverse) {
+        bp += rowsize * (n - 1);
+        rowsize = -rowsize;
+      }
+      for (unsigned int i = 0;i < n;i++) {
+        unsigned int h = reverse ? header.cupsHeight - y - i : y + i;
+
+        for (unsigned int band = 0;band < nbands;band++) {
+          dp = convertLine(bp,lineBuf,h,plane+band,header.cupsWidth,
+                 bytesPerLine);
+          cupsRasterWritePixels(raster,dp,bytesPerLine);
+        }
+        bp += rowsize;
+      }
+    }
+  }
+  if (allocLineBuf) delete[] lineBuf;
+  if (cmsLineBuf != NULL) {
+    delete[] cmsLineBuf;
+    cmsLineBuf = NULL;
+  }
 }
 
 static void outPage(PDFDoc *doc, Catalog *catalog, int pageNo,
   SplashOutputDev *out, cups_raster_t *raster)
 {
-  SplashBitmap *bitmap;
+  SplashBitmap *bitmap = NULL;
   Page *page = catalog->getPage(pageNo);
   PDFRectangle *mediaBox = page->getMediaBox();
   int rotate = page->getRotate();
@@ -1795,10 +1926,12 @@ static void outPage(PDFDoc *doc, Catalog *catalog, int pageNo,
     }
   }
 
-  doc->displayPage(out,pageNo,header.HWResolution[0],
-		   header.HWResolution[1],(landscape == 0 ? 0 : 90),
-		   gTrue,gTrue,gTrue);
-  bitmap = out->getBitmap();
+  if (stripHeight == 0) {
+    doc->displayPage(out,pageNo,header.HWResolution[0],
+		     header.HWResolution[1],(landscape == 0 ? 0 : 90),
+		     gTrue,gTrue,gTrue);
+    bitmap = out->getBitmap();
+  }
   bitmapoffset[0] = margins[0] / 72.0 * header.HWResolution[0];
   bitmapoffset[1] = margins[3] / 72.0 * header.HWResolution[1];
 
@@ -1840,7 +1973,165 @@ static void outPage(PDFDoc *doc, Catalog *catalog, int pageNo,
   }
 
   /* write page image */
-  writePageImage(raster,bitmap,pageNo);
+  if (stripHeight == 0) {
+    writePageImage(raster,bitmap,pageNo);
+  } else {
+    writePageImageStrips(raster,doc,out,pageNo,(landscape == 0 ? 0 : 90));
+  }
+}
+
+static SplashOutputDev *createOutputDev(PDFDoc *doc,
+  enum SplashColorMode cmode, int rowpad, SplashColorPtr paperColor)
+{
+  SplashOutputDev *out;
+
+  out = new SplashOutputDev(cmode,rowpad/* row padding */,
+    gFalse,paperColor,gTrue
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR <= 30
+    ,gFalse
+#endif
+    );
+#if POPPLER_VERSION_MAJOR > 0 || POPPLER_VERSION_MINOR >= 19
+  out->startDoc(doc);
+#else
+  out->startDoc(doc->getXRef());
+#endif
+  return out;
+}
+
+/* Body of a page rendering worker process. It opens its own PDFDoc and
+   SplashOutputDev, renders every nworkers-th page starting at page
+   worker+1 and sends them to the parent as an uncompressed raster stream */
+static void renderWorkerPages(const char *fileName, int worker, int npages,
+  enum SplashColorMode cmode, int rowpad, SplashColorPtr paperColor, int fd)
+{
+  cups_raster_t *raster;
+  PDFDoc *doc;
+  SplashOutputDev *out;
+
+  if ((raster = cupsRasterOpen(fd,CUPS_RASTER_WRITE)) == 0) {
+    pdfError(-1,const_cast<char *>("Can't open raster stream"));
+    _exit(1);
+  }
+  doc = new PDFDoc(new GooString(fileName),NULL,NULL);
+  if (!doc->isOk()) {
+    pdfError(-1,const_cast<char *>("Can't open %s in worker %d"),fileName,
+      worker);
+    _exit(1);
+  }
+  out = createOutputDev(doc,cmode,rowpad,paperColor);
+  for (int i = worker+1;i <= npages;i += nworkers) {
+    outPage(doc,doc->getCatalog(),i,out,raster);
+  }
+  cupsRasterClose(raster);
+  close(fd);
+  delete out;
+  delete doc;
+  fflush(stderr);
+  _exit(0);
+}
+
+/* Render the pages in nworkers processes. The parent copies the pages
+   from the workers' raster streams to the output in page order, while the
+   other workers render the following pages. */
+static void outPagesInWorkers(const char *fileName, int npages,
+  enum SplashColorMode cmode, int rowpad, SplashColorPtr paperColor,
+  cups_raster_t *raster)
+{
+  pid_t *pids = new pid_t [nworkers];
+  int *fds = new int [nworkers];
+  cups_raster_t **in = new cups_raster_t * [nworkers];
+  unsigned char *buf = NULL;
+  unsigned int bufSize = 0;
+  int w;
+
+  fflush(stderr);
+  for (w = 0;w < nworkers;w++) {
+    int p[2];
+
+    if (pipe(p) < 0) {
+      pdfError(-1,const_cast<char *>("Can't create pipe for worker %d"),w);
+      exit(1);
+    }
+    if ((pids[w] = fork()) < 0) {
+      pdfError(-1,const_cast<char *>("Can't create worker %d"),w);
+      exit(1);
+    }
+    if (pids[w] == 0) {
+      close(p[0]);
+      for (int j = 0;j < w;j++) {
+        close(fds[j]);
+      }
+      renderWorkerPages(fileName,w,npages,cmode,rowpad,paperColor,p[1]);
+    }
+    close(p[1]);
+    fds[w] = p[0];
+  }
+  fprintf(stderr, "DEBUG: Rendering %d pages in %d workers\n",npages,
+    nworkers);
+  for (w = 0;w < nworkers;w++) {
+    in[w] = cupsRasterOpen(fds[w],CUPS_RASTER_READ);
+  }
+
+  for (int i = 1;i <= npages;i++) {
+    cups_page_header2_t h;
+    unsigned int lines;
+
+    w = (i-1) % nworkers;
+    if (in[w] == NULL || !cupsRasterReadHeader2(in[w],&h)) {
+      pdfError(-1,const_cast<char *>("Can't read page %d from worker %d"),
+        i,w);
+      exitCode = 1;
+      break;
+    }
+    if (!cupsRasterWriteHeader2(raster,&h)) {
+      pdfError(-1,const_cast<char *>("Can't write page %d header"),i);
+      exitCode = 1;
+      break;
+    }
+    lines = h.cupsHeight;
+    if (h.cupsColorOrder == CUPS_ORDER_PLANAR) {
+      lines *= h.cupsNumColors;
+    }
+    if (h.cupsBytesPerLine > bufSize) {
+      delete[] buf;
+      bufSize = h.cupsBytesPerLine;
+      buf = new unsigned char [bufSize];
+    }
+    for (unsigned int l = 0;l < lines;l++) {
+      if (cupsRasterReadPixels(in[w],buf,h.cupsBytesPerLine) == 0) {
+        pdfError(-1,const_cast<char *>("Can't read page %d from worker %d"),
+          i,w);
+        exitCode = 1;
+        break;
+      }
+      cupsRasterWritePixels(raster,buf,h.cupsBytesPerLine);
+    }
+    if (exitCode != 0) {
+      break;
+    }
+  }
+
+  for (w = 0;w < nworkers;w++) {
+    int status = 0;
+
+    if (exitCode != 0) {
+      kill(pids[w],SIGTERM);
+    }
+    if (in[w] != NULL) {
+      cupsRasterClose(in[w]);
+    }
+    close(fds[w]);
+    while (waitpid(pids[w],&status,0) < 0 && errno == EINTR);
+    if (exitCode == 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+      pdfError(-1,const_cast<char *>("Worker %d failed"),w);
+      exitCode = 1;
+    }
+  }
+  delete[] buf;
+  delete[] in;
+  delete[] fds;
+  delete[] pids;
 }
 
 static void setPopplerColorProfile()
@@ -1941,6 +2232,9 @@ int main(int argc, char *argv[]) {
   enum SplashColorMode cmode;
   int rowpad;
   Catalog *catalog;
+  char tmpName[BUFSIZ];
+
+  tmpName[0] = '\0';
 
 #if POPPLER_VERSION_MAJOR > 0 || POPPLER_VERSION_MINOR >= 19
   setErrorCallback(::myErrorFun,NULL);
@@ -1954,11 +2248,10 @@ int main(int argc, char *argv[]) {
   if (argc == 6) {
     /* stdin */
     int fd;
-    char name[BUFSIZ];
     char buf[BUFSIZ];
     int n;
 
-    fd = cupsTempFd(name,sizeof(name));
+    fd = cupsTempFd(tmpName,sizeof(tmpName));
     if (fd < 0) {
       pdfError(-1,const_cast<char *>("Can't create temporary file"));
       exit(1);
@@ -1973,9 +2266,13 @@ int main(int argc, char *argv[]) {
       }
     }
     close(fd);
-    doc = new PDFDoc(new GooString(name));
-    /* remove name */
-    unlink(name);
+    doc = new PDFDoc(new GooString(tmpName));
+    if (nworkers == 1) {
+      /* remove name */
+      unlink(tmpName);
+      tmpName[0] = '\0';
+    }
+    /* else the workers open it by name, remove it after rendering */
   } else {
     GooString *fileName = new GooString(argv[6]);
     /* argc == 7 filenmae is specified */
@@ -2099,17 +2396,7 @@ int main(int argc, char *argv[]) {
     setPopplerColorProfile();
   }
 
-  out = new SplashOutputDev(cmode,rowpad/* row padding */,
-    gFalse,paperColor,gTrue
-#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR <= 30
-    ,gFalse
-#endif
-    );
-#if POPPLER_VERSION_MAJOR > 0 || POPPLER_VERSION_MINOR >= 19
-  out->startDoc(doc);
-#else
-  out->startDoc(doc->getXRef());
-#endif
+  out = createOutputDev(doc,cmode,rowpad,paperColor);
 
   if ((raster = cupsRasterOpen(1, pwgraster ? CUPS_RASTER_WRITE_PWG :
 			       CUPS_RASTER_WRITE)) == 0) {
@@ -2117,14 +2404,25 @@ int main(int argc, char *argv[]) {
 	exit(1);
   }
   selectConvertFunc(raster);
-  for (i = 1;i <= npages;i++) {
-    outPage(doc,catalog,i,out,raster);
+  if (nworkers > 1 && npages > 1) {
+    if (nworkers > npages) {
+      nworkers = npages;
+    }
+    outPagesInWorkers(doc->getFileName()->getCString(),npages,cmode,rowpad,
+      paperColor,raster);
+  } else {
+    for (i = 1;i <= npages;i++) {
+      outPage(doc,catalog,i,out,raster);
+    }
   }
   cupsRasterClose(raster);
 
   delete out;
 err1:
   delete doc;
+  if (tmpName[0] != '\0') {
+    unlink(tmpName);
+  }
   if (ppd != NULL) {
     ppdClose(ppd);
   }
@@ -21,8 +21,16 @@
  *   CancelJob()       - Cancel the current job...
  *   CompressData()    - Compress a line of graphics.
  *   OutputBand()      - Output a band of graphics.
+ *   SeparateLine()    - Color separate and dither a line of graphics.
+ *   WeaveLine()       - Weave a dithered line into bands and output as
+ *                       needed.
  *   ProcessLine()     - Read graphics from the page stream and output
  *                       as needed.
+ *   StartPipeline()   - Start the reader and separator threads for a page.
+ *   WritePipelineLine() - Weave and output the next line from the pipeline.
+ *   EndPipeline()     - Stop the pipeline threads and free the line buffers.
+ *   ReadThread()      - Read the lines of a page into the pipeline.
+ *   SeparateThread()  - Color separate and dither the lines of a page.
  *   main()            - Main entry and processing of driver.
  */
 
@@ -30,11 +38,15 @@
  * Include necessary headers...
  */
 
+#include <config.h>
 #include <cupsfilters/driver.h>
 #include "escp.h"
 #include <signal.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
@@ -54,6 +66,41 @@ typedef struct cups_weave_str
 } cups_weave_t;
 
 
+/*
+ * Pipeline data...
+ */
+
+#define PIPELINE_LINES	32		/* Lines buffered between stages */
+
+typedef struct cups_line_str
+{
+  int			status;			/* 1 if the line was read */
+  unsigned char		*pixels,		/* Raster data */
+			*outputs[7];		/* Dithered color planes */
+} cups_line_t;
+
+typedef struct cups_pipeline_str
+{
+  cups_raster_t		*ras;			/* Raster stream */
+  cups_page_header2_t	*header;		/* Page header */
+  int			num_lines;		/* Number of line buffers */
+  cups_line_t		*lines;			/* Line buffers */
+#ifdef HAVE_PTHREAD_H
+  int			num_threads,		/* Number of threads started */
+			stop,			/* Stop the threads? */
+			read,			/* Lines read */
+			separated,		/* Lines separated and dithered */
+			written;		/* Lines woven and output */
+  pthread_t		reader,			/* Reader thread */
+			separator;		/* Separator thread */
+  pthread_mutex_t	mutex;			/* Lock for the counts */
+  pthread_cond_t	read_cond,		/* Signaled when a line is written */
+			separate_cond,		/* Signaled when a line is read */
+			write_cond;		/* Signaled when a line is separated */
+#endif /* HAVE_PTHREAD_H */
+} cups_pipeline_t;
+
+
 /*
  * Globals...
  */
@@ -84,6 +131,9 @@ int		PrinterPlanes,		/* # of color planes */
 		PrinterLength;		/* Length of page */
 cups_lut_t	*DitherLuts[7];		/* Lookup tables for dithering */
 cups_dither_t	*DitherStates[7];	/* Dither state tables */
+cups_dither_pool_t *DitherPool;		/* Threads for dithering planes */
+cups_pipeline_t	*Pipeline;		/* Reader/separator threads */
+int		PipelineThreads;	/* Number of threads to use */
 int		OutputFeed;		/* Number of lines to skip */
 int		Canceled;		/* Is the job canceled? */
 
@@ -104,8 +154,19 @@ void	CompressData(ppd_file_t *, const unsigned char *, const int,
 		     const int);
 void	OutputBand(ppd_file_t *, cups_page_header2_t *,
 	           cups_weave_t *band);
+void	SeparateLine(cups_page_header2_t *, const unsigned char *,
+	             unsigned char **);
+void	WeaveLine(ppd_file_t *, cups_page_header2_t *, const int y,
+	          unsigned char **);
 void	ProcessLine(ppd_file_t *, cups_raster_t *,
 	            cups_page_header2_t *, const int y);
+int	StartPipeline(cups_raster_t *, cups_page_header2_t *);
+void	WritePipelineLine(ppd_file_t *, cups_page_header2_t *, const int y);
+void	EndPipeline(cups_pipeline_t *);
+#ifdef HAVE_PTHREAD_H
+static void *ReadThread(void *);
+static void *SeparateThread(void *);
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
@@ -345,6 +406,15 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
       DitherLuts[plane] = cupsLutNew(2, default_lut);
   }
 
+ /*
+  * Threads beyond the reader, separator, and output threads dither the
+  * color planes, at most one per plane...
+  */
+
+  if (!DitherPool && PrinterPlanes > 1 && PipelineThreads > 3)
+    DitherPool = cupsDitherPoolNew(PipelineThreads - 2 < PrinterPlanes ?
+                                       PipelineThreads - 2 : PrinterPlanes);
+
   if (DitherLuts[0][4095].pixel > 1)
     BitPlanes = 2;
   else
@@ -1547,71 +1617,52 @@ OutputBand(ppd_file_t         *ppd,	/* I - PPD file */
 
 
 /*
- * 'ProcessLine()' - Read graphics from the page stream and output as needed.
+ * 'SeparateLine()' - Color separate and dither a line of graphics.
  */
 
 void
-ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
-            cups_raster_t      *ras,	/* I - Raster stream */
-            cups_page_header2_t *header,	/* I - Page header */
-            const int          y)	/* I - Current scanline */
+SeparateLine(cups_page_header2_t *header,	/* I - Page header */
+             const unsigned char *pixels,	/* I - Raster data */
+             unsigned char      **outputs)	/* O - Dithered planes */
 {
-  int		plane,			/* Current color plane */
-		width,			/* Width of line */
-		subwidth,		/* Width of interleaved row */
-		subrow,			/* Subrow for interleaved output */
-		offset,			/* Offset to current line */
-		pass,			/* Pass number */
-		xstep,			/* X step value */
-		ystep;			/* Y step value */
-  cups_weave_t	*band;			/* Current band */
-
-
- /*
-  * Read a row of graphics...
-  */
+  int		width;			/* Width of line */
 
-  if (!cupsRasterReadPixels(ras, PixelBuffer, header->cupsBytesPerLine))
-    return;
 
  /*
   * Perform the color separation...
   */
 
-  width    = header->cupsWidth;
-  subwidth = header->cupsWidth / DotColStep;
-  xstep    = 3600 / header->HWResolution[0];
-  ystep    = 3600 / header->HWResolution[1];
+  width = header->cupsWidth;
 
   switch (header->cupsColorSpace)
   {
     case CUPS_CSPACE_W :
         if (RGB)
 	{
-	  cupsRGBDoGray(RGB, PixelBuffer, CMYKBuffer, width);
+	  cupsRGBDoGray(RGB, pixels, CMYKBuffer, width);
 	  cupsCMYKDoCMYK(CMYK, CMYKBuffer, InputBuffer, width);
 	}
 	else
-          cupsCMYKDoGray(CMYK, PixelBuffer, InputBuffer, width);
+          cupsCMYKDoGray(CMYK, pixels, InputBuffer, width);
 	break;
 
     case CUPS_CSPACE_K :
-        cupsCMYKDoBlack(CMYK, PixelBuffer, InputBuffer, width);
+        cupsCMYKDoBlack(CMYK, pixels, InputBuffer, width);
 	break;
 
     default :
     case CUPS_CSPACE_RGB :
         if (RGB)
 	{
-	  cupsRGBDoRGB(RGB, PixelBuffer, CMYKBuffer, width);
+	  cupsRGBDoRGB(RGB, pixels, CMYKBuffer, width);
 	  cupsCMYKDoCMYK(CMYK, CMYKBuffer, InputBuffer, width);
 	}
 	else
-          cupsCMYKDoRGB(CMYK, PixelBuffer, InputBuffer, width);
+          cupsCMYKDoRGB(CMYK, pixels, InputBuffer, width);
 	break;
 
     case CUPS_CSPACE_CMYK :
-        cupsCMYKDoCMYK(CMYK, PixelBuffer, InputBuffer, width);
+        cupsCMYKDoCMYK(CMYK, pixels, InputBuffer, width);
 	break;
   }
 
@@ -1619,25 +1670,53 @@ ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
   * Dither the pixels...
   */
 
+  cupsDitherLines(DitherPool, DitherStates, DitherLuts, InputBuffer,
+                  PrinterPlanes, outputs);
+}
+
+
+/*
+ * 'WeaveLine()' - Weave a dithered line into bands and output as needed.
+ */
+
+void
+WeaveLine(ppd_file_t          *ppd,	/* I - PPD file */
+          cups_page_header2_t *header,	/* I - Page header */
+          const int           y,	/* I - Current scanline */
+          unsigned char       **outputs)/* I - Dithered planes */
+{
+  int		plane,			/* Current color plane */
+		width,			/* Width of line */
+		subwidth,		/* Width of interleaved row */
+		subrow,			/* Subrow for interleaved output */
+		offset,			/* Offset to current line */
+		pass,			/* Pass number */
+		xstep,			/* X step value */
+		ystep;			/* Y step value */
+  cups_weave_t	*band;			/* Current band */
+
+
+  width    = header->cupsWidth;
+  subwidth = header->cupsWidth / DotColStep;
+  xstep    = 3600 / header->HWResolution[0];
+  ystep    = 3600 / header->HWResolution[1];
+
   for (plane = 0; plane < PrinterPlanes; plane ++)
   {
-    cupsDitherLine(DitherStates[plane], DitherLuts[plane], InputBuffer + plane,
-                   PrinterPlanes, OutputBuffers[plane]);
-
     if (DotRowMax == 1)
     {
      /*
       * Handle microweaved output...
       */
 
-      if (cupsCheckBytes(OutputBuffers[plane], width))
+      if (cupsCheckBytes(outputs[plane], width))
 	continue;
 
       if (BitPlanes == 1)
-	cupsPackHorizontal(OutputBuffers[plane], DotBuffers[plane],
+	cupsPackHorizontal(outputs[plane], DotBuffers[plane],
 	                   width, 0, 1);
       else
-	cupsPackHorizontal2(OutputBuffers[plane], DotBuffers[plane],
+	cupsPackHorizontal2(outputs[plane], DotBuffers[plane],
                 	    width, 1);
 
       if (OutputFeed > 0)
@@ -1670,10 +1749,10 @@ ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
 	offset = band->row * DotBufferSize;
 
         if (BitPlanes == 1)
-	  cupsPackHorizontal(OutputBuffers[plane] + pass,
+	  cupsPackHorizontal(outputs[plane] + pass,
 	                     band->buffer + offset, subwidth, 0, DotColStep);
         else
-	  cupsPackHorizontal2(OutputBuffers[plane] + pass,
+	  cupsPackHorizontal2(outputs[plane] + pass,
 	                      band->buffer + offset, subwidth, DotColStep);
 
         band->row ++;
@@ -1738,6 +1817,323 @@ ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
 }
 
 
+/*
+ * 'ProcessLine()' - Read graphics from the page stream and output as needed.
+ */
+
+void
+ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
+            cups_raster_t      *ras,	/* I - Raster stream */
+            cups_page_header2_t *header,	/* I - Page header */
+            const int          y)	/* I - Current scanline */
+{
+ /*
+  * Read a row of graphics...
+  */
+
+  if (!cupsRasterReadPixels(ras, PixelBuffer, header->cupsBytesPerLine))
+    return;
+
+ /*
+  * Separate, dither, and weave it...
+  */
+
+  SeparateLine(header, PixelBuffer, OutputBuffers);
+  WeaveLine(ppd, header, y, OutputBuffers);
+}
+
+
+/*
+ * 'StartPipeline()' - Start the reader and separator threads for a page.
+ *
+ * Lines go from the reader thread to the separator thread (color separation
+ * and dithering) and then to WritePipelineLine() (weaving, compression, and
+ * output) through a ring of PIPELINE_LINES line buffers.  Returns 0 when the
+ * page has to be processed with ProcessLine() instead.
+ */
+
+int					/* O - 1 if started, 0 otherwise */
+StartPipeline(cups_raster_t      *ras,	/* I - Raster stream */
+              cups_page_header2_t *header)	/* I - Page header */
+{
+#ifdef HAVE_PTHREAD_H
+  cups_pipeline_t *pipeline;		/* New pipeline */
+  cups_line_t	*line;			/* Current line */
+  int		i, j;			/* Looping vars */
+  sigset_t	mask,			/* Signals blocked in the threads */
+		oldmask;		/* Original signal mask */
+
+
+  if (PipelineThreads < 2 || header->cupsHeight < 2)
+    return (0);
+
+  if ((pipeline = calloc(1, sizeof(cups_pipeline_t))) == NULL)
+    return (0);
+
+  pipeline->ras       = ras;
+  pipeline->header    = header;
+  pipeline->num_lines = PIPELINE_LINES;
+
+  pthread_mutex_init(&(pipeline->mutex), NULL);
+  pthread_cond_init(&(pipeline->read_cond), NULL);
+  pthread_cond_init(&(pipeline->separate_cond), NULL);
+  pthread_cond_init(&(pipeline->write_cond), NULL);
+
+  if ((pipeline->lines = calloc(PIPELINE_LINES, sizeof(cups_line_t))) == NULL)
+  {
+    EndPipeline(pipeline);
+    return (0);
+  }
+
+  for (i = 0, line = pipeline->lines; i < PIPELINE_LINES; i ++, line ++)
+  {
+    line->pixels     = malloc(header->cupsBytesPerLine);
+    line->outputs[0] = malloc(PrinterPlanes * header->cupsWidth);
+
+    if (!line->pixels || !line->outputs[0])
+    {
+      EndPipeline(pipeline);
+      return (0);
+    }
+
+    for (j = 1; j < PrinterPlanes; j ++)
+      line->outputs[j] = line->outputs[0] + j * header->cupsWidth;
+  }
+
+ /*
+  * Start the separator before the reader, so nothing has been read from the
+  * raster stream if a thread cannot be created.  Keep SIGTERM on the main
+  * thread so CancelJob() does not interrupt a raster read...
+  */
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+
+  if (!pthread_create(&(pipeline->separator), NULL, SeparateThread, pipeline))
+  {
+    pipeline->num_threads = 1;
+
+    if (!pthread_create(&(pipeline->reader), NULL, ReadThread, pipeline))
+      pipeline->num_threads = 2;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+  if (pipeline->num_threads < 2)
+  {
+    fputs("DEBUG: Unable to start pipeline threads.\n", stderr);
+    EndPipeline(pipeline);
+    return (0);
+  }
+
+  Pipeline = pipeline;
+
+  return (1);
+#else
+  (void)ras;
+  (void)header;
+
+  return (0);
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * 'WritePipelineLine()' - Weave and output the next line from the pipeline.
+ */
+
+void
+WritePipelineLine(ppd_file_t         *ppd,	/* I - PPD file */
+                  cups_page_header2_t *header,	/* I - Page header */
+                  const int          y)	/* I - Current scanline */
+{
+#ifdef HAVE_PTHREAD_H
+  cups_pipeline_t *pipeline = Pipeline;	/* Current pipeline */
+  cups_line_t	*line;			/* Current line */
+
+
+  line = pipeline->lines + y % pipeline->num_lines;
+
+  pthread_mutex_lock(&(pipeline->mutex));
+
+  while (pipeline->separated <= y)
+    pthread_cond_wait(&(pipeline->write_cond), &(pipeline->mutex));
+
+  pthread_mutex_unlock(&(pipeline->mutex));
+
+  if (line->status)
+    WeaveLine(ppd, header, y, line->outputs);
+
+ /*
+  * Give the buffer back to the reader...
+  */
+
+  pthread_mutex_lock(&(pipeline->mutex));
+  pipeline->written = y + 1;
+  pthread_cond_signal(&(pipeline->read_cond));
+  pthread_mutex_unlock(&(pipeline->mutex));
+#else
+  (void)ppd;
+  (void)header;
+  (void)y;
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * 'EndPipeline()' - Stop the pipeline threads and free the line buffers.
+ */
+
+void
+EndPipeline(cups_pipeline_t *pipeline)	/* I - Pipeline */
+{
+#ifdef HAVE_PTHREAD_H
+  int		i;			/* Looping var */
+
+
+  if (!pipeline)
+    return;
+
+  if (pipeline->num_threads > 0)
+  {
+   /*
+    * Stop the threads, which may still be waiting for lines when the job is
+    * canceled...
+    */
+
+    pthread_mutex_lock(&(pipeline->mutex));
+    pipeline->stop = 1;
+    pthread_cond_broadcast(&(pipeline->read_cond));
+    pthread_cond_broadcast(&(pipeline->separate_cond));
+    pthread_mutex_unlock(&(pipeline->mutex));
+
+    pthread_join(pipeline->separator, NULL);
+    if (pipeline->num_threads > 1)
+      pthread_join(pipeline->reader, NULL);
+  }
+
+  if (pipeline->lines)
+  {
+    for (i = 0; i < pipeline->num_lines; i ++)
+    {
+      free(pipeline->lines[i].pixels);
+      free(pipeline->lines[i].outputs[0]);
+    }
+
+    free(pipeline->lines);
+  }
+
+  pthread_mutex_destroy(&(pipeline->mutex));
+  pthread_cond_destroy(&(pipeline->read_cond));
+  pthread_cond_destroy(&(pipeline->separate_cond));
+  pthread_cond_destroy(&(pipeline->write_cond));
+
+  if (pipeline == Pipeline)
+    Pipeline = NULL;
+
+  free(pipeline);
+#else
+  (void)pipeline;
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * 'ReadThread()' - Read the lines of a page into the pipeline.
+ */
+
+static void *				/* O - Thread exit status */
+ReadThread(void *data)			/* I - Pipeline */
+{
+  cups_pipeline_t *pipeline = (cups_pipeline_t *)data;
+					/* Pipeline */
+  cups_line_t	*line;			/* Current line */
+  int		y;			/* Current scanline */
+
+
+  for (y = 0; y < pipeline->header->cupsHeight; y ++)
+  {
+   /*
+    * Wait for the main thread to finish with the buffer...
+    */
+
+    pthread_mutex_lock(&(pipeline->mutex));
+
+    while (!pipeline->stop && y - pipeline->written >= pipeline->num_lines)
+      pthread_cond_wait(&(pipeline->read_cond), &(pipeline->mutex));
+
+    if (pipeline->stop)
+    {
+      pthread_mutex_unlock(&(pipeline->mutex));
+      break;
+    }
+
+    pthread_mutex_unlock(&(pipeline->mutex));
+
+    line         = pipeline->lines + y % pipeline->num_lines;
+    line->status = cupsRasterReadPixels(pipeline->ras, line->pixels,
+                                        pipeline->header->cupsBytesPerLine) != 0;
+
+    pthread_mutex_lock(&(pipeline->mutex));
+    pipeline->read = y + 1;
+    pthread_cond_signal(&(pipeline->separate_cond));
+    pthread_mutex_unlock(&(pipeline->mutex));
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'SeparateThread()' - Color separate and dither the lines of a page.
+ */
+
+static void *				/* O - Thread exit status */
+SeparateThread(void *data)		/* I - Pipeline */
+{
+  cups_pipeline_t *pipeline = (cups_pipeline_t *)data;
+					/* Pipeline */
+  cups_line_t	*line;			/* Current line */
+  int		y;			/* Current scanline */
+
+
+  for (y = 0; y < pipeline->header->cupsHeight; y ++)
+  {
+   /*
+    * Wait for the reader...
+    */
+
+    pthread_mutex_lock(&(pipeline->mutex));
+
+    while (!pipeline->stop && pipeline->read <= y)
+      pthread_cond_wait(&(pipeline->separate_cond), &(pipeline->mutex));
+
+    if (pipeline->stop)
+    {
+      pthread_mutex_unlock(&(pipeline->mutex));
+      break;
+    }
+
+    pthread_mutex_unlock(&(pipeline->mutex));
+
+    line = pipeline->lines + y % pipeline->num_lines;
+
+    if (line->status)
+      SeparateLine(pipeline->header, line->pixels, line->outputs);
+
+    pthread_mutex_lock(&(pipeline->mutex));
+    pipeline->separated = y + 1;
+    pthread_cond_signal(&(pipeline->write_cond));
+    pthread_mutex_unlock(&(pipeline->mutex));
+  }
+
+  return (NULL);
+}
+#endif /* HAVE_PTHREAD_H */
+
+
 /*
  * 'main()' - Main entry and processing of driver.
  */
@@ -1751,9 +2147,11 @@ main(int  argc,				/* I - Number of command-line arguments */
   cups_page_header2_t	header;		/* Page header from file */
   int			page;		/* Current page */
   int			y;		/* Current line */
+  int			pipelined;	/* Using the pipeline threads? */
   ppd_file_t		*ppd;		/* PPD file */
   int			num_options;	/* Number of options */
   cups_option_t		*options;	/* Options */
+  const char		*val;		/* Option value */
 #if defined(HAVE_SIGACTION) && !defined(HAVE_SIGSET)
   struct sigaction action;		/* Actions for POSIX signals */
 #endif /* HAVE_SIGACTION && !HAVE_SIGSET */
@@ -1778,6 +2176,24 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   num_options = cupsParseOptions(argv[5], 0, &options);
 
+ /*
+  * "rastertoescpx-threads=N" sets the number of threads; 1, the default,
+  * processes each line on the main thread, 2 or 3 read and separate the
+  * raster in a pipeline, and more also dither the color planes in
+  * parallel...
+  */
+
+  if ((val = cupsGetOption("rastertoescpx-threads", num_options,
+                           options)) != NULL)
+    PipelineThreads = atoi(val);
+  else
+    PipelineThreads = 1;
+
+  if (PipelineThreads < 1)
+    PipelineThreads = 1;
+  else if (PipelineThreads > 16)
+    PipelineThreads = 16;
+
  /*
   * Open the PPD file...
   */
@@ -1865,6 +2281,8 @@ main(int  argc,				/* I - Number of command-line arguments */
 
     StartPage(ppd, &header);
 
+    pipelined = StartPipeline(ras, &header);
+
     for (y = 0; y < header.cupsHeight; y ++)
     {
      /*
@@ -1886,9 +2304,14 @@ main(int  argc,				/* I - Number of command-line arguments */
       * Read and write a line of graphics or whitespace...
       */
 
-      ProcessLine(ppd, ras, &header, y);
+      if (pipelined)
+        WritePipelineLine(ppd, &header, y);
+      else
+        ProcessLine(ppd, ras, &header, y);
     }
 
+    EndPipeline(Pipeline);
+
    /*
     * Eject the page...
     */
@@ -1903,6 +2326,8 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   Shutdown(ppd);
 
+  cupsDitherPoolDelete(DitherPool);
+
   cupsFreeOptions(num_options, options);
 
   cupsRasterClose(ras);
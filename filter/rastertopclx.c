@@ -19,6 +19,7 @@
  *   EndPage()      - Finish a page of graphics.
  *   Shutdown()     - Shutdown a printer.
  *   CancelJob()    - Cancel the current job...
+ *   EncodeData()   - Encode a line of graphics with one compression mode.
  *   CompressData() - Compress a line of graphics.
  *   OutputLine()   - Output the specified number of lines of graphics.
  *   ReadLine()     - Read graphics from the page stream.
@@ -59,18 +60,25 @@ unsigned char	*PixelBuffer,		/* Pixel buffer */
 		*OutputBuffers[6],	/* Output buffers */
 		*DotBuffers[6],		/* Bit buffers */
 		*CompBuffer,		/* Compression buffer */
-		*SeedBuffer,		/* Mode 3 seed buffers */
+		*SeedBuffer,		/* Mode 3/9 seed buffers */
 		BlankValue;		/* The blank value */
 short		*InputBuffer;		/* Color separation buffer */
 cups_lut_t	*DitherLuts[6];		/* Lookup tables for dithering */
 cups_dither_t	*DitherStates[6];	/* Dither state tables */
+cups_dither_pool_t *DitherPool;		/* Threads for dithering planes */
 int		PrinterPlanes,		/* Number of color planes */
 		SeedInvalid,		/* Contents of seed buffer invalid? */
 		DotBits[6],		/* Number of bits per color */
 		DotBufferSizes[6],	/* Size of one row of color dots */
 		DotBufferSize,		/* Size of complete line */
 		OutputFeed,		/* Number of lines to skip */
+		Compression,		/* Compression mode, -1 for automatic */
+		CompModes,		/* Bitmask of modes tried by automatic */
+		CompMode,		/* Mode last sent with ESC * b # M */
+		CompRows[10],		/* Rows sent with each mode */
 		Page;			/* Current page number */
+long		PageBytesIn,		/* Raster bytes on the current page */
+		PageBytesOut;		/* Bytes sent for the current page */
 pcl_output_t	OutputMode;		/* Output mode - see OUTPUT_ consts */
 const int	ColorOrders[7][7] =	/* Order of color planes */
 		{
@@ -97,6 +105,8 @@ void	Shutdown(ppd_file_t *ppd, int job_id, const char *user,
 	         const char *title, int num_options, cups_option_t *options);
 
 void	CancelJob(int sig);
+int	EncodeData(unsigned char *line, int length, int plane, int type,
+	           unsigned char *buffer, unsigned char **data);
 void	CompressData(unsigned char *line, int length, int plane, int pend,
 	             int type);
 void	OutputLine(ppd_file_t *ppd, cups_page_header2_t *header);
@@ -122,6 +132,8 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
   int		cm_disabled;	/* Device Color Inhibited */
   char		s[255];			/* Temporary value */
   const char	*colormodel;		/* Color model string */
+  const char	*val;			/* Option value */
+  char		*ptr;			/* Pointer into option value */
   char		resolution[PPD_MAX_NAME],
 					/* Resolution string */
 		spec[PPD_MAX_NAME];	/* PPD attribute name */
@@ -446,6 +458,24 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
       if (!DitherLuts[plane])
 	DitherLuts[plane] = cupsLutNew(2, default_lut);
     }
+
+   /*
+    * The "rastertopclx-threads" option or cupsPCLThreads attribute lets
+    * up to one thread per plane dither the color planes of a line in
+    * parallel.  The default of 1 dithers them one after the other on the
+    * main thread with the same random sequence as cupsDitherLine()...
+    */
+
+    if (!DitherPool && PrinterPlanes > 1)
+    {
+      if ((val = cupsGetOption("rastertopclx-threads", num_options,
+                               options)) == NULL &&
+          ppd && (attr = ppdFindAttr(ppd, "cupsPCLThreads", NULL)) != NULL)
+        val = attr->value;
+
+      if (val && (i = atoi(val)) > 1)
+        DitherPool = cupsDitherPoolNew(i < PrinterPlanes ? i : PrinterPlanes);
+    }
   }
 
   fprintf(stderr, "DEBUG: PrinterPlanes = %d\n", PrinterPlanes);
@@ -787,8 +817,64 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
   printf("\033*r%dT", header->cupsHeight);
   printf("\033*r1A");
 
-  if (header->cupsCompression && header->cupsCompression != 10)
-    printf("\033*b%dM", header->cupsCompression);
+ /*
+  * Choose the compression mode(s).  The "rastertopclx-compression" option
+  * or cupsPCLCompression attribute can list several modes ("2,3,9"), in
+  * which case each row is sent with whichever of them is smallest, or
+  * "auto" for modes 0 to 3, which every PCL 5 printer understands.  Mode 10
+  * and the format 6 configure raster data command fix the mode for the
+  * whole page...
+  */
+
+  Compression = header->cupsCompression;
+  CompModes   = 0;
+  CompMode    = -1;
+
+  if ((val = cupsGetOption("rastertopclx-compression", num_options,
+                           options)) == NULL &&
+      ppd && (attr = ppdFindAttr(ppd, "cupsPCLCompression", NULL)) != NULL)
+    val = attr->value;
+
+  if (val && header->cupsCompression != 10 &&
+      !(OutputMode == OUTPUT_RGB && ppd &&
+        (ppd->model_number & PCL_RASTER_CRD)))
+  {
+    if (!strcasecmp(val, "auto"))
+      CompModes = 0x0f;
+    else
+    {
+      for (ptr = (char *)val; *ptr;)
+      {
+	if (!isdigit(*ptr & 255))
+	{
+	  ptr ++;
+	  continue;
+	}
+
+	i = strtol(ptr, &ptr, 10);
+
+	if ((i >= 0 && i <= 3) || i == 9)
+	  CompModes |= 1 << i;
+      }
+    }
+
+    if (CompModes & (CompModes - 1))
+      Compression = -1;
+    else if (CompModes)
+    {
+      for (Compression = 0; !(CompModes & (1 << Compression)); Compression ++);
+    }
+  }
+
+  fprintf(stderr, "DEBUG: Compression = %d, CompModes = 0x%x\n", Compression,
+          CompModes);
+
+  if (Compression > 0 && Compression != 10)
+    printf("\033*b%dM", Compression);
+
+  memset(CompRows, 0, sizeof(CompRows));
+  PageBytesIn  = 0;
+  PageBytesOut = 0;
 
   OutputFeed = 0;
 
@@ -820,10 +906,12 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
       DotBuffers[plane] = DotBuffers[plane - 1] + DotBufferSizes[plane - 1];
   }
 
-  if (header->cupsCompression)
+  if (Compression < 0)
+    CompBuffer = malloc(DotBufferSize * 8);
+  else if (Compression)
     CompBuffer = malloc(DotBufferSize * 4);
 
-  if (header->cupsCompression >= 3)
+  if (Compression < 0 || Compression >= 3)
     SeedBuffer = malloc(DotBufferSize);
 
   SeedInvalid = 1;
@@ -841,8 +929,24 @@ EndPage(ppd_file_t         *ppd,	/* I - PPD file */
         cups_page_header2_t *header)	/* I - Page header */
 {
   int	plane;				/* Current plane */
+  int	mode;				/* Compression mode */
 
 
+ /*
+  * Log how well the page compressed...
+  */
+
+  fprintf(stderr, "DEBUG: Page %d: %ld bytes of raster data sent as %ld "
+                  "bytes.\n", Page, PageBytesIn, PageBytesOut);
+
+  if (Compression < 0)
+  {
+    for (mode = 0; mode < 10; mode ++)
+      if (CompRows[mode])
+	fprintf(stderr, "DEBUG: Page %d: %d rows sent with mode %d.\n", Page,
+	        CompRows[mode], mode);
+  }
+
  /*
   * End graphics mode...
   */
@@ -891,10 +995,10 @@ EndPage(ppd_file_t         *ppd,	/* I - PPD file */
     }
   }
 
-  if (header->cupsCompression)
+  if (Compression)
     free(CompBuffer);
 
-  if (header->cupsCompression >= 3)
+  if (Compression < 0 || Compression >= 3)
     free(SeedBuffer);
 }
 
@@ -961,20 +1065,25 @@ CancelJob(int sig)			/* I - Signal */
 
 
 /*
- * 'CompressData()' - Compress a line of graphics.
+ * 'EncodeData()' - Encode a line of graphics with one compression mode.
+ *
+ * The seed buffer is only read; CompressData() updates it once the line
+ * has been sent.
  */
 
-void
-CompressData(unsigned char *line,	/* I - Data to compress */
-             int           length,	/* I - Number of bytes */
-	     int           plane,	/* I - Color plane */
-	     int           pend,	/* I - End character for data */
-	     int           type)	/* I - Type of compression */
+int					/* O - Number of bytes of encoded data */
+EncodeData(unsigned char *line,		/* I - Data to compress */
+           int           length,	/* I - Number of bytes */
+	   int           plane,		/* I - Color plane */
+	   int           type,		/* I - Type of compression */
+	   unsigned char *buffer,	/* I - Compression buffer */
+	   unsigned char **data)	/* O - Encoded data */
 {
   unsigned char	*line_ptr,		/* Current byte pointer */
         	*line_end,		/* End-of-line byte pointer */
         	*comp_ptr,		/* Pointer into compression buffer */
         	*start,			/* Start of compression sequence */
+        	*next,			/* End of literal sequence */
 		*seed;			/* Seed buffer pointer */
   int           count,			/* Count of bytes for output */
 		offset,			/* Offset of bytes for output */
@@ -986,16 +1095,12 @@ CompressData(unsigned char *line,	/* I - Data to compress */
   {
     default :
        /*
-	* Do no compression; with a mode-0 only printer, we can compress blank
-	* lines...
+	* Do no compression; with a mode-0 only printer, we can still drop
+	* trailing blank bytes, which the printer fills with zeros...
 	*/
 
 	line_ptr = line;
-
-        if (cupsCheckBytes(line, length))
-          line_end = line;		/* Blank line */
-        else
-	  line_end = line + length;	/* Non-blank line */
+	line_end = line + cupsCheckLast(line, length, 0) + 1;
 	break;
 
     case 1 :
@@ -1004,7 +1109,7 @@ CompressData(unsigned char *line,	/* I - Data to compress */
         */
 
 	line_end = line + length;
-	for (line_ptr = line, comp_ptr = CompBuffer;
+	for (line_ptr = line, comp_ptr = buffer;
 	     line_ptr < line_end;
 	     comp_ptr += 2, line_ptr += count)
 	{
@@ -1018,7 +1123,7 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 	  comp_ptr[1] = line_ptr[0];
 	}
 
-        line_ptr = CompBuffer;
+        line_ptr = buffer;
         line_end = comp_ptr;
 	break;
 
@@ -1029,7 +1134,7 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 
 	line_ptr = line;
 	line_end = line + length;
-	comp_ptr = CompBuffer;
+	comp_ptr = buffer;
 
 	while (line_ptr < line_end)
 	{
@@ -1087,7 +1192,7 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 	  }
 	}
 
-        line_ptr = CompBuffer;
+        line_ptr = buffer;
         line_end = comp_ptr;
 	break;
 
@@ -1099,7 +1204,7 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 	line_ptr = line;
 	line_end = line + length;
 
-	comp_ptr = CompBuffer;
+	comp_ptr = buffer;
 	seed     = SeedBuffer + plane * length;
 
 	while (line_ptr < line_end)
@@ -1129,8 +1234,8 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 	    * The seed buffer is valid, so compare against it...
 	    */
 
-            while (*line_ptr == *seed &&
-                   line_ptr < line_end)
+            while (line_ptr < line_end &&
+                   *line_ptr == *seed)
             {
               line_ptr ++;
               seed ++;
@@ -1147,8 +1252,8 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 
             start = line_ptr;
             count = 0;
-            while (*line_ptr != *seed &&
-                   line_ptr < line_end &&
+            while (line_ptr < line_end &&
+                   *line_ptr != *seed &&
                    count < 8)
             {
               line_ptr ++;
@@ -1192,10 +1297,153 @@ CompressData(unsigned char *line,	/* I - Data to compress */
           comp_ptr += count;
         }
 
-	line_ptr = CompBuffer;
+	line_ptr = buffer;
 	line_end = comp_ptr;
+	break;
+
+    case 9 :
+       /*
+	* Do compressed replacement delta-row compression...
+	*/
+
+	line_ptr = line;
+	line_end = line + length;
+
+	comp_ptr = buffer;
+	seed     = SeedBuffer + plane * length;
+
+	while (line_ptr < line_end)
+        {
+         /*
+          * Find the next non-matching sequence; if the seed buffer is
+	  * invalid, the rest of the line is replaced...
+          */
+
+          start = line_ptr;
+
+	  if (!SeedInvalid)
+	  {
+            while (line_ptr < line_end &&
+	           *line_ptr == *seed)
+            {
+              line_ptr ++;
+              seed ++;
+            }
+
+            if (line_ptr == line_end)
+              break;
+	  }
+
+          offset = line_ptr - start;
+	  start  = line_ptr;
+
+	  if (SeedInvalid)
+	    line_ptr = line_end;
+	  else
+	  {
+            while (line_ptr < line_end &&
+	           *line_ptr != *seed)
+            {
+              line_ptr ++;
+              seed ++;
+            }
+	  }
+
+         /*
+	  * Send the changed bytes as runs of 3 or more repeated bytes and
+	  * literal sequences; only the first command carries the offset...
+	  */
+
+	  while (start < line_ptr)
+	  {
+	    for (count = 1;
+	         (start + count) < line_ptr && start[count] == start[0];
+		 count ++);
+
+	    if (count >= 3)
+	    {
+	     /*
+	      * Repeated sequence, command byte is:
+	      *
+	      *     1 OFF OFF CNT CNT CNT CNT CNT
+	      *
+	      * with the count minus 2; offset 3 and count 31 are followed
+	      * by extra bytes, each byte == 255 until the last one...
+	      */
+
+	      temp = count - 2;
+
+	      *comp_ptr++ = 0x80 | ((offset < 3 ? offset : 3) << 5) |
+	                    (temp < 31 ? temp : 31);
 
-        memcpy(SeedBuffer + plane * length, line, length);
+	      if (offset >= 3)
+	      {
+		for (offset -= 3; offset >= 255; offset -= 255)
+		  *comp_ptr++ = 255;
+
+		*comp_ptr++ = offset;
+	      }
+
+	      if (temp >= 31)
+	      {
+		for (temp -= 31; temp >= 255; temp -= 255)
+		  *comp_ptr++ = 255;
+
+		*comp_ptr++ = temp;
+	      }
+
+	      *comp_ptr++ = start[0];
+	    }
+	    else
+	    {
+	     /*
+	      * Literal sequence up to the next repeated one, command byte is:
+	      *
+	      *     0 OFF OFF OFF OFF CNT CNT CNT
+	      *
+	      * with the count minus 1; offset 15 and count 7 are followed
+	      * by extra bytes as above, then the replacement bytes...
+	      */
+
+	      for (next = start + 1;
+	           next < line_ptr &&
+		       ((next + 2) >= line_ptr || next[0] != next[1] ||
+			next[1] != next[2]);
+		   next ++);
+
+	      count = next - start;
+	      temp  = count - 1;
+
+	      *comp_ptr++ = ((offset < 15 ? offset : 15) << 3) |
+	                    (temp < 7 ? temp : 7);
+
+	      if (offset >= 15)
+	      {
+		for (offset -= 15; offset >= 255; offset -= 255)
+		  *comp_ptr++ = 255;
+
+		*comp_ptr++ = offset;
+	      }
+
+	      if (temp >= 7)
+	      {
+		for (temp -= 7; temp >= 255; temp -= 255)
+		  *comp_ptr++ = 255;
+
+		*comp_ptr++ = temp;
+	      }
+
+	      memcpy(comp_ptr, start, count);
+	      comp_ptr += count;
+	    }
+
+	    start  += count;
+	    offset = 0;
+	  }
+        }
+
+	line_ptr = buffer;
+	line_end = comp_ptr;
 	break;
 
     case 10 :
@@ -1206,7 +1454,7 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 	line_ptr = line;
 	line_end = line + length;
 
-	comp_ptr = CompBuffer;
+	comp_ptr = buffer;
 	seed     = SeedBuffer;
 
         if (PrinterPlanes == 1)
@@ -1250,7 +1498,7 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 
 #if 0
             fprintf(stderr, "DEBUG: offset=%d, count=%d, comp_ptr=%p(%d of %d)...\n",
-	            offset, count, comp_ptr, comp_ptr - CompBuffer,
+	            offset, count, comp_ptr, comp_ptr - buffer,
 		    BytesPerLine * 5);
 #endif /* 0 */
 
@@ -1540,19 +1788,104 @@ CompressData(unsigned char *line,	/* I - Data to compress */
           }
         }
 
-	line_ptr = CompBuffer;
+	line_ptr = buffer;
 	line_end = comp_ptr;
-
-        memcpy(SeedBuffer, line, length);
 	break;
   }
 
+  *data = line_ptr;
+
+  return ((int)(line_end - line_ptr));
+}
+
+
+/*
+ * 'CompressData()' - Compress a line of graphics.
+ *
+ * A negative type tries every mode in CompModes and sends the smallest
+ * result, counting the ESC * b # M needed to switch modes.
+ */
+
+void
+CompressData(unsigned char *line,	/* I - Data to compress */
+             int           length,	/* I - Number of bytes */
+	     int           plane,	/* I - Color plane */
+	     int           pend,	/* I - End character for data */
+	     int           type)	/* I - Type of compression */
+{
+  unsigned char	*data,			/* Encoded data */
+		*buffer,		/* Buffer for next candidate */
+		*best_data;		/* Smallest encoded data */
+  int		bytes,			/* Encoded size */
+		mode,			/* Current candidate */
+		best_bytes,		/* Smallest encoded size */
+		best_mode;		/* Mode with smallest size */
+
+
+  if (type < 0)
+  {
+    buffer     = CompBuffer;
+    best_data  = NULL;
+    best_bytes = 0;
+    best_mode  = -1;
+
+    for (mode = 0; mode < 10; mode ++)
+    {
+      if (!(CompModes & (1 << mode)))
+        continue;
+
+      bytes = EncodeData(line, length, plane, mode, buffer, &data);
+
+      if (best_mode < 0 ||
+          (bytes + (mode != CompMode ? 5 : 0)) <
+	      (best_bytes + (best_mode != CompMode ? 5 : 0)))
+      {
+        best_data  = data;
+	best_bytes = bytes;
+	best_mode  = mode;
+
+       /*
+        * Keep the winner and encode the next candidate into the other half
+	* of the compression buffer...
+	*/
+
+        if (data == buffer)
+	  buffer = (buffer == CompBuffer) ? CompBuffer + 4 * DotBufferSize :
+	                                    CompBuffer;
+      }
+    }
+
+    if (best_mode != CompMode)
+    {
+      printf("\033*b%dM", best_mode);
+      CompMode = best_mode;
+    }
+
+    CompRows[best_mode] ++;
+
+    data  = best_data;
+    bytes = best_bytes;
+  }
+  else
+    bytes = EncodeData(line, length, plane, type, CompBuffer, &data);
+
  /*
   * Set the length of the data and write a raster plane...
   */
 
-  printf("\033*b%d%c", (int)(line_end - line_ptr), pend);
-  cupsWritePrintData(line_ptr, line_end - line_ptr);
+  printf("\033*b%d%c", bytes, pend);
+  cupsWritePrintData(data, bytes);
+
+  PageBytesIn  += length;
+  PageBytesOut += bytes;
+
+ /*
+  * Delta row modes compare the next line against this one, whatever mode
+  * this line was sent with...
+  */
+
+  if (type < 0 || type >= 3)
+    memcpy(SeedBuffer + plane * length, line, length);
 }
 
 
@@ -1579,7 +1912,7 @@ OutputLine(ppd_file_t         *ppd,	/* I - PPD file */
 
   if (OutputFeed > 0)
   {
-    if (header->cupsCompression < 3)
+    if (Compression >= 0 && Compression < 3)
     {
      /*
       * Send blank raster lines...
@@ -1619,7 +1952,7 @@ OutputLine(ppd_file_t         *ppd,	/* I - PPD file */
 
 	  CompressData(PixelBuffer + i * bytes, bytes, plane,
 	               (i < (PrinterPlanes - 1)) ? 'V' : 'W',
-		       header->cupsCompression);
+		       Compression);
         }
         break;
 
@@ -1638,7 +1971,7 @@ OutputLine(ppd_file_t         *ppd,	/* I - PPD file */
 
 	  CompressData(PixelBuffer + i * bytes, bytes, plane,
 	               (i < (PrinterPlanes - 1)) ? 'V' : 'W',
-		       header->cupsCompression);
+		       Compression);
         }
         break;
 
@@ -1660,7 +1993,7 @@ OutputLine(ppd_file_t         *ppd,	/* I - PPD file */
 	*/
 
 	CompressData(PixelBuffer, header->cupsBytesPerLine, 0, 'W',
-	             header->cupsCompression);
+	             Compression);
         break;
 
     default :
@@ -1681,7 +2014,7 @@ OutputLine(ppd_file_t         *ppd,	/* I - PPD file */
             CompressData(ptr, bytes, j,
 	                 i == (PrinterPlanes - 1) &&
 			     bit == DotBits[plane] ? 'W' : 'V',
-			 header->cupsCompression);
+			 Compression);
           }
 	}
 	break;
@@ -1703,8 +2036,7 @@ int					/* O - Number of lines (0 if blank) */
 ReadLine(cups_raster_t      *ras,	/* I - Raster stream */
          cups_page_header2_t *header)	/* I - Page header */
 {
-  int	plane,				/* Current color plane */
-	width;				/* Width of line */
+  int	width;				/* Width of line */
 
 
  /*
@@ -1777,9 +2109,8 @@ ReadLine(cups_raster_t      *ras,	/* I - Raster stream */
   * Dither the pixels...
   */
 
-  for (plane = 0; plane < PrinterPlanes; plane ++)
-    cupsDitherLine(DitherStates[plane], DitherLuts[plane], InputBuffer + plane,
-                   PrinterPlanes, OutputBuffers[plane]);
+  cupsDitherLines(DitherPool, DitherStates, DitherLuts, InputBuffer,
+                  PrinterPlanes, OutputBuffers);
 
  /*
   * Return 1 to indicate that we have non-blank output...
@@ -1954,6 +2285,8 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   Shutdown(ppd, job_id, argv[2], argv[3], num_options, options);
 
+  cupsDitherPoolDelete(DitherPool);
+
   cupsFreeOptions(num_options, options);
 
   cupsRasterClose(ras);
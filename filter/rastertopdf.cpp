@@ -38,6 +38,13 @@
 #include <arpa/inet.h>   // ntohl
 
 #include <vector>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <zlib.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif // HAVE_PTHREAD_H
 #include <qpdf/QPDF.hh>
 #include <qpdf/QPDFWriter.hh>
 #include <qpdf/QUtil.hh>
@@ -45,6 +52,8 @@
 #include <qpdf/Pl_Flate.hh>
 #include <qpdf/Pl_Buffer.hh>
 
+#include "imagespool.h"
+
 #ifdef USE_LCMS1
 #include <lcms.h>
 #define cmsColorSpaceSignature icColorSpaceSignature
@@ -104,6 +113,8 @@ int                 cm_disabled = 0;         // Flag rasied if color management
 cm_calibration_t    cm_calibrate;            // Status of CUPS color management ("on" or "off")
 convertFunction     conversion_function;     // Raster color conversion function
 bitFunction         bit_function;            // Raster bit function
+int                 deflate_level = Z_DEFAULT_COMPRESSION; // Flate level of page images
+int                 deflate_threads = 1;     // Threads compressing page images
 
 
 #ifdef USE_LCMS1
@@ -193,6 +204,275 @@ void die(const char * str)
 }
 
 
+//------------- Image spool ---------------
+
+class PageSpool : public SpoolProvider
+{
+public:
+    PageSpool() : SpoolProvider(PROGRAM) {}
+    // append already compressed data for stream to the spool
+    void add(QPDFObjectHandle stream, const std::string &data);
+};
+
+void PageSpool::add(QPDFObjectHandle stream, const std::string &data)
+{
+    FILE * spool = begin();
+
+    if (fwrite(data.data(), 1, data.size(), spool) != data.size() || fflush(spool) != 0)
+        die("Unable to spool image data");
+
+    end(stream);
+}
+
+//------------- Parallel page compression ---------------
+
+// The page image is deflated in strips of lines while the raster is still
+// being read.  Each strip is compressed on its own into raw deflate data
+// ending on a byte boundary (Z_SYNC_FLUSH, Z_FINISH for the last one), so
+// the strips can simply be concatenated behind a zlib header and followed
+// by the combined Adler-32 checksum.  The result is a normal FlateDecode
+// stream.
+class StripDeflater
+{
+public:
+    StripDeflater(int level, int num_threads);
+    ~StripDeflater();
+
+    // page must stay valid until finish() returns
+    void start(const unsigned char *page, unsigned line_bytes, unsigned height);
+    void line_done(unsigned line_n);
+    // waits for all strips and returns the complete zlib stream
+    void finish(std::string &out);
+
+    long long bytes_in, bytes_out;  // totals over all pages
+private:
+    struct strip {
+        size_t start, len;
+        unsigned lines_left;
+        bool queued, done;
+        uLong adler;
+        std::string out;
+    };
+
+    void queue(size_t index);
+    void compress(size_t index);
+    void wait();
+#ifdef HAVE_PTHREAD_H
+    static void *worker(void *arg);
+#endif
+
+    int level;
+    const unsigned char *page;
+    unsigned strip_lines;
+    std::vector<strip> strips;
+#ifdef HAVE_PTHREAD_H
+    std::vector<pthread_t> threads;
+    std::deque<size_t> todo;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond, done_cond;
+    bool quit;
+#endif
+};
+
+StripDeflater::StripDeflater(int level, int num_threads)
+    : bytes_in(0), bytes_out(0),
+      level(level), page(NULL), strip_lines(0)
+{
+#ifdef HAVE_PTHREAD_H
+    quit = false;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&work_cond, NULL);
+    pthread_cond_init(&done_cond, NULL);
+
+    // with a single thread the reading thread compresses the strips itself
+    for (int i = 0; num_threads > 1 && i < num_threads; i++)
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, worker, this) != 0)
+            break;
+        threads.push_back(thread);
+    }
+#else
+    (void)num_threads;
+#endif
+}
+
+StripDeflater::~StripDeflater()
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < threads.size(); i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&work_cond);
+    pthread_cond_destroy(&done_cond);
+#endif
+}
+
+void StripDeflater::start(const unsigned char *page, unsigned line_bytes, unsigned height)
+{
+    unsigned nstrips;
+
+    wait(); // the workers may still be busy with an abandoned page
+
+    // roughly 256k per strip: large enough to compress well, small enough
+    // to keep all threads busy on a single page
+    strip_lines = line_bytes ? (256 * 1024 + line_bytes - 1) / line_bytes : 1;
+    nstrips = height ? (height + strip_lines - 1) / strip_lines : 1;
+
+    this->page = page;
+    strips.clear();
+    strips.resize(nstrips);
+    for (unsigned i = 0; i < nstrips; i++)
+    {
+        unsigned lines = std::min(strip_lines, height - i * strip_lines);
+
+        strips[i].start = (size_t)i * strip_lines * line_bytes;
+        strips[i].len = (size_t)lines * line_bytes;
+        strips[i].lines_left = lines;
+        strips[i].queued = false;
+        strips[i].done = false;
+    }
+}
+
+void StripDeflater::line_done(unsigned line_n)
+{
+    size_t index = line_n / strip_lines;
+
+    if (index < strips.size() && strips[index].lines_left > 0 &&
+        --strips[index].lines_left == 0)
+        queue(index);
+}
+
+void StripDeflater::queue(size_t index)
+{
+    strips[index].queued = true;
+
+#ifdef HAVE_PTHREAD_H
+    if (!threads.empty())
+    {
+        pthread_mutex_lock(&mutex);
+        todo.push_back(index);
+        pthread_cond_signal(&work_cond);
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+#endif
+
+    compress(index);
+    strips[index].done = true;
+}
+
+void StripDeflater::compress(size_t index)
+{
+    strip &s = strips[index];
+    z_stream z;
+    size_t have = 0;
+
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        die("Unable to initialize compression");
+
+    s.out.resize(deflateBound(&z, s.len) + 16);
+    z.next_in = (Bytef *)(page + s.start);
+    z.avail_in = s.len;
+
+    for (;;)
+    {
+        z.next_out = (Bytef *)&s.out[have];
+        z.avail_out = s.out.size() - have;
+        deflate(&z, (index + 1 == strips.size()) ? Z_FINISH : Z_SYNC_FLUSH);
+        have = s.out.size() - z.avail_out;
+
+        if (z.avail_out > 0 && z.avail_in == 0)
+            break;
+        s.out.resize(s.out.size() * 2);
+    }
+
+    deflateEnd(&z);
+    s.out.resize(have);
+    s.adler = adler32(adler32(0L, Z_NULL, 0), page + s.start, s.len);
+}
+
+#ifdef HAVE_PTHREAD_H
+void *StripDeflater::worker(void *arg)
+{
+    StripDeflater *self = (StripDeflater *)arg;
+    size_t index;
+
+    pthread_mutex_lock(&self->mutex);
+    for (;;)
+    {
+        while (!self->quit && self->todo.empty())
+            pthread_cond_wait(&self->work_cond, &self->mutex);
+        if (self->todo.empty())
+            break;
+
+        index = self->todo.front();
+        self->todo.pop_front();
+        pthread_mutex_unlock(&self->mutex);
+
+        self->compress(index);
+
+        pthread_mutex_lock(&self->mutex);
+        self->strips[index].done = true;
+        pthread_cond_broadcast(&self->done_cond);
+    }
+    pthread_mutex_unlock(&self->mutex);
+
+    return NULL;
+}
+#endif
+
+void StripDeflater::wait()
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&mutex);
+    for (size_t i = 0; i < strips.size(); i++)
+        while (strips[i].queued && !strips[i].done)
+            pthread_cond_wait(&done_cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void StripDeflater::finish(std::string &out)
+{
+    int flevel = (level < 0) ? 6 : level;
+    unsigned char header[2] = { 0x78, 0 };
+    uLong adler = adler32(0L, Z_NULL, 0);
+
+    // strips that never got all of their lines
+    for (size_t i = 0; i < strips.size(); i++)
+        if (!strips[i].queued)
+            queue(i);
+
+    wait();
+
+    // zlib header: 32k window, compression level hint, FCHECK
+    header[1] = (flevel < 2 ? 0 : flevel < 6 ? 1 : flevel == 6 ? 2 : 3) << 6;
+    header[1] += 31 - (header[0] * 256 + header[1]) % 31;
+
+    out.assign((const char *)header, 2);
+    for (size_t i = 0; i < strips.size(); i++)
+    {
+        out.append(strips[i].out);
+        adler = adler32_combine(adler, strips[i].adler, strips[i].len);
+        bytes_in += strips[i].len;
+        std::string().swap(strips[i].out);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((char)((adler >> shift) & 0xff));
+
+    bytes_out += out.size();
+    page = NULL;
+}
+
 //------------- PDF ---------------
 
 struct pdf_info
@@ -203,10 +483,17 @@ struct pdf_info
         line_bytes(0),
         bpp(0), bpc(0), render_intent(""),
         color_space(CUPS_CSPACE_K),
-        page_width(0),page_height(0)
+        page_width(0),page_height(0),
+        spool(NULL),
+        deflater(NULL)
     {
     }
 
+    ~pdf_info()
+    {
+        delete deflater;
+    }
+
     QPDF pdf;
     QPDFObjectHandle page;
     unsigned pagecount;
@@ -219,6 +506,9 @@ struct pdf_info
     cups_cspace_t color_space;
     PointerHolder<Buffer> page_data;
     double page_width,page_height;
+    PageSpool * spool;  // NULL: keep images in memory
+    PointerHolder<QPDFObjectHandle::StreamDataProvider> spool_holder;
+    StripDeflater * deflater;
 };
 
 int create_pdf_file(struct pdf_info * info)
@@ -228,6 +518,17 @@ int create_pdf_file(struct pdf_info * info)
     } catch (...) {
         return 1;
     }
+
+#ifdef PRE_COMPRESS
+    info->deflater = new StripDeflater(deflate_level, deflate_threads);
+
+    info->spool = new PageSpool();
+    info->spool_holder = PointerHolder<QPDFObjectHandle::StreamDataProvider>(info->spool);
+    if (!info->spool->ok()) {
+        fputs("DEBUG: (" PROGRAM ") Unable to create image spool file, keeping pages in memory\n", stderr);
+        info->spool = NULL;
+    }
+#endif
     return 0;
 }
 
@@ -315,7 +616,6 @@ void convertPdf_InvertColors(struct pdf_info * info)
 
 
 
-#define PRE_COMPRESS
 
 // Create an '/ICCBased' array and embed a previously 
 // set ICC Profile in the PDF
@@ -490,7 +790,7 @@ QPDFObjectHandle getCalGrayArray(double wp[3], double gamma[1], double bp[3])
     return ret;
 }
 
-QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<Buffer> page_data, unsigned width, 
+QPDFObjectHandle makeImage(QPDF &pdf, struct pdf_info * info, PointerHolder<Buffer> page_data, unsigned width, 
                            unsigned height, std::string render_intent, cups_cspace_t cs, unsigned bpc)
 {
     QPDFObjectHandle ret = QPDFObjectHandle::newStream(&pdf);
@@ -623,14 +923,22 @@ QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<Buffer> page_data, unsigned
     ret.replaceDict(QPDFObjectHandle::newDictionary(dict));
 
 #ifdef PRE_COMPRESS
-    // we deliver already compressed content (instead of letting QPDFWriter do it), to avoid using excessive memory
-    Pl_Buffer psink("psink");
-    Pl_Flate pflate("pflate",&psink,Pl_Flate::a_deflate);
-    
-    pflate.write(page_data->getBuffer(),page_data->getSize());
-    pflate.finish();
+    // we deliver already compressed content (instead of letting QPDFWriter do it), to avoid using excessive memory;
+    // the strips of the page have been compressed in the background while it was read
+    std::string compressed;
+    info->deflater->finish(compressed);
+
+    if (info->spool) {
+        info->spool->add(ret, compressed);
+        ret.replaceStreamData(info->spool_holder,
+                              QPDFObjectHandle::newName("/FlateDecode"),QPDFObjectHandle::newNull());
+        return ret;
+    }
+
+    PointerHolder<Buffer> psink(new Buffer(compressed.size()));
+    memcpy(psink->getBuffer(), compressed.data(), compressed.size());
 
-    ret.replaceStreamData(PointerHolder<Buffer>(psink.getBuffer()),
+    ret.replaceStreamData(psink,
                           QPDFObjectHandle::newName("/FlateDecode"),QPDFObjectHandle::newNull());
 #else
     ret.replaceStreamData(page_data,QPDFObjectHandle::newNull(),QPDFObjectHandle::newNull());
@@ -645,7 +953,7 @@ void finish_page(struct pdf_info * info)
     if(!info->page_data.getPointer())
         return;
 
-    QPDFObjectHandle image = makeImage(info->pdf, info->page_data, info->width, info->height, info->render_intent, info->color_space, info->bpc);
+    QPDFObjectHandle image = makeImage(info->pdf, info, info->page_data, info->width, info->height, info->render_intent, info->color_space, info->bpc);
     if(!image.isInitialized()) die("Unable to load image data");
 
     // add it
@@ -812,6 +1120,9 @@ int add_pdf_page(struct pdf_info * info, int pagen, unsigned width,
             die("Page too big");
         }
         info->page_data = PointerHolder<Buffer>(new Buffer(info->line_bytes*info->height));
+#ifdef PRE_COMPRESS
+        info->deflater->start(info->page_data->getBuffer(), info->line_bytes, info->height);
+#endif
 
         QPDFObjectHandle page = QPDFObjectHandle::parse(
             "<<"
@@ -845,6 +1156,12 @@ int close_pdf_file(struct pdf_info * info)
     try {
         finish_page(info); // any active
 
+        if (info->deflater)
+            fprintf(stderr, "DEBUG: (" PROGRAM ") Compressed %lld bytes of page images to %lld bytes\n",
+                    info->deflater->bytes_in, info->deflater->bytes_out);
+        if (info->spool)
+            fprintf(stderr, "DEBUG: (" PROGRAM ") Spooled %lld bytes of compressed page images\n", info->spool->bytes);
+
         QPDFWriter output(info->pdf,NULL);
 //        output.setMinimumPDFVersion("1.4");
         output.write();
@@ -859,13 +1176,16 @@ void pdf_set_line(struct pdf_info * info, unsigned line_n, unsigned char *line)
 {
     //dprintf("pdf_set_line(%d)\n", line_n);
 
-    if(line_n > info->height)
+    if(line_n >= info->height)
     {
         dprintf("Bad line %d\n", line_n);
         return;
     }
   
     memcpy((info->page_data->getBuffer()+(line_n*info->line_bytes)), line, info->line_bytes);
+#ifdef PRE_COMPRESS
+    info->deflater->line_done(line_n);
+#endif
 }
 
 int convert_raster(cups_raster_t *ras, unsigned width, unsigned height,
@@ -988,6 +1308,7 @@ int main(int argc, char **argv)
     ppd_file_t		*ppd;		/* PPD file */
     int			num_options;	/* Number of options */
     const char*         profile_name;	/* IPP Profile Name */
+    const char*         val;		/* Option value */
     cups_option_t	*options;	/* Options */
 
     // Make sure status messages are not buffered...
@@ -1003,6 +1324,22 @@ int main(int argc, char **argv)
 
     num_options = cupsParseOptions(argv[5], 0, &options);  
 
+    /* "rastertopdf-compression-level=0..9" trades output size for speed,
+       "rastertopdf-threads=N" sets the number of compression threads */
+    if ((val = cupsGetOption("rastertopdf-compression-level", num_options, options)) != NULL)
+    {
+      deflate_level = atoi(val);
+      if (deflate_level < 0 || deflate_level > 9)
+        deflate_level = Z_DEFAULT_COMPRESSION;
+    }
+
+    if ((val = cupsGetOption("rastertopdf-threads", num_options, options)) != NULL)
+      deflate_threads = atoi(val);
+    if (deflate_threads < 1)
+      deflate_threads = 1;
+    else if (deflate_threads > 16)
+      deflate_threads = 16;
+
     /* support the CUPS "cm-calibration" option */ 
     cm_calibrate = cmGetCupsColorCalibrateMode(options, num_options);
 
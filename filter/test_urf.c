@@ -0,0 +1,203 @@
+/*
+ *   URF raster decoder test and benchmark.
+ *
+ *   Usage: test_urf [width height [passes]]
+ *
+ *   A synthetic page (text-like bars, a noisy photo area and blank space)
+ *   is PackBits encoded into a temporary file, decoded with the buffered
+ *   reader, and compared with the original pixels.
+ *
+ *   Copyright 2026 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ */
+
+#include "unirast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define PIXEL_SIZE 3
+
+struct check_t {
+  const uint8_t *page;
+  unsigned width,lines,errors;
+};
+
+static void check_line(void *ctx,unsigned line,const uint8_t *data) // {{{
+{
+  struct check_t *check=(struct check_t *)ctx;
+  const size_t linesize=(size_t)check->width*PIXEL_SIZE;
+
+  if (memcmp(data,check->page+line*linesize,linesize)!=0) {
+    check->errors++;
+  }
+  check->lines++;
+}
+// }}}
+
+static void make_page(uint8_t *page,unsigned width,unsigned height) // {{{
+{
+  unsigned x,y;
+  uint8_t *p=page;
+
+  srand(1);
+  for (y=0;y<height;y++) {
+    for (x=0;x<width;x++,p+=PIXEL_SIZE) {
+      if (y<height/3) { // text-like: runs of black on white, repeated lines
+        const int ink=((x/7)%5==0)&&((y/4)%3!=0);
+        p[0]=p[1]=p[2]=ink?0:255;
+      } else if (y<2*height/3) { // photo: short runs and noise
+        p[0]=(x*255)/width;
+        p[1]=(y*255)/height;
+        p[2]=(x>width/2)?(uint8_t)rand():(x/3)&0xff;
+      } else { // blank tail with a margin mark
+        p[0]=p[1]=p[2]=(x<8)?0:255;
+      }
+    }
+  }
+}
+// }}}
+
+static void put_byte(FILE *f,int c) // {{{
+{
+  putc(c,f);
+}
+// }}}
+
+// PackBits encoding as produced by AirPrint clients
+static void encode_page(FILE *f,const uint8_t *page,unsigned width,unsigned height) // {{{
+{
+  const size_t linesize=(size_t)width*PIXEL_SIZE;
+  unsigned y=0,x,n,rep;
+
+  while (y<height) {
+    const uint8_t *line=page+y*linesize;
+
+    for (rep=1;(rep<256)&&(y+rep<height)&&
+               (memcmp(line,line+rep*linesize,linesize)==0);rep++) {
+    }
+    put_byte(f,rep-1);
+
+    x=0;
+    while (x<width) {
+      const uint8_t *px=line+x*PIXEL_SIZE;
+
+      // rest of line white?
+      for (n=x;(n<width)&&(memcmp(line+n*PIXEL_SIZE,"\xff\xff\xff",PIXEL_SIZE)==0);n++) {
+      }
+      if (n==width) {
+        put_byte(f,0x80);
+        break;
+      }
+
+      // repeated pixel
+      for (n=1;(n<128)&&(x+n<width)&&
+               (memcmp(px,px+n*PIXEL_SIZE,PIXEL_SIZE)==0);n++) {
+      }
+      if ( (n>1)||(x+1==width) ) {
+        put_byte(f,n-1);
+        fwrite(px,PIXEL_SIZE,1,f);
+        x+=n;
+        continue;
+      }
+
+      // literal run, up to the next repeated pixel
+      for (n=1;(n<128)&&(x+n+1<width)&&
+               (memcmp(px+n*PIXEL_SIZE,px+(n+1)*PIXEL_SIZE,PIXEL_SIZE)!=0);n++) {
+      }
+      put_byte(f,(uint8_t)(1-(int)n));
+      fwrite(px,PIXEL_SIZE,n,f);
+      x+=n;
+    }
+    y+=rep;
+  }
+}
+// }}}
+
+int main(int argc,char **argv)
+{
+  unsigned width=argc>2?atoi(argv[1]):2550,
+           height=argc>2?atoi(argv[2]):3300; // letter, 300 dpi
+  int passes=argc>3?atoi(argv[3]):5,iA;
+  uint8_t *page;
+  FILE *f;
+  long size;
+  double secs=0;
+  struct timeval start,end;
+
+  if ( (width==0)||(height==0)||(passes<1) ) {
+    fprintf(stderr,"Usage: test_urf [width height [passes]]\n");
+    return 1;
+  }
+
+  if ( (page=malloc((size_t)width*height*PIXEL_SIZE))==NULL) {
+    fprintf(stderr,"Unable to allocate page\n");
+    return 1;
+  }
+  make_page(page,width,height);
+
+  if ( (f=tmpfile())==NULL) {
+    fprintf(stderr,"Unable to create temporary file\n");
+    return 1;
+  }
+  encode_page(f,page,width,height);
+  fflush(f);
+  size=ftell(f);
+
+  for (iA=0;iA<passes;iA++) {
+    struct check_t check={page,width,0,0};
+    unirast_reader_t *reader;
+
+    lseek(fileno(f),0,SEEK_SET);
+    if ( (reader=unirast_reader_new(fileno(f)))==NULL) {
+      fprintf(stderr,"Unable to allocate reader\n");
+      return 1;
+    }
+
+    gettimeofday(&start,NULL);
+    if (unirast_decode_raster(reader,width,height,PIXEL_SIZE*8,check_line,&check)!=0) {
+      fprintf(stderr,"FAIL: decoder reported truncated data\n");
+      return 1;
+    }
+    gettimeofday(&end,NULL);
+    secs+=end.tv_sec-start.tv_sec+0.000001*(end.tv_usec-start.tv_usec);
+
+    if ( (check.lines!=height)||(check.errors)||(reader->bytes_read!=size) ) {
+      fprintf(stderr,"FAIL: %u of %u lines decoded, %u differ, %lld of %ld bytes read\n",
+              check.lines,height,check.errors,reader->bytes_read,size);
+      return 1;
+    }
+    unirast_reader_free(reader);
+  }
+
+  // truncated input must be reported, not crash
+  {
+    struct check_t check={page,width,0,0};
+    unirast_reader_t *reader;
+
+    if (ftruncate(fileno(f),size/2)!=0) {
+      return 1;
+    }
+    lseek(fileno(f),0,SEEK_SET);
+    reader=unirast_reader_new(fileno(f));
+    if ( (!reader)||
+         (unirast_decode_raster(reader,width,height,PIXEL_SIZE*8,check_line,&check)==0) ) {
+      fprintf(stderr,"FAIL: truncated data not detected\n");
+      return 1;
+    }
+    unirast_reader_free(reader);
+  }
+
+  printf("%ux%u page, %ld bytes encoded: %.1f MB/s in, %.1f Mpixels/s out\n",
+         width,height,size,
+         secs>0?passes*size/secs/1e6:0.0,
+         secs>0?passes*(double)width*height/secs/1e6:0.0);
+
+  fclose(f);
+  free(page);
+  return 0;
+}
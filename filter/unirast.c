@@ -0,0 +1,201 @@
+/**
+ * This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @brief Buffered UNIRAST (URF) reader and PackBits raster decoder
+ * @file unirast.c
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unirast.h"
+
+#define UNIRAST_BUFSIZE (256 * 1024)
+
+unirast_reader_t *unirast_reader_new(int fd)
+{
+    unirast_reader_t *reader;
+
+    if ((reader = calloc(1, sizeof(unirast_reader_t))) == NULL)
+        return NULL;
+
+    if ((reader->buf = malloc(UNIRAST_BUFSIZE)) == NULL)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    reader->fd = fd;
+    reader->size = UNIRAST_BUFSIZE;
+
+    return reader;
+}
+
+void unirast_reader_free(unirast_reader_t *reader)
+{
+    if (!reader)
+        return;
+
+    free(reader->buf);
+    free(reader);
+}
+
+/* Make sure at least need bytes are buffered; need must not exceed the
+ * buffer size.  Returns 0 on success, -1 on EOF or error.
+ */
+static int fill(unirast_reader_t *reader, size_t need)
+{
+    ssize_t n;
+
+    if (reader->len - reader->pos >= need)
+        return 0;
+
+    // keep the unread tail, refill behind it
+    memmove(reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+    reader->len -= reader->pos;
+    reader->pos = 0;
+
+    while (reader->len < need)
+    {
+        n = read(reader->fd, reader->buf + reader->len, reader->size - reader->len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        reader->len += n;
+        reader->bytes_read += n;
+    }
+
+    return 0;
+}
+
+int unirast_read(unirast_reader_t *reader, void *dst, size_t len)
+{
+    uint8_t *out = dst;
+    size_t chunk;
+
+    while (len > 0)
+    {
+        if (fill(reader, 1) != 0)
+            return -1;
+
+        chunk = reader->len - reader->pos;
+        if (chunk > len)
+            chunk = len;
+
+        memcpy(out, reader->buf + reader->pos, chunk);
+        reader->pos += chunk;
+        out += chunk;
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+int unirast_decode_raster(unirast_reader_t *reader, unsigned width, unsigned height, int bpp,
+                          unirast_line_cb line_cb, void *ctx)
+{
+    // We should be at raster start
+    unsigned cur_line = 0;
+    unsigned pos, n, line_repeat, i;
+    int code;
+    size_t pixel_size = bpp / 8, bytes, done, chunk;
+    uint8_t *line, *dst;
+
+    if (pixel_size == 0 || width == 0 || width > ((size_t)-1) / pixel_size)
+        return 1;
+
+    if ((line = malloc(pixel_size * width)) == NULL)
+        return 1;
+
+    while (cur_line < height)
+    {
+        if (fill(reader, 1) != 0)
+            goto truncated;
+
+        line_repeat = (unsigned)reader->buf[reader->pos++] + 1;
+
+        // Start of line
+        pos = 0;
+
+        while (pos < width)
+        {
+            if (fill(reader, 1) != 0)
+                goto truncated;
+
+            code = (int8_t)reader->buf[reader->pos++];
+
+            if (code == -128)
+            {
+                // blank rest of line
+                memset(line + pos * pixel_size, 0xFF, pixel_size * (width - pos));
+                pos = width;
+            }
+            else if (code >= 0)
+            {
+                // one pixel, repeated code+1 times
+                n = code + 1;
+                if (n > width - pos)
+                    n = width - pos;
+
+                if (fill(reader, pixel_size) != 0)
+                    goto truncated;
+
+                dst = line + pos * pixel_size;
+                memcpy(dst, reader->buf + reader->pos, pixel_size);
+                reader->pos += pixel_size;
+
+                // replicate by doubling the already written run
+                bytes = n * pixel_size;
+                for (done = pixel_size; done < bytes; done += chunk)
+                {
+                    chunk = (done < bytes - done) ? done : bytes - done;
+                    memcpy(dst + done, dst, chunk);
+                }
+
+                pos += n;
+            }
+            else
+            {
+                // -code+1 verbatim pixels; pixels past the end of the line are
+                // not part of this line (the original decoder never read them)
+                n = -code + 1;
+                if (n > width - pos)
+                    n = width - pos;
+
+                bytes = n * pixel_size;
+                if (fill(reader, bytes) != 0)
+                    goto truncated;
+
+                memcpy(line + pos * pixel_size, reader->buf + reader->pos, bytes);
+                reader->pos += bytes;
+                pos += n;
+            }
+        }
+
+        // write lines, but never past the end of the page
+        for (i = 0; i < line_repeat && cur_line < height; i++, cur_line++)
+            line_cb(ctx, cur_line, line);
+    }
+
+    free(line);
+    return 0;
+
+truncated:
+    free(line);
+    return 1;
+}
@@ -59,4 +59,44 @@ enum unirast_bpp_e
     UNIRAST_BPP_64BIT = 64
 };
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Buffered reader for URF streams; all input goes through one large
+ * buffer instead of a read() call per byte.
+ */
+typedef struct unirast_reader_s
+{
+    int fd;
+    uint8_t *buf;
+    size_t size;        /* allocated size of buf */
+    size_t pos;         /* next unread byte */
+    size_t len;         /* valid bytes in buf */
+    long long bytes_read; /* bytes read from fd so far */
+} unirast_reader_t;
+
+/* called once per decoded line, lines are 0-based and below height */
+typedef void (*unirast_line_cb)(void *ctx, unsigned line, const uint8_t *data);
+
+/* returns NULL on error */
+unirast_reader_t *unirast_reader_new(int fd);
+void unirast_reader_free(unirast_reader_t *reader);
+
+/* reads exactly len bytes; returns 0 on success, -1 on EOF or error */
+int unirast_read(unirast_reader_t *reader, void *dst, size_t len);
+
+/* decodes the PackBits raster of one page, calling line_cb for every line;
+ * returns 0 on success, 1 on truncated data
+ */
+int unirast_decode_raster(unirast_reader_t *reader, unsigned width, unsigned height, int bpp,
+                          unirast_line_cb line_cb, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
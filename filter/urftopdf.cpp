@@ -31,14 +31,17 @@
 #include <arpa/inet.h>   // ntohl
 
 #include <vector>
+#include <map>
 #include <qpdf/QPDF.hh>
 #include <qpdf/QPDFWriter.hh>
 #include <qpdf/QUtil.hh>
 
 #include <qpdf/Pl_Flate.hh>
 #include <qpdf/Pl_Buffer.hh>
+#include <qpdf/Pl_StdioFile.hh>
 
 #include "unirast.h"
+#include "imagespool.h"
 
 #define DEFAULT_PDF_UNIT 72   // 1/72 inch
 
@@ -58,6 +61,34 @@ void die(const char * str)
     exit(1);
 }
 
+//------------- Image spool ---------------
+
+class PageSpool : public SpoolProvider
+{
+public:
+    PageSpool() : SpoolProvider(PROGRAM) {}
+    // deflate data into the spool and make it the data of stream
+    void add(QPDFObjectHandle stream, const unsigned char *data, size_t len);
+};
+
+void PageSpool::add(QPDFObjectHandle stream, const unsigned char *data, size_t len)
+{
+    FILE * spool = begin();
+
+    try {
+        Pl_StdioFile pfile("pspool", spool);
+        Pl_Flate pflate("pflate", &pfile, Pl_Flate::a_deflate);
+        pflate.write(const_cast<unsigned char *>(data), len);
+        pflate.finish(); // flushes the spool file, too
+    } catch (...) {
+        die("Unable to spool image data");
+    }
+    if (ferror(spool))
+        die("Unable to spool image data");
+
+    end(stream);
+}
+
 //------------- PDF ---------------
 
 struct pdf_info
@@ -67,7 +98,8 @@ struct pdf_info
         width(0),height(0),
         pixel_bytes(0),line_bytes(0),
         bpp(0),
-        page_width(0),page_height(0)
+        page_width(0),page_height(0),
+        spool(NULL)
     {
     }
 
@@ -81,6 +113,8 @@ struct pdf_info
     unsigned bpp;
     PointerHolder<Buffer> page_data;
     double page_width,page_height;
+    PageSpool * spool;  // NULL: keep images in memory
+    PointerHolder<QPDFObjectHandle::StreamDataProvider> spool_holder;
 };
 
 int create_pdf_file(struct pdf_info * info, unsigned pagecount)
@@ -91,6 +125,15 @@ int create_pdf_file(struct pdf_info * info, unsigned pagecount)
         return 1;
     }
 
+#ifdef PRE_COMPRESS
+    info->spool = new PageSpool();
+    info->spool_holder = PointerHolder<QPDFObjectHandle::StreamDataProvider>(info->spool);
+    if (!info->spool->ok()) {
+        fputs("DEBUG: (" PROGRAM ") Unable to create image spool file, keeping pages in memory\n", stderr);
+        info->spool = NULL;
+    }
+#endif
+
     info->pagecount = pagecount;
 
     return 0;
@@ -112,13 +155,7 @@ enum ColorSpace {
     DEVICE_CMYK
 };
 
-#define PRE_COMPRESS
-/* or temporarily store images?
-    if(cupsTempFile2(tempfile_name, 255) == NULL) die("Unable to create a temporary pdf file");
-    iprintf("Created temporary file '%s'\n", tempfile_name);
-*/
-
-QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<Buffer> page_data, unsigned width, unsigned height, ColorSpace cs, unsigned bpc)
+QPDFObjectHandle makeImage(QPDF &pdf, struct pdf_info * info, PointerHolder<Buffer> page_data, unsigned width, unsigned height, ColorSpace cs, unsigned bpc)
 {
     QPDFObjectHandle ret = QPDFObjectHandle::newStream(&pdf);
 
@@ -144,6 +181,13 @@ QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<Buffer> page_data, unsigned
 
 #ifdef PRE_COMPRESS
     // we deliver already compressed content (instead of letting QPDFWriter do it), to avoid using excessive memory
+    if (info->spool) {
+        info->spool->add(ret, page_data->getBuffer(), page_data->getSize());
+        ret.replaceStreamData(info->spool_holder,
+                              QPDFObjectHandle::newName("/FlateDecode"),QPDFObjectHandle::newNull());
+        return ret;
+    }
+
     Pl_Buffer psink("psink");
     Pl_Flate pflate("pflate",&psink,Pl_Flate::a_deflate);
     
@@ -167,7 +211,7 @@ void finish_page(struct pdf_info * info)
     if(!info->page_data.getPointer())
         return;
 
-    QPDFObjectHandle image = makeImage(info->pdf, info->page_data, info->width, info->height, DEVICE_RGB, 8);
+    QPDFObjectHandle image = makeImage(info->pdf, info, info->page_data, info->width, info->height, DEVICE_RGB, 8);
     if(!image.isInitialized()) die("Unable to load image data");
 
     // add it
@@ -232,6 +276,9 @@ int close_pdf_file(struct pdf_info * info)
     try {
         finish_page(info); // any active
 
+        if (info->spool)
+            fprintf(stderr, "DEBUG: (" PROGRAM ") Spooled %lld bytes of compressed page images\n", info->spool->bytes);
+
         QPDFWriter output(info->pdf,NULL);
         output.write();
     } catch (...) {
@@ -241,11 +288,13 @@ int close_pdf_file(struct pdf_info * info)
     return 0;
 }
 
-void pdf_set_line(struct pdf_info * info, unsigned line_n, uint8_t line[])
+void pdf_set_line(void * ctx, unsigned line_n, const uint8_t line[])
 {
+    struct pdf_info * info = (struct pdf_info *)ctx;
+
     dprintf("pdf_set_line(%d)\n", line_n);
 
-    if(line_n > info->height)
+    if(line_n >= info->height)
     {
         dprintf("Bad line %d\n", line_n);
         return;
@@ -274,144 +323,10 @@ struct urf_page_header {
     uint32_t unknown3;
 } __attribute__((__packed__));
 
-int decode_raster(int fd, unsigned width, unsigned height, int bpp, struct pdf_info * info)
-{
-    // We should be at raster start
-    int i, j;
-    unsigned cur_line = 0;
-    unsigned pos = 0;
-    uint8_t line_repeat_byte = 0;
-    unsigned line_repeat = 0;
-    int8_t packbit_code = 0;
-    int pixel_size = (bpp/8);
-    std::vector<uint8_t> pixel_container;
-    std::vector<uint8_t> line_container;
-
-    if (width > (std::numeric_limits<unsigned>::max() / pixel_size)) {
-        die("Line too big");
-    }
-    try {
-        pixel_container.resize(pixel_size);
-        line_container.resize(pixel_size*width);
-    } catch (...) {
-        die("Unable to allocate temporary storage");
-    }
-
-    do
-    {
-        if(read(fd, &line_repeat_byte, 1) < 1)
-        {
-            dprintf("l%06d : line_repeat EOF at %lu\n", cur_line, lseek(fd, 0, SEEK_CUR));
-            return 1;
-        }
-
-        line_repeat = (unsigned)line_repeat_byte + 1;
-
-        dprintf("l%06d : next actions for %d lines\n", cur_line, line_repeat);
-
-        // Start of line
-        pos = 0;
-
-        do
-        {
-            if(read(fd, &packbit_code, 1) < 1)
-            {
-                dprintf("p%06dl%06d : packbit_code EOF at %lu\n", pos, cur_line, lseek(fd, 0, SEEK_CUR));
-                return 1;
-            }
-
-            dprintf("p%06dl%06d: Raster code %02X='%d'.\n", pos, cur_line, (uint8_t)packbit_code, packbit_code);
-
-            if(packbit_code == -128)
-            {
-                dprintf("\tp%06dl%06d : blank rest of line.\n", pos, cur_line);
-                memset((&line_container[pos*pixel_size]), 0xFF, (pixel_size*(width-pos)));
-                pos = width;
-                break;
-            }
-            else if(packbit_code >= 0 && packbit_code <= 127)
-            {
-                int n = (packbit_code+1);
-
-                //Read pixel
-                if(read(fd, &pixel_container[0], pixel_size) < pixel_size)
-                {
-                    dprintf("p%06dl%06d : pixel repeat EOF at %lu\n", pos, cur_line, lseek(fd, 0, SEEK_CUR));
-                    return 1;
-                }
-
-                dprintf("\tp%06dl%06d : Repeat pixel '", pos, cur_line);
-                for(j = 0 ; j < pixel_size ; ++j)
-                    dprintf("%02X ", pixel_container[j]);
-                dprintf("' for %d times.\n", n);
-
-                for(i = 0 ; i < n ; ++i)
-                {
-                    //for(j = pixel_size-1 ; j >= 0 ; --j)
-                    for(j = 0 ; j < pixel_size ; ++j)
-                        line_container[pixel_size*pos + j] = pixel_container[j];
-                    ++pos;
-                    if(pos >= width)
-                        break;
-                }
-
-                if(i < n && pos >= width)
-                {
-                    dprintf("\tp%06dl%06d : Forced end of line for pixel repeat.\n", pos, cur_line);
-                }
-                
-                if(pos >= width)
-                    break;
-            }
-            else if(packbit_code > -128 && packbit_code < 0)
-            {
-                int n = (-(int)packbit_code)+1;
-
-                dprintf("\tp%06dl%06d : Copy %d verbatim pixels.\n", pos, cur_line, n);
-
-                for(i = 0 ; i < n ; ++i)
-                {
-                    if(read(fd, &pixel_container[0], pixel_size) < pixel_size)
-                    {
-                        dprintf("p%06dl%06d : literal_pixel EOF at %lu\n", pos, cur_line, lseek(fd, 0, SEEK_CUR));
-                        return 1;
-                    }
-                    //Invert pixels, should be programmable
-                    for(j = 0 ; j < pixel_size ; ++j)
-                        line_container[pixel_size*pos + j] = pixel_container[j];
-                    ++pos;
-                    if(pos >= width)
-                        break;
-                }
-
-                if(i < n && pos >= width)
-                {
-                    dprintf("\tp%06dl%06d : Forced end of line for pixel copy.\n", pos, cur_line);
-                }
-                
-                if(pos >= width)
-                    break;
-            }
-        }
-        while(pos < width);
-
-        dprintf("\tl%06d : End Of line, drawing %d times.\n", cur_line, line_repeat);
-
-        // write lines
-        for(i = 0 ; i < (int)line_repeat ; ++i)
-        {
-            pdf_set_line(info, cur_line, &line_container[0]);
-            ++cur_line;
-        }
-    }
-    while(cur_line < height);
-
-    return 0;
-}
-
 int main(int argc, char **argv)
 {
     int fd, page;
+    unirast_reader_t * reader;
     struct urf_file_header head, head_orig;
     struct urf_page_header page_header, page_header_orig;
     struct pdf_info pdf;
@@ -435,7 +350,10 @@ int main(int argc, char **argv)
     // Get fd from file
     fd = fileno(input);
 
-    if(read(fd, &head_orig, sizeof(head)) == -1) die("Unable to read file header");
+    // all reads are buffered; decoding byte by byte from the fd is far too slow
+    if((reader = unirast_reader_new(fd)) == NULL) die("Unable to allocate read buffer");
+
+    if(unirast_read(reader, &head_orig, sizeof(head)) != 0) die("Unable to read file header");
 
     //Transform
     memcpy(head.unirast, head_orig.unirast, sizeof(head.unirast));
@@ -452,7 +370,7 @@ int main(int argc, char **argv)
 
     for(page = 0 ; page < (int)head.page_count ; ++page)
     {
-        if(read(fd, &page_header_orig, sizeof(page_header_orig)) == -1) die("Unable to read page header");
+        if(unirast_read(reader, &page_header_orig, sizeof(page_header_orig)) != 0) die("Unable to read page header");
 
         //Transform
         page_header.bpp = page_header_orig.bpp;
@@ -487,10 +405,13 @@ int main(int argc, char **argv)
 
         if(add_pdf_page(&pdf, page, page_header.width, page_header.height, page_header.bpp, page_header.dot_per_inch) != 0) die("Unable to create PDF file");
 
-        if(decode_raster(fd, page_header.width, page_header.height, page_header.bpp, &pdf) != 0)
+        if(unirast_decode_raster(reader, page_header.width, page_header.height, page_header.bpp, pdf_set_line, &pdf) != 0)
             die("Failed to decode Page");
     }
 
+    fprintf(stderr, "DEBUG: (" PROGRAM ") Read %lld bytes of URF data\n", reader->bytes_read);
+    unirast_reader_free(reader);
+
     close_pdf_file(&pdf); // will output to stdout
 
     return 0;